@@ -0,0 +1,79 @@
+/*
+ * bench/headers.c - measures parse_headers over a corpus of header blocks
+ *
+ * Usage: bench_headers [corpus directory] [iterations]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "email/headers.h"
+
+static char *read_file(const char *path, size_t *size) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *data = malloc(len + 1);
+	*size = fread(data, 1, len, f);
+	data[*size] = '\0';
+	fclose(f);
+	return data;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	const char *dir = argc > 1 ? argv[1] : CORPUS_DIR;
+	long iterations = argc > 2 ? strtol(argv[2], NULL, 10) : 2000;
+	DIR *d = opendir(dir);
+	if (!d) {
+		fprintf(stderr, "Unable to open %s\n", dir);
+		return 1;
+	}
+	struct dirent *entry;
+	double total_bytes = 0, total_time = 0;
+	while ((entry = readdir(d))) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		size_t size;
+		char *text = read_file(path, &size);
+		if (!text) {
+			continue;
+		}
+		size_t headers = 0;
+		double start = now();
+		for (long i = 0; i < iterations; ++i) {
+			struct email_headers *parsed = create_email_headers();
+			parse_headers(text, parsed);
+			headers = parsed->headers->length;
+			free_headers(parsed);
+		}
+		double elapsed = now() - start;
+		printf("%-28s %7zu bytes %4zu headers %9.0f ns/block %8.1f MB/s\n",
+				entry->d_name, size, headers, elapsed / iterations * 1e9,
+				size * iterations / elapsed / 1e6);
+		total_bytes += (double)size * iterations;
+		total_time += elapsed;
+		free(text);
+	}
+	closedir(d);
+	if (total_time > 0) {
+		printf("%-28s %58.1f MB/s\n", "total", total_bytes / total_time / 1e6);
+	}
+	return 0;
+}
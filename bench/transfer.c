@@ -0,0 +1,144 @@
+/*
+ * bench/transfer.c - measures the base64 and quoted-printable decoders
+ *
+ * Decodes a generated attachment in 64 KiB chunks, the way it would arrive
+ * from the server, with each implementation this CPU supports. Base64 is
+ * measured both wrapped at 76 columns, as mailers send it, and unwrapped.
+ *
+ * Usage: bench_transfer [megabytes] [iterations]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "email/transfer.h"
+#include "util/base64.h"
+
+#define CHUNK 65536
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *make_base64(size_t size, bool wrap, size_t *len) {
+	unsigned char *data = malloc(size);
+	for (size_t i = 0; i < size; ++i) {
+		data[i] = rand();
+	}
+	int encoded_len;
+	char *encoded = base64(data, size, &encoded_len);
+	free(data);
+	if (!wrap) {
+		*len = encoded_len;
+		return encoded;
+	}
+	/* Break into 76 character lines, as mailers do */
+	char *text = malloc(encoded_len + encoded_len / 76 * 2 + 3);
+	size_t o = 0;
+	for (int i = 0; i < encoded_len; i += 76) {
+		int n = encoded_len - i < 76 ? encoded_len - i : 76;
+		memcpy(text + o, encoded + i, n);
+		o += n;
+		text[o++] = '\r';
+		text[o++] = '\n';
+	}
+	free(encoded);
+	*len = o;
+	return text;
+}
+
+static char *make_qp(size_t size, size_t *len) {
+	/* Mostly plain text, with the odd escape and soft line break */
+	char *text = malloc(size + 16);
+	size_t o = 0, column = 0;
+	while (o < size) {
+		int r = rand() % 100;
+		if (r < 3) {
+			o += sprintf(text + o, "=%02X", 0x80 + rand() % 0x80);
+			column += 3;
+		} else {
+			text[o++] = r < 18 ? ' ' : 'a' + r % 26;
+			++column;
+		}
+		if (column >= 72) {
+			memcpy(text + o, "=\r\n", 3);
+			o += 3;
+			column = 0;
+		}
+	}
+	*len = o;
+	return text;
+}
+
+static void bench_base64(const char *text, size_t len, long iterations,
+		const char *label) {
+	unsigned char *out = malloc(BASE64_DECODED_MAX(CHUNK));
+	for (int impl = TRANSFER_SCALAR;
+			impl <= (int)transfer_impl_best(); ++impl) {
+		double start = now();
+		size_t decoded = 0;
+		for (long n = 0; n < iterations; ++n) {
+			struct base64_decoder dec;
+			base64_decoder_init(&dec);
+			dec.impl = impl;
+			for (size_t i = 0; i < len; i += CHUNK) {
+				size_t chunk = len - i < CHUNK ? len - i : CHUNK;
+				decoded += base64_decode(&dec, text + i, chunk, out);
+			}
+			decoded += base64_decode_finish(&dec, out);
+		}
+		double elapsed = now() - start;
+		printf("base64 %-8s %-9s %10zu bytes out %8.1f MB/s\n",
+				transfer_impl_name(impl), label, decoded / iterations,
+				len * iterations / elapsed / 1e6);
+	}
+	free(out);
+}
+
+static void bench_qp(const char *text, size_t len, long iterations) {
+	char *out = malloc(QP_DECODED_MAX(CHUNK));
+	for (int impl = TRANSFER_SCALAR;
+			impl <= (int)transfer_impl_best(); ++impl) {
+		double start = now();
+		size_t decoded = 0;
+		for (long n = 0; n < iterations; ++n) {
+			struct qp_decoder dec;
+			qp_decoder_init(&dec);
+			dec.impl = impl;
+			for (size_t i = 0; i < len; i += CHUNK) {
+				size_t chunk = len - i < CHUNK ? len - i : CHUNK;
+				decoded += qp_decode(&dec, text + i, chunk, out);
+			}
+			decoded += qp_decode_finish(&dec, out);
+		}
+		double elapsed = now() - start;
+		printf("qp     %-8s %-9s %10zu bytes out %8.1f MB/s\n",
+				transfer_impl_name(impl), "", decoded / iterations,
+				len * iterations / elapsed / 1e6);
+	}
+	free(out);
+}
+
+int main(int argc, char **argv) {
+	long megabytes = argc > 1 ? strtol(argv[1], NULL, 10) : 30;
+	long iterations = argc > 2 ? strtol(argv[2], NULL, 10) : 5;
+	size_t size = (size_t)megabytes * 1024 * 1024;
+	srand(1);
+	size_t len;
+	char *text = make_base64(size, true, &len);
+	bench_base64(text, len, iterations, "wrapped");
+	free(text);
+	text = make_base64(size, false, &len);
+	bench_base64(text, len, iterations, "unwrapped");
+	free(text);
+	text = make_qp(size, &len);
+	bench_qp(text, len, iterations);
+	free(text);
+	return 0;
+}
@@ -1,10 +1,41 @@
 #ifndef _COLORS_H
 #define _COLORS_H
 
+#include <stdbool.h>
 #include <termbox.h>
 
-void set_color(const char *name, const char *value);
-void get_color(const char *name, struct tb_cell *cell);
+/*
+ * Every color the UI draws with. Names from the [colors] section are
+ * resolved to one of these when the config is loaded, so drawing is just an
+ * array lookup.
+ */
+enum color_role {
+	COLOR_BORDERS,
+	COLOR_LOADING_INDICATOR,
+	COLOR_ACCOUNT_UNSELECTED,
+	COLOR_ACCOUNT_SELECTED,
+	COLOR_ACCOUNT_ERROR,
+	COLOR_FOLDER_UNSELECTED,
+	COLOR_FOLDER_SELECTED,
+	COLOR_STATUS_LINE,
+	COLOR_STATUS_LINE_ERROR,
+	COLOR_EX_LINE,
+	COLOR_MESSAGE_LIST_SELECTED,
+	COLOR_MESSAGE_LIST_UNSELECTED,
+	COLOR_MESSAGE_LIST_SELECTED_UNREAD,
+	COLOR_MESSAGE_LIST_UNSELECTED_UNREAD,
+	COLOR_ROLE_COUNT,
+};
+
+extern struct tb_cell colors[COLOR_ROLE_COUNT];
+
+// Returns false if name isn't a color we know
+bool set_color(const char *name, const char *value);
 void colors_init();
 
+static inline void get_color(enum color_role role, struct tb_cell *cell) {
+	cell->fg = colors[role].fg;
+	cell->bg = colors[role].bg;
+}
+
 #endif
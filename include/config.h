@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 
+#include "index_format.h"
 #include "util/list.h"
 
 struct account_config_extra {
@@ -19,12 +20,14 @@ struct aerc_config {
 	struct {
 		list_t *loading_frames;
 		char *index_format;
+		struct index_format *index; // index_format, compiled
 		char *timestamp_format;
 		char *render_account_tabs;
 		char *border_style;
 		bool show_all_headers;
 		bool render_sidebar;
 		int sidebar_width;
+		int max_fps; // 0 for no limit
 	} ui;
 	list_t *accounts;
 };
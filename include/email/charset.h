@@ -0,0 +1,23 @@
+#ifndef _EMAIL_CHARSET_H
+#define _EMAIL_CHARSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Converts text in any charset iconv knows about to UTF-8.
+ *
+ * Opening an iconv handle is expensive (glibc loads a gconv module each
+ * time), so handles are opened once per charset and kept in a pool shared by
+ * every thread.
+ */
+
+// Returns a NUL-terminated UTF-8 copy of the text, or NULL if the charset is
+// unknown. Invalid input is replaced with U+FFFD.
+char *charset_to_utf8(const char *charset, const char *text, size_t len);
+// True for charsets that need no conversion to UTF-8
+bool charset_is_utf8(const char *charset);
+// Closes every pooled handle
+void charset_pool_free(void);
+
+#endif
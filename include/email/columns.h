@@ -0,0 +1,74 @@
+#ifndef _EMAIL_COLUMNS_H
+#define _EMAIL_COLUMNS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "email/flags.h"
+#include "util/uidset.h"
+
+/*
+ * The fields the message list shows and sorts on, for every loaded message
+ * in a mailbox, stored column by column: one array each of UIDs, flags,
+ * dates and sizes, and offsets into a single pool of strings for the subject and
+ * sender. Rendering a screenful or sorting the whole mailbox then reads a few
+ * contiguous arrays instead of following pointers into every message.
+ *
+ * Rows are appended as messages are loaded and are looked up by UID. Removed
+ * rows are left empty until they outnumber the live ones, at which point the
+ * columns (and the string pool) are compacted, so rows are only meaningful
+ * until the next change.
+ */
+
+#define COLUMNS_NONE SIZE_MAX
+#define COLUMNS_DATE_MAX 32
+
+struct message_columns {
+	size_t count; // Live rows
+	size_t length, capacity;
+	long *uids; // 0 for removed rows
+	flagset_t *flags;
+	int64_t *dates; // Internal date, in seconds since the epoch
+	int64_t *sent_dates; // Date: header, or the internal date without one
+	uint32_t *sizes; // In bytes, 0 if not fetched
+	uint32_t *subjects, *froms; // Offsets into pool
+	int *subject_widths; // In columns, measured as rows are set
+	// Each row's date as the renderer last formatted it, or "" if it hasn't
+	// been yet. Cleared when the date stamp changes.
+	char (*date_texts)[COLUMNS_DATE_MAX];
+	uint64_t date_stamp;
+	char *pool;
+	size_t pool_length, pool_capacity, pool_garbage;
+	size_t *buckets; // Open addressing, row by UID
+	size_t bucket_count;
+};
+
+struct message_columns *create_message_columns(void);
+void message_columns_free(struct message_columns *columns);
+// Adds or updates the row for uid and returns it
+size_t message_columns_set(struct message_columns *columns, long uid,
+		flagset_t flags, int64_t date, int64_t sent_date, uint32_t size,
+		const char *subject, const char *from);
+void message_columns_remove(struct message_columns *columns, long uid);
+// Returns the row for uid, or COLUMNS_NONE
+size_t message_columns_row(const struct message_columns *columns, long uid);
+const char *message_columns_subject(const struct message_columns *columns,
+		size_t row);
+const char *message_columns_from(const struct message_columns *columns,
+		size_t row);
+/*
+ * Forgets every formatted date if stamp is different from the last one. The
+ * renderer passes something that changes with the date format and the day.
+ */
+void message_columns_date_stamp(struct message_columns *columns,
+		uint64_t stamp);
+/*
+ * Sorts every row by IMAP SORT criteria (RFC 5256), e.g. "REVERSE DATE".
+ * ARRIVAL, DATE, FROM and SUBJECT are supported. As in the RFC, ARRIVAL is the
+ * internal date and DATE is the Date: header.
+ * Returns the UIDs in order, or NULL if the criteria use anything else.
+ */
+uidset_t *message_columns_sort(const struct message_columns *columns,
+		const char *order);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _EMAIL_FLAGS_H
+#define _EMAIL_FLAGS_H
+
+#include <stdint.h>
+
+/*
+ * Message flags are kept as a bitset rather than a list of strings. The system
+ * flags have fixed bits; keywords ($Label1, $Junk, ...) are interned per
+ * account and get the next free bit. Checking a flag is then a single AND.
+ *
+ * Flag names are case-insensitive, as in IMAP. The table is shared by the
+ * main thread and the worker, and is safe to use from both.
+ */
+
+typedef uint64_t flagset_t;
+
+#define FLAG_SEEN     ((flagset_t)1 << 0)
+#define FLAG_ANSWERED ((flagset_t)1 << 1)
+#define FLAG_FLAGGED  ((flagset_t)1 << 2)
+#define FLAG_DELETED  ((flagset_t)1 << 3)
+#define FLAG_DRAFT    ((flagset_t)1 << 4)
+#define FLAG_RECENT   ((flagset_t)1 << 5)
+
+#define FLAG_MAX 64
+
+struct flag_table;
+
+struct flag_table *create_flag_table(void);
+void flag_table_free(struct flag_table *table);
+// Returns the bit for this flag, adding it if need be, or 0 if the table is full
+flagset_t flag_intern(struct flag_table *table, const char *name);
+// Returns the bit for this flag, or 0 if it has never been seen
+flagset_t flag_lookup(struct flag_table *table, const char *name);
+// Returns the name of a single flag bit, or NULL
+const char *flag_name(struct flag_table *table, flagset_t flag);
+// Returns the names of the flags in the set, separated by spaces. Free it.
+char *flagset_serialize(struct flag_table *table, flagset_t flags);
+
+#endif
@@ -1,13 +1,72 @@
 #ifndef _EMAIL_HEADERS_H
 #define _EMAIL_HEADERS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "util/list.h"
 
+/*
+ * The headers we look at all the time get a fixed slot in struct
+ * email_headers, so finding the subject is a field load rather than a search.
+ * Every header is also kept in order in a list, for showing them all.
+ *
+ * Header names are interned: every header with the same name (compared
+ * without regard to case) shares one key string for the life of the program,
+ * so keys are never copied or freed, and can be compared by pointer.
+ */
+
+enum header_field {
+	HEADER_DATE,
+	HEADER_FROM,
+	HEADER_SUBJECT,
+	HEADER_TO,
+	HEADER_CC,
+	HEADER_MESSAGE_ID,
+	HEADER_REFERENCES,
+	HEADER_IN_REPLY_TO,
+	HEADER_CONTENT_TYPE,
+	HEADER_REPLY_TO,
+	HEADER_FIELD_COUNT
+};
+
 struct email_header {
-	char *key, *value;
+	const char *key; // Interned
+	char *value;
+};
+
+struct email_headers {
+	// The value of the first header of each kind, or NULL
+	const char *fields[HEADER_FIELD_COUNT];
+	// The same values with RFC 2047 encoded words decoded, or NULL if that
+	// made no difference. See decode_headers.
+	char *decoded[HEADER_FIELD_COUNT];
+	list_t *headers; // struct email_header, in message order
+	// Storage for the above, owned by this struct
+	struct email_header *records;
+	char *arena;
+	size_t arena_size;
 };
 
-int parse_headers(const char *headers, list_t *output);
-void free_headers(list_t *headers);
+struct email_headers *create_email_headers(void);
+// Parses a header block into an empty struct email_headers
+int parse_headers(const char *headers, struct email_headers *output);
+void free_headers(struct email_headers *headers);
+struct email_headers *copy_headers(const struct email_headers *headers);
+// Decodes the encoded words in the fields meant for people to read (Subject,
+// From, To, Cc and Reply-To), once, so that rendering can use them as is
+void decode_headers(struct email_headers *headers);
+// Returns the decoded value of a field if there is one, or its raw value
+const char *header_text(const struct email_headers *headers,
+		enum header_field field);
+// Returns the canonical name of a field, e.g. "Message-ID"
+const char *header_field_name(enum header_field field);
+// Returns the value of the first header named key, or NULL
+const char *get_header(const struct email_headers *headers, const char *key);
+// Returns the shared copy of a header name
+const char *intern_header_key(const char *key);
+// Returns an RFC 5322 date, e.g. the Date: header, in seconds since the
+// epoch, or 0 if it isn't one. Obsolete forms and zone names are understood.
+int64_t parse_header_date(const char *value);
 
 #endif
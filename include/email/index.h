@@ -0,0 +1,57 @@
+#ifndef _EMAIL_INDEX_H
+#define _EMAIL_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/uidset.h"
+
+/*
+ * A local inverted index over message text (usually Subject, From, To and Cc)
+ * for searching without talking to the server.
+ *
+ * Text is split into lowercase tokens. Each token maps to a posting list of
+ * document IDs, stored as varint-encoded deltas. Documents are numbered in
+ * the order they are added, so posting lists are always appended to and
+ * never rewritten.
+ *
+ * Expunged messages are marked removed and left out of results, and are
+ * dropped from the posting lists when the index is next saved. When a
+ * mailbox's UIDVALIDITY changes, everything indexed for it is removed.
+ *
+ * The index is persisted in two files: a compact snapshot at the given path,
+ * and a journal (path + ".journal") that every change is appended to as it
+ * happens. The journal is folded into the snapshot by email_index_save.
+ */
+
+struct email_index;
+
+// Loads the index from disk, or creates an empty one if path doesn't exist.
+// A NULL path gives an in-memory index.
+struct email_index *email_index_open(const char *path);
+void email_index_close(struct email_index *index);
+// Returns true if the message was already indexed
+bool email_index_contains(struct email_index *index, const char *mailbox,
+		long uid);
+// Indexes the given text under mailbox/uid. Messages already in the index are
+// ignored.
+void email_index_add(struct email_index *index, const char *mailbox,
+		long uid, const char *text);
+// Forgets the message with this UID, if it was indexed
+void email_index_remove(struct email_index *index, const char *mailbox,
+		long uid);
+// Records the mailbox's UIDVALIDITY, forgetting every message indexed under
+// a different one
+void email_index_set_uidvalidity(struct email_index *index,
+		const char *mailbox, uint32_t uidvalidity);
+// Returns the UIDs in mailbox which contain every token in query. A token
+// ending in '*' matches every token that starts with it. Other single
+// characters are ignored, since they aren't indexed.
+uidset_t *email_index_query(struct email_index *index, const char *mailbox,
+		const char *query);
+// Writes a new snapshot and truncates the journal.
+bool email_index_save(struct email_index *index);
+// Returns the default path of the index for the given account key.
+char *email_index_path(const char *key);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _EMAIL_RFC2047_H
+#define _EMAIL_RFC2047_H
+
+// Implements RFC 2047 (MIME Part Three: Message Header Extensions)
+
+/*
+ * Decodes the encoded words (=?charset?B?...?= and =?charset?Q?...?=) in a
+ * header value to UTF-8. Returns NULL if there was nothing to decode, or a
+ * new string otherwise. Words that can't be decoded are left as they are.
+ */
+char *rfc2047_decode(const char *text);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef _EMAIL_THREAD_H
+#define _EMAIL_THREAD_H
+
+#include <stddef.h>
+
+#include "util/uidset.h"
+
+/*
+ * Threads messages together with the algorithm described by Jamie Zawinski
+ * (https://www.jwz.org/doc/threading.html), the same one IMAP servers use for
+ * THREAD=REFERENCES.
+ *
+ * The thread index is built incrementally: every message is linked in as it
+ * is added, with a hash table on Message-ID to find the messages it refers
+ * to. Adding a message costs O(number of references), regardless of how many
+ * messages are already threaded.
+ */
+
+struct thread_node {
+	char *message_id;
+	long uid; // 0 if we've only seen references to this message
+	struct thread_node *parent;
+	struct thread_node *child, *last_child;
+	struct thread_node *prev, *next;
+};
+
+struct thread_index {
+	struct thread_node root; // Top-level messages are children of this
+	struct thread_node **slots;
+	size_t slot_count, node_count;
+	uidset_t *uids; // Messages added so far
+};
+
+/*
+ * A flattened thread forest, ready for display. UIDs are in display order and
+ * depths[n] is the nesting level of the nth UID.
+ */
+struct thread_list {
+	uidset_t *uids;
+	int *depths;
+	size_t length, capacity;
+};
+
+struct thread_index *create_thread_index(void);
+void thread_index_free(struct thread_index *index);
+// Links a message into the thread index. References and in_reply_to are the
+// raw header values and may be NULL. Messages already added are ignored.
+void thread_index_add(struct thread_index *index, long uid,
+		const char *message_id, const char *references,
+		const char *in_reply_to);
+// Flattens the threads with the newest thread first.
+struct thread_list *thread_index_flatten(struct thread_index *index);
+
+struct thread_list *create_thread_list(void);
+void thread_list_append(struct thread_list *list, long uid, int depth);
+void thread_list_free(struct thread_list *list);
+
+#endif
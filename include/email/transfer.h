@@ -0,0 +1,66 @@
+#ifndef _EMAIL_TRANSFER_H
+#define _EMAIL_TRANSFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming decoders for the base64 and quoted-printable
+ * Content-Transfer-Encodings (RFC 2045).
+ *
+ * Bodies arrive from the server in whatever pieces ab_recv hands us, so the
+ * decoders carry any partial quantum over from one chunk to the next and can
+ * be fed a large attachment a piece at a time. On x86 the inner loops use
+ * SSSE3 or AVX2 when the CPU has them; the choice is made once at runtime.
+ */
+
+enum transfer_impl {
+	TRANSFER_SCALAR,
+	TRANSFER_SSE, // SSE2 for quoted-printable, SSSE3 for base64
+	TRANSFER_AVX2,
+};
+
+// The fastest implementation this CPU supports
+enum transfer_impl transfer_impl_best(void);
+const char *transfer_impl_name(enum transfer_impl impl);
+
+struct base64_decoder {
+	enum transfer_impl impl;
+	uint32_t bits; // Sextets of the current quantum
+	int count; // Number of sextets in bits
+};
+
+// The output buffer given to base64_decode must have room for this many
+// bytes for an input chunk of len bytes
+#define BASE64_DECODED_MAX(len) ((len) / 4 * 3 + 3)
+
+void base64_decoder_init(struct base64_decoder *dec);
+// Decodes a chunk, skipping line breaks and anything else outside the
+// alphabet, and returns the number of bytes written to out
+size_t base64_decode(struct base64_decoder *dec,
+		const char *in, size_t len, unsigned char *out);
+// Flushes a final quantum that was missing its padding. out needs room for
+// 2 bytes.
+size_t base64_decode_finish(struct base64_decoder *dec, unsigned char *out);
+
+struct qp_decoder {
+	enum transfer_impl impl;
+	char pending[3]; // An escape split across chunks, starting with '='
+	int pending_length;
+};
+
+// The output buffer given to qp_decode must have room for this many bytes
+// for an input chunk of len bytes
+#define QP_DECODED_MAX(len) ((len) + 3)
+
+void qp_decoder_init(struct qp_decoder *dec);
+// Decodes a chunk and returns the number of bytes written to out. Soft line
+// breaks are removed; malformed escapes are passed through as they are.
+size_t qp_decode(struct qp_decoder *dec,
+		const char *in, size_t len, char *out);
+// Flushes an escape left incomplete at the end of the input. out needs room
+// for 3 bytes.
+size_t qp_decode_finish(struct qp_decoder *dec, char *out);
+
+#endif
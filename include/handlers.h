@@ -4,6 +4,9 @@
 #include "state.h"
 #include "worker.h"
 
+// Asks the worker for the messages in mbox that rendering found missing
+void fetch_necessary(struct account_state *account,
+		struct aerc_mailbox *mbox);
 void handle_worker_connect_done(struct account_state *account,
 		struct worker_message *message);
 void handle_worker_connect_error(struct account_state *account,
@@ -20,5 +23,23 @@ void handle_worker_message_updated(struct account_state *account,
 		struct worker_message *message);
 void handle_worker_mailbox_deleted(struct account_state *account,
 		struct worker_message *message);
+void handle_worker_messages_expunged(struct account_state *account,
+		struct worker_message *message);
+void handle_worker_store_flags_done(struct account_state *account,
+		struct worker_message *message);
+void handle_worker_store_flags_error(struct account_state *account,
+		struct worker_message *message);
+void handle_worker_search_done(struct account_state *account,
+		struct worker_message *message);
+void handle_worker_search_error(struct account_state *account,
+		struct worker_message *message);
+void handle_worker_sort_done(struct account_state *account,
+		struct worker_message *message);
+void handle_worker_thread_done(struct account_state *account,
+		struct worker_message *message);
+void handle_worker_thread_error(struct account_state *account,
+		struct worker_message *message);
+void handle_worker_sort_error(struct account_state *account,
+		struct worker_message *message);
 
 #endif
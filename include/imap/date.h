@@ -1,8 +1,11 @@
 #ifndef _IMAP_DATE_H
 #define _IMAP_DATE_H
 
+#include <stdint.h>
 #include <time.h>
 
 char *parse_imap_date(const char *str, struct tm *time);
+// Seconds since the epoch of a date returned by parse_imap_date
+int64_t imap_date_epoch(const struct tm *time);
 
 #endif
@@ -7,9 +7,12 @@
 #include <stdbool.h>
 
 #include "absocket.h"
+#include "email/flags.h"
 #include "urlparse.h"
 #include "util/hashtable.h"
 #include "util/list.h"
+#include "util/seqmap.h"
+#include "util/uidset.h"
 
 // TODO: Refactor these into the internal header:
 // - recv_mode
@@ -23,6 +26,10 @@ struct imap_capabilities {
 	bool auth_login;
 	bool idle;
 	bool sasl_ir;
+	bool esearch;
+	bool sort;
+	bool esort;
+	bool thread_references;
 };
 
 enum imap_status {
@@ -36,9 +43,24 @@ enum recv_mode {
 };
 
 struct imap_connection;
+struct email_index;
+struct thread_index;
+struct thread_list;
 
 typedef void (*imap_callback_t)(struct imap_connection *imap,
 		void *data, enum imap_status status, const char *args);
+/*
+ * Invoked when a SEARCH or SORT completes. The callback takes ownership of the
+ * result set, which is NULL if the command failed.
+ */
+typedef void (*imap_search_callback_t)(struct imap_connection *imap,
+		void *data, enum imap_status status, uidset_t *uids);
+/*
+ * Invoked when a THREAD completes. Ownership of the threads is passed to the
+ * callback, and they are NULL if the command failed.
+ */
+typedef void (*imap_thread_callback_t)(struct imap_connection *imap,
+		void *data, enum imap_status status, struct thread_list *threads);
 
 struct mailbox_flag {
 	char *name;
@@ -49,18 +71,22 @@ struct mailbox_message {
 	bool fetching, populated;
 	int index;
 	long uid;
-	list_t *flags, *headers;
-	struct tm *internal_date;
+	flagset_t flags;
+	uint32_t size; // RFC822.SIZE, if we asked for it
+	struct email_headers *headers;
+	int64_t internal_date; // Seconds since the epoch, 0 if unknown
 };
 
 struct mailbox {
 	list_t *flags;
-	list_t *messages;
+	seqmap_t *messages; // struct mailbox_message by sequence number and UID
 	char *name;
 	long exists, recent, unseen;
 	long nextuid; // Predicted, not definite
+	long uidvalidity; // 0 until the server says
 	bool read_write;
 	bool selected;
+	char delimiter; // Hierarchy delimiter from LIST, or '\0' for none
 };
 
 struct imap_connection {
@@ -68,6 +94,10 @@ struct imap_connection {
 		void (*mailbox_updated)(struct imap_connection *);
 		void (*mailbox_deleted)(struct imap_connection *, const char *name);
 		void (*message_updated)(struct imap_connection *, struct mailbox_message *);
+		// Called after a message is removed, with its old sequence number and
+		// its UID, or 0 if that wasn't known
+		void (*message_expunged)(struct imap_connection *, size_t seq,
+				long uid);
 	} events;
 
 	void *data;
@@ -84,6 +114,15 @@ struct imap_connection {
 	struct uri *uri;
 	list_t *mailboxes;
 	char *selected;
+	list_t *searches; // In-flight SEARCH/SORT commands, oldest first
+	list_t *threads; // In-flight THREAD commands, oldest first
+	struct email_index *index; // Owned by the worker, may be NULL
+	struct thread_index *thread_index; // Owned by the worker, may be NULL
+	uidset_t *expunged; // Owned by the worker, may be NULL
+	struct flag_table *flags; // Shared with the main thread, not owned
+	// What the main thread wants fetched for each message
+	uint32_t fetch_headers; // Bitmask of enum header_field values
+	bool fetch_size;
 };
 
 enum imap_type {
@@ -123,7 +162,35 @@ void imap_select(struct imap_connection *imap, imap_callback_t callback,
 		void *data, const char *mailbox);
 void imap_fetch(struct imap_connection *imap, imap_callback_t callback,
 		void *data, size_t min, size_t max, const char *what);
+void imap_uid_fetch(struct imap_connection *imap, imap_callback_t callback,
+		void *data, const uidset_t *uids, const char *what);
 void imap_delete(struct imap_connection *imap, imap_callback_t callback,
 		void *data, const char *mailbox);
+/*
+ * Searches the selected mailbox for UIDs matching the given IMAP search
+ * criteria.
+ */
+void imap_search(struct imap_connection *imap, imap_search_callback_t callback,
+		void *data, const char *criteria);
+/*
+ * Like imap_search, but the results are ordered per the given SORT criteria
+ * (e.g. "REVERSE DATE"). Requires the SORT extension.
+ */
+void imap_sort(struct imap_connection *imap, imap_search_callback_t callback,
+		void *data, const char *order, const char *criteria);
+/*
+ * Adds (or removes) flags on every message in uids, in as few UID STORE
+ * commands as possible. Our copy of the messages is updated immediately and
+ * put back if the server refuses. The UIDs covered by any command that was
+ * refused are added to failed, if it isn't NULL, before the callback runs.
+ */
+void imap_store(struct imap_connection *imap, imap_callback_t callback,
+		void *data, const uidset_t *uids, bool add, flagset_t flags,
+		uidset_t *failed);
+/*
+ * Threads the messages matching criteria with THREAD=REFERENCES.
+ */
+void imap_thread(struct imap_connection *imap, imap_thread_callback_t callback,
+		void *data, const char *criteria);
 
 #endif
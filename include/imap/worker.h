@@ -13,6 +13,12 @@ void handle_worker_cert_okay(struct worker_pipe *pipe, struct worker_message *me
 void handle_worker_list(struct worker_pipe *pipe, struct worker_message *message);
 void handle_worker_select_mailbox(struct worker_pipe *pipe, struct worker_message *message);
 void handle_worker_fetch_messages(struct worker_pipe *pipe, struct worker_message *message);
+void handle_worker_fetch_uids(struct worker_pipe *pipe, struct worker_message *message);
+void handle_worker_set_fetch_fields(struct worker_pipe *pipe, struct worker_message *message);
+void handle_worker_search(struct worker_pipe *pipe, struct worker_message *message);
+void handle_worker_sort(struct worker_pipe *pipe, struct worker_message *message);
+void handle_worker_thread(struct worker_pipe *pipe, struct worker_message *message);
+void handle_worker_store_flags(struct worker_pipe *pipe, struct worker_message *message);
 void handle_worker_delete_mailbox(struct worker_pipe *pipe, struct worker_message *message);
 
 #endif
@@ -0,0 +1,81 @@
+#ifndef _INDEX_FORMAT_H
+#define _INDEX_FORMAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <termbox.h>
+
+#include "email/flags.h"
+
+/*
+ * The index format (ui.index-format) decides what each row of the message
+ * list shows, using mutt's printf-like syntax:
+ *
+ *   %[-][min][.max]X
+ *
+ * where X is one of:
+ *
+ *   C  message number      D, d  date, per ui.timestamp-format
+ *   Z  status flags        n     author's name, or address if there isn't one
+ *   s  subject             a, f  author's full From header
+ *   c  size                %     a literal %
+ *
+ * The format is compiled once, when the config is loaded, into a list of
+ * ops that the renderer runs for each row.
+ */
+
+enum index_field {
+	INDEX_LITERAL,
+	INDEX_NUMBER,
+	INDEX_DATE,
+	INDEX_FLAGS,
+	INDEX_NAME,
+	INDEX_FROM,
+	INDEX_SUBJECT,
+	INDEX_SIZE,
+};
+
+struct index_op {
+	enum index_field field;
+	int min_width; // Padded with spaces to at least this many columns
+	int max_width; // Truncated to this many columns, or -1
+	bool left_align;
+	// For INDEX_LITERAL, an offset into the format's literal text
+	size_t literal, literal_length;
+};
+
+struct index_format {
+	struct index_op *ops;
+	size_t length;
+	char *literals;
+	// What the ops need fetched: a bitmask of enum header_field values, and
+	// whether the size is shown
+	uint32_t headers;
+	bool size;
+};
+
+// Everything the ops can show about one message
+struct index_row {
+	size_t number;
+	int64_t date;
+	// Where to keep the formatted date between renders, or NULL. The date is
+	// formatted again if this holds an empty string.
+	char *date_text;
+	size_t date_text_size;
+	uint32_t size;
+	flagset_t flags;
+	const char *subject, *from;
+	int subject_width; // In columns, or 0 if it has to be measured
+	int depth; // Thread depth, for indenting the subject
+};
+
+struct index_format *compile_index_format(const char *format);
+void free_index_format(struct index_format *format);
+// Renders a row into at most width cells, taking colors from basis. Returns
+// the number of cells used.
+int render_index_format(const struct index_format *format,
+		const struct index_row *row, const struct tb_cell *basis,
+		struct tb_cell *cells, int width);
+
+#endif
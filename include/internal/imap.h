@@ -25,10 +25,22 @@ void handle_imap_existsunseenrecent(struct imap_connection *imap,
 		const char *token, const char *cmd, imap_arg_t *args);
 void handle_imap_uidnext(struct imap_connection *imap, const char *token,
 		const char *cmd, imap_arg_t *args);
+void handle_imap_uidvalidity(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args);
 void handle_imap_readwrite(struct imap_connection *imap, const char *token,
 		const char *cmd, imap_arg_t *args);
 void handle_imap_fetch(struct imap_connection *imap, const char *token,
 		const char *cmd, imap_arg_t *args);
+void handle_imap_search(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args);
+void handle_imap_esearch(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args);
+void handle_imap_thread(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args);
+void handle_imap_expunge(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args);
+void handle_imap_vanished(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args);
 
 /* Parses an IMAP argument string and sets "remaining" the number of characters
  * necessary to complete parsing (if the string doesn't represent a complete
@@ -1,11 +1,17 @@
 #ifndef _RENDER_H
 #define _RENDER_H
 
+#include "util/uidset.h"
+
 void render_account_bar(int x, int y, int width, int folder_width);
 void render_folder_list(int x, int y, int width, int height);
 void render_status(int x, int y, int width);
 void render_items(int x, int y, int width, int height);
-void render_item(int x, int y, int width, int height,
-		struct aerc_message *message, bool selected);
+// Redraws only the message list rows (counted from the top of the list) in rows
+void render_rows(int x, int y, int width, int height, const uidset_t *rows);
+// Returns true if the message is drawn as loading, because we don't have it
+bool render_item(int x, int y, int width, int height,
+		struct aerc_mailbox *mailbox, struct aerc_message *message,
+		size_t number, bool selected, int depth);
 
 #endif
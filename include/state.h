@@ -6,6 +6,7 @@
 
 #include "bind.h"
 #include "util/list.h"
+#include "util/uidset.h"
 #include "worker.h"
 
 enum account_status {
@@ -29,6 +30,23 @@ struct account_state {
 	struct {
 		size_t selected_message;
 		size_t list_offset;
+		uidset_t *search; // UIDs matching the last :search
+		uidset_t *sort; // Display order from the last :sort or :thread
+		int *depths; // Thread depth of each row in sort, if threaded
+		// The UID shown on each row of sort, so rows are found in O(1)
+		long *rows;
+		size_t row_count;
+		// Sequence numbers of the messages drawn as still loading, for
+		// fetch_necessary to ask for after the frame
+		uidset_t *missing;
+		// The same for rows of sort, by UID, since we may not have their
+		// messages at all; and the UIDs already asked for that way
+		uidset_t *missing_uids, *requested_uids;
+		// Indices into mailboxes of the folders on show (those whose
+		// parents are all expanded), or NULL until they're next needed
+		size_t *folder_rows;
+		size_t folder_count;
+		size_t folder_offset;
 	} ui;
 
 	char *name;
@@ -41,7 +59,6 @@ struct aerc_state {
 	size_t selected_account;
 	list_t *accounts;
 	bool exit;
-	bool rerender;
 	struct {
 		char *text;
 		size_t length, index, scroll;
@@ -53,13 +70,47 @@ extern struct aerc_state *state;
 
 void set_status(struct account_state *account, enum account_status state,
 		const char *text);
+/*
+ * account->mailboxes is kept sorted by name, so mailboxes are found by binary
+ * search and the folder list never has to sort.
+ */
 struct aerc_mailbox *get_aerc_mailbox(struct account_state *account,
 		const char *name);
+// Index of the mailbox in account->mailboxes, or -1
+int get_aerc_mailbox_index(struct account_state *account, const char *name);
+// Replaces the account's mailboxes with a freshly listed set
+void set_aerc_mailboxes(struct account_state *account, list_t *mailboxes);
+// Adds a mailbox, or replaces the one with the same name. Takes ownership.
+void put_aerc_mailbox(struct account_state *account,
+		struct aerc_mailbox *mbox);
+void remove_aerc_mailbox(struct account_state *account, const char *name);
+// The folders on show, in order. Worked out again after folders are added,
+// removed, expanded or collapsed.
+const size_t *get_folder_rows(struct account_state *account, size_t *count);
+// Call after expanding or collapsing a folder
+void invalidate_folder_rows(struct account_state *account);
+// Which of the folder rows shows mailboxes->items[index], or -1 if it's hidden
+long get_folder_row(struct account_state *account, size_t index);
 void free_aerc_mailbox(struct aerc_mailbox *mbox);
 void free_aerc_message(struct aerc_message *msg);
+void reset_message_view(struct account_state *account);
+// Replaces the sort order (and thread depths) with these, taking ownership,
+// and goes back to the top of the list. sort may be NULL.
+void set_sort(struct account_state *account, uidset_t *sort, int *depths);
+// Rebuilds ui.rows after ui.sort was changed in place
+void index_sort_rows(struct account_state *account);
+struct aerc_message *get_aerc_message_by_uid(struct aerc_mailbox *mbox,
+		long uid);
 const char *get_message_header(struct aerc_message *msg, char *key);
-bool get_message_flag(struct aerc_message *msg, char *flag);
 bool get_mailbox_flag(struct aerc_mailbox *mbox, char *flag);
+// Brings the mailbox's columns up to date with a freshly fetched message
+void update_message_columns(struct aerc_mailbox *mbox,
+		struct aerc_message *msg);
+// Changes the flags of every loaded message in uids. Returns the UIDs of the
+// messages that actually changed.
+uidset_t *set_message_flags(struct aerc_mailbox *mbox, const uidset_t *uids,
+		flagset_t flags, bool set);
+void free_flag_request(struct flag_request *request);
 struct account_config *config_for_account(const char *name);
 
 #endif
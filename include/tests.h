@@ -15,11 +15,30 @@ void *__wrap_hashtable_get(hashtable_t *table, const void *key);
 int __wrap_poll(struct pollfd fds[], nfds_t nfds, int timeout);
 void set_ab_recv_result(void *buffer, size_t size);
 int __wrap_ab_recv(absocket_t *socket, void *buffer, size_t len);
+ssize_t __wrap_ab_send(absocket_t *socket, void *buffer, size_t len);
 
 /* Tests */
 int run_tests_urlparse();
 int run_tests_imap();
 int run_tests_headers();
 int run_tests_bind();
+int run_tests_search();
+int run_tests_uidset();
+int run_tests_index();
+int run_tests_thread();
+int run_tests_seqmap();
+int run_tests_expunge();
+int run_tests_store();
+int run_tests_fetch();
+int run_tests_flags();
+int run_tests_columns();
+int run_tests_rfc2047();
+int run_tests_transfer();
+int run_tests_index_format();
+int run_tests_colors();
+int run_tests_spinners();
+int run_tests_state();
+int run_tests_utf7();
+int run_tests_wcwidth();
 
 #endif
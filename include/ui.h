@@ -2,15 +2,64 @@
 #define _UI_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "termbox.h"
 
+/*
+ * Nothing is drawn when something changes. Instead the part of the screen it
+ * affects is marked as damaged, and everything damaged is redrawn together at
+ * the end of the next ui_tick.
+ */
+enum damage {
+	DAMAGE_ACCOUNT_BAR = 1 << 0,
+	DAMAGE_FOLDERS = 1 << 1,
+	DAMAGE_STATUS = 1 << 2,
+	DAMAGE_MESSAGES = 1 << 3,
+	DAMAGE_ALL = DAMAGE_ACCOUNT_BAR | DAMAGE_FOLDERS
+		| DAMAGE_STATUS | DAMAGE_MESSAGES,
+};
+
+// Where render time went, for finding slow widgets. Times are in seconds.
+enum frame_region {
+	FRAME_ACCOUNT_BAR,
+	FRAME_FOLDERS,
+	FRAME_STATUS,
+	FRAME_MESSAGES,
+	FRAME_PRESENT,
+	FRAME_REGION_COUNT,
+};
+
+struct frame_stats {
+	unsigned long frames;
+	// Ticks that had something to draw, but came too soon after a frame
+	unsigned long deferred;
+	double total, worst;
+	double regions[FRAME_REGION_COUNT], worst_regions[FRAME_REGION_COUNT];
+};
+
 void init_ui();
 void teardown_ui();
+void damage(unsigned regions);
+// Damages one row of the message list, counted from the top of the list
+void damage_row(size_t row);
+// Damages the row showing the message at this (zero-based) sequence index
+void damage_message(size_t index);
+// Damages the whole screen
 void rerender();
-void rerender_item(size_t index);
+// How many rows of the message list fit on screen
+int message_list_height();
+// Scrolls the message list, if need be, so this row is on screen
+void show_row(size_t row);
 bool ui_tick();
-int tb_printf(int x, int y, struct tb_cell *basis, const char *fmt, ...);
+const struct frame_stats *get_frame_stats();
+// Draws UTF-8 text, clipped to width columns (or unclipped if width < 0).
+// Returns the number of columns drawn.
+int tb_puts(int x, int y, int width, struct tb_cell *basis, const char *text);
+int tb_printf(int x, int y, struct tb_cell *basis, const char *fmt, ...)
+	__attribute__((format(printf,4,5)));
 void add_loading(int x, int y);
+// Stops animating loading indicators inside this rectangle
+void remove_loading(int x, int y, int w, int h);
 
 #endif
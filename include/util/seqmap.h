@@ -0,0 +1,61 @@
+#ifndef _SEQMAP_H
+#define _SEQMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Maps IMAP message sequence numbers to UIDs and to an arbitrary item (usually
+ * the message itself), with the operations a mailbox needs to stay cheap as
+ * it grows:
+ *
+ * - Looking up an item by UID is O(1) (hash table)
+ * - Looking up an item or UID by sequence number is O(log n)
+ * - Finding the sequence number of a UID is O(log n)
+ * - Expunging a message is O(log n), and renumbers every later message
+ *
+ * Messages live in slots that are never moved when something is expunged;
+ * expunged slots are just marked dead. A Fenwick tree over the live slots
+ * translates between sequence numbers and slots. Dead slots are compacted
+ * away once they outnumber the live ones.
+ *
+ * Sequence numbers are 1-based, like IMAP. A UID of 0 means not yet known.
+ */
+
+typedef struct {
+	size_t count; // Live messages, i.e. EXISTS
+	size_t length, capacity; // Slots in use and allocated
+	void **items;
+	long *uids;
+	bool *alive;
+	size_t *tree; // Fenwick tree over alive, 1-based
+	size_t *buckets; // Open addressing, slot by UID
+	size_t bucket_count, hashed;
+} seqmap_t;
+
+seqmap_t *create_seqmap(void);
+// Does not free the items
+void seqmap_free(seqmap_t *map);
+// Adds a message with sequence number count + 1
+void seqmap_append(seqmap_t *map, void *item);
+void *seqmap_get(const seqmap_t *map, size_t seq);
+void seqmap_set(seqmap_t *map, size_t seq, void *item);
+long seqmap_uid(const seqmap_t *map, size_t seq);
+void seqmap_set_uid(seqmap_t *map, size_t seq, long uid);
+// Returns the item with this UID, or NULL
+void *seqmap_find(const seqmap_t *map, long uid);
+// Returns the sequence number of this UID, or 0
+size_t seqmap_seq(const seqmap_t *map, long uid);
+// Removes the message and returns its item. Later messages move up by one.
+void *seqmap_remove(seqmap_t *map, size_t seq);
+/*
+ * Iterates over the items in sequence order:
+ *
+ * size_t cursor = 0; void *item;
+ * while (seqmap_iter(map, &cursor, &item)) { ... }
+ *
+ * The map must not be modified during iteration.
+ */
+bool seqmap_iter(const seqmap_t *map, size_t *cursor, void **item);
+
+#endif
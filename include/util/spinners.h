@@ -0,0 +1,38 @@
+#ifndef _SPINNERS_H
+#define _SPINNERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Where the loading indicators are on screen, keyed by row. A bitmap marks
+ * the rows that have any, so animating them skips empty rows a word at a
+ * time, and each row holds the columns of its (few) indicators. Adding or
+ * removing the indicator on a row is O(1), and nothing is allocated once the
+ * registry is as tall as the screen.
+ */
+
+#define SPINNERS_PER_ROW 2
+
+typedef struct {
+	uint64_t *active; // Bit per row with at least one indicator
+	int16_t (*columns)[SPINNERS_PER_ROW]; // -1 where there's no indicator
+	size_t rows; // Capacity
+	size_t count;
+} spinners_t;
+
+spinners_t *create_spinners(void);
+void spinners_free(spinners_t *spinners);
+// Returns false if the row already has as many indicators as it can hold
+bool spinners_add(spinners_t *spinners, int x, int y);
+// Removes every indicator inside this rectangle
+void spinners_remove(spinners_t *spinners, int x, int y, int w, int h);
+void spinners_clear(spinners_t *spinners);
+// Moves the indicators inside this rectangle up by dy rows (down if dy is
+// negative), dropping those that leave it
+void spinners_scroll(spinners_t *spinners, int x, int y, int w, int h, int dy);
+// Iterates over the indicators. Start with *cursor = 0.
+bool spinners_iter(const spinners_t *spinners, size_t *cursor, int *x, int *y);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _UIDSET_H
+#define _UIDSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A set of message UIDs (or sequence numbers) stored as runs of consecutive
+ * numbers, i.e. the in-memory form of an IMAP sequence-set like "1:5,7,9:12".
+ *
+ * Sets built with uidset_add are kept sorted with adjacent runs merged, and
+ * can be queried with uidset_contains. Sets built with uidset_append keep the
+ * order numbers were appended in (for SORT results) and only merge a number
+ * into the last run if it directly follows or precedes it, so that runs can
+ * descend as well (for REVERSE sorts). Walk those with uid_range_at.
+ */
+
+struct uid_range {
+	long min, max;
+	bool descending; // Appended from max down to min
+};
+
+typedef struct {
+	size_t capacity;
+	size_t length;
+	struct uid_range *ranges;
+} uidset_t;
+
+// The nth UID of the range, in the order it was appended
+static inline long uid_range_at(const struct uid_range *range, long n) {
+	return range->descending ? range->max - n : range->min + n;
+}
+
+uidset_t *create_uidset(void);
+void uidset_free(uidset_t *set);
+void uidset_add(uidset_t *set, long uid);
+void uidset_add_range(uidset_t *set, long min, long max);
+void uidset_append(uidset_t *set, long uid);
+bool uidset_contains(const uidset_t *set, long uid);
+// Total number of UIDs in the set
+long uidset_count(const uidset_t *set);
+// Returns the nth (zero-indexed) UID in set order, or -1
+long uidset_get(const uidset_t *set, long n);
+// Parses an IMAP sequence-set and adds it to the set. Returns false if the
+// string is not a valid sequence-set. "*" is not supported.
+bool uidset_parse(uidset_t *set, const char *str, bool ordered);
+// Returns an IMAP sequence-set string. Free it yourself.
+char *uidset_serialize(const uidset_t *set);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _UTF7_H
+#define _UTF7_H
+
+/*
+ * IMAP mailbox names are in modified UTF-7 (RFC 3501 section 5.1.3).
+ * Printable ASCII stands for itself, except "&", which is written "&-".
+ * Anything else is UTF-16, in base64 with "," for "/", between "&" and "-".
+ */
+
+// Returns the name as UTF-8, or NULL if it isn't valid modified UTF-7
+char *utf7_decode(const char *name);
+// Returns UTF-8 text as a mailbox name. Invalid UTF-8 becomes U+FFFD.
+char *utf7_encode(const char *text);
+
+#endif
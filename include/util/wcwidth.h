@@ -0,0 +1,30 @@
+#ifndef _WCWIDTH_H
+#define _WCWIDTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * How many terminal columns text takes: two for wide characters (CJK, most
+ * emoji), none for combining marks, other zero-width characters and control
+ * characters, and one for everything else. Runs of printable ASCII, by far
+ * the common case, are measured without being decoded.
+ */
+
+int codepoint_width(uint32_t ch);
+/*
+ * Decodes the character at the start of len (at least one) bytes of UTF-8
+ * and stores how many bytes it took in n. Invalid and cut off bytes are
+ * decoded one at a time, as U+FFFD.
+ */
+uint32_t next_codepoint(const char *text, size_t len, size_t *n);
+// The width of len bytes of UTF-8. Invalid bytes are one column each.
+int utf8_width(const char *text, size_t len);
+/*
+ * Returns how many bytes of text fit in max columns without splitting a
+ * character, and stores their width in width. Zero-width characters after
+ * the last one that fits are kept with it.
+ */
+size_t utf8_truncate(const char *text, size_t len, int max, int *width);
+
+#endif
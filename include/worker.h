@@ -7,8 +7,12 @@
 #include <openssl/ossl_typ.h>
 #endif
 
+#include "email/columns.h"
+#include "email/flags.h"
 #include "util/aqueue.h"
 #include "util/list.h"
+#include "util/seqmap.h"
+#include "util/uidset.h"
 
 /* worker.h
  *
@@ -46,8 +50,24 @@ enum worker_message_type {
 	WORKER_MAILBOX_UPDATED,
 	/* Messages */
 	WORKER_FETCH_MESSAGES,
+	WORKER_FETCH_UIDS,
 	WORKER_FETCH_MESSAGE_FULL,
+	WORKER_SET_FETCH_FIELDS,
 	WORKER_MESSAGE_UPDATED,
+	WORKER_MESSAGES_EXPUNGED,
+	WORKER_STORE_FLAGS,
+	WORKER_STORE_FLAGS_DONE,
+	WORKER_STORE_FLAGS_ERROR,
+	/* Searching */
+	WORKER_SEARCH,
+	WORKER_SEARCH_DONE,
+	WORKER_SEARCH_ERROR,
+	WORKER_SORT,
+	WORKER_SORT_DONE,
+	WORKER_SORT_ERROR,
+	WORKER_THREAD,
+	WORKER_THREAD_DONE,
+	WORKER_THREAD_ERROR,
 	/* Deleting things */
 	WORKER_DELETE_MAILBOX,
 	WORKER_MAILBOX_DELETED,
@@ -60,6 +80,8 @@ struct worker_pipe {
 	aqueue_t *messages;
 	/* Arbitrary worker-specific data */
 	void *data;
+	/* Flag names for this account, used by both sides */
+	struct flag_table *flags;
 };
 
 struct worker_message {
@@ -72,12 +94,69 @@ struct message_range {
 	int min, max;
 };
 
+/*
+ * WORKER_LIST takes the name of the folder whose children to list, or NULL for
+ * the top level. WORKER_LIST_DONE carries a struct mailbox_list of the folders
+ * at that level (struct aerc_mailbox), and WORKER_LIST_ERROR sends the parent
+ * name back.
+ */
+struct mailbox_list {
+	char *parent;
+	list_t *mailboxes;
+};
+
+/*
+ * Sent with WORKER_SET_FETCH_FIELDS to say what the message list shows, so
+ * that fetches only ask the server for that (plus what the worker needs).
+ */
+struct fetch_fields {
+	uint32_t headers; // Bitmask of enum header_field values
+	bool size; // RFC822.SIZE
+};
+
+/*
+ * Sent with WORKER_SEARCH and WORKER_SORT. The *_DONE replies carry a
+ * uidset_t of matching UIDs, in sort order for WORKER_SORT_DONE. Local
+ * searches take plain words rather than IMAP search criteria.
+ *
+ * WORKER_THREAD takes no data and WORKER_THREAD_DONE carries a struct
+ * thread_list (see email/thread.h).
+ */
+struct search_request {
+	char *criteria;
+	char *order; // Only used for WORKER_SORT
+	bool local; // Search the local index instead of the server
+};
+
+/*
+ * Sent with WORKER_STORE_FLAGS, and sent back with the *_DONE or *_ERROR reply.
+ * The main thread changes its copy of the flags before sending the request;
+ * changed holds the messages that actually changed, so that they can be put
+ * back if the server refuses. The worker fills in failed with the messages
+ * covered by whichever commands the server refused, which may be only some.
+ */
+struct flag_request {
+	uidset_t *uids;
+	bool add;
+	flagset_t flags;
+	uidset_t *changed;
+	uidset_t *failed;
+};
+
+/*
+ * WORKER_MESSAGES_EXPUNGED carries a uidset_t of the sequence numbers that were
+ * removed, numbered as they were before any of them were removed. Remove them
+ * from the highest down.
+ */
+
 struct aerc_message {
-	bool fetching, fetched, should_fetch;
+	bool fetching, fetched;
 	int index;
 	long uid;
-	list_t *flags, *headers;
-	struct tm *internal_date;
+	flagset_t flags;
+	uint32_t size;
+	struct email_headers *headers;
+	int64_t internal_date; // Seconds since the epoch, 0 if unknown
 };
 
 struct aerc_mailbox {
@@ -86,7 +165,16 @@ struct aerc_mailbox {
 	bool selected;
 	long exists, recent, unseen;
 	list_t *flags;
-	list_t *messages;
+	seqmap_t *messages; // struct aerc_message by sequence number and UID
+	struct message_columns *columns; // What the message list shows, by UID
+	char delimiter; // Hierarchy delimiter, or '\0' for none
+	// Kept by the main thread for the folder list
+	char *display_name; // The name decoded from modified UTF-7
+	const char *leaf; // The last part of display_name
+	int leaf_width; // In columns
+	int depth; // How many parents it has
+	bool has_children;
+	bool expanded, children_listed;
 };
 
 #ifdef USE_OPENSSL
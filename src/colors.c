@@ -1,18 +1,36 @@
-#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <strings.h>
 #include <termbox.h>
 
 #include "colors.h"
-#include "util/stringop.h"
-#include "util/hashtable.h"
 
-hashtable_t *colors;
+struct tb_cell colors[COLOR_ROLE_COUNT];
+
+static const struct {
+	const char *name;
+	enum color_role role;
+} color_roles[] = {
+	{ "borders", COLOR_BORDERS },
+	{ "loading-indicator", COLOR_LOADING_INDICATOR },
+	{ "account-unselected", COLOR_ACCOUNT_UNSELECTED },
+	{ "account-selected", COLOR_ACCOUNT_SELECTED },
+	{ "account-error", COLOR_ACCOUNT_ERROR },
+	{ "folder-unselected", COLOR_FOLDER_UNSELECTED },
+	{ "folder-selected", COLOR_FOLDER_SELECTED },
+	{ "status-line", COLOR_STATUS_LINE },
+	{ "status-line-error", COLOR_STATUS_LINE_ERROR },
+	{ "ex-line", COLOR_EX_LINE },
+	{ "message-list-selected", COLOR_MESSAGE_LIST_SELECTED },
+	{ "message-list-unselected", COLOR_MESSAGE_LIST_UNSELECTED },
+	{ "message-list-selected-unread", COLOR_MESSAGE_LIST_SELECTED_UNREAD },
+	{ "message-list-unselected-unread", COLOR_MESSAGE_LIST_UNSELECTED_UNREAD },
+	/* Misspellings older configs may still use */
+	{ "message-list-unselcted", COLOR_MESSAGE_LIST_UNSELECTED },
+	{ "message-list-unselcted-unread", COLOR_MESSAGE_LIST_UNSELECTED_UNREAD },
+};
 
 void colors_init() {
-	colors = create_hashtable(50, hash_string);
-	
 	set_color("borders", "white:black");
 	set_color("loading-indicator", "default:default");
 
@@ -29,9 +47,9 @@ void colors_init() {
 	set_color("ex-line", "default:default");
 
 	set_color("message-list-selected", "white:black");
-	set_color("message-list-unselcted", "default:default");
+	set_color("message-list-unselected", "default:default");
 	set_color("message-list-selected-unread", "white:_black");
-	set_color("message-list-unselcted-unread", "default:_default");
+	set_color("message-list-unselected-unread", "default:_default");
 }
 
 const struct {
@@ -72,8 +90,17 @@ static uint16_t match_color(const char *value) {
 	return TB_DEFAULT | mods;
 }
 
-void set_color(const char *name, const char *value) {
-	struct tb_cell *cell = calloc(1, sizeof(struct tb_cell));
+bool set_color(const char *name, const char *value) {
+	struct tb_cell *cell = NULL;
+	for (size_t i = 0; i < sizeof(color_roles) / sizeof(color_roles[0]); ++i) {
+		if (strcmp(color_roles[i].name, name) == 0) {
+			cell = &colors[color_roles[i].role];
+			break;
+		}
+	}
+	if (!cell) {
+		return false;
+	}
 	uint16_t c = match_color(value);
 	if (strchr(value, ':')) {
 		cell->bg = c;
@@ -84,16 +111,5 @@ void set_color(const char *name, const char *value) {
 		cell->bg = TB_DEFAULT;
 		cell->fg = c;
 	}
-	hashtable_set(colors, name, cell);
-}
-
-void get_color(const char *name, struct tb_cell *cell) {
-	struct tb_cell *c = hashtable_get(colors, name);
-	if (!c) {
-		cell->fg = TB_DEFAULT;
-		cell->bg = TB_DEFAULT;
-	} else {
-		cell->fg = c->fg;
-		cell->bg = c->bg;
-	}
+	return true;
 }
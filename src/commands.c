@@ -1,14 +1,19 @@
 #define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <strings.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include "email/columns.h"
 #include "util/stringop.h"
 #include "commands.h"
 #include "state.h"
 #include "log.h"
 #include "ui.h"
+#include "util/uidset.h"
+#include "util/utf7.h"
 
 static void handle_quit(int argc, char **argv) {
 	// TODO: We may occasionally want to confirm the user's choice here
@@ -19,9 +24,17 @@ static void handle_next_message(int argc, char **argv) {
 	struct account_state *account =
 		state->accounts->items[state->selected_account];
 	struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
-	if (account->ui.selected_message + 1 < mbox->messages->length) {
+	if (!mbox || !mbox->messages) {
+		return;
+	}
+	/* A sort order may leave out messages, so it has rows of its own */
+	size_t rows = account->ui.sort ?
+		account->ui.row_count : mbox->messages->count;
+	if (account->ui.selected_message + 1 < rows) {
+		damage_row(account->ui.selected_message);
 		++account->ui.selected_message;
-		rerender();
+		show_row(account->ui.selected_message);
+		damage_row(account->ui.selected_message);
 	}
 }
 
@@ -29,8 +42,10 @@ static void handle_previous_message(int argc, char **argv) {
 	struct account_state *account =
 		state->accounts->items[state->selected_account];
 	if (account->ui.selected_message != 0) {
+		damage_row(account->ui.selected_message);
 		--account->ui.selected_message;
-		rerender();
+		show_row(account->ui.selected_message);
+		damage_row(account->ui.selected_message);
 	}
 }
 
@@ -46,62 +61,86 @@ static void handle_previous_account(int argc, char **argv) {
 	rerender();
 }
 
-static void handle_next_folder(int argc, char **argv) {
+static void step_folder(long step) {
+	/* Moves through the folders on show, skipping collapsed children */
 	struct account_state *account =
 		state->accounts->items[state->selected_account];
-	int i = -1;
 	worker_log(L_DEBUG, "Current: %s", account->selected);
-	for (i = 0; i < (int)account->mailboxes->length; ++i) {
-		struct aerc_mailbox *mbox = account->mailboxes->items[i];
-		if (!strcmp(mbox->name, account->selected)) {
-			break;
-		}
+	int i = get_aerc_mailbox_index(account, account->selected);
+	if (i == -1) {
+		return;
 	}
-	if (i == -1 || i == (int)account->mailboxes->length) {
+	size_t count;
+	const size_t *rows = get_folder_rows(account, &count);
+	long row = get_folder_row(account, i);
+	if (row == -1) {
 		return;
 	}
-	i++;
-	i %= account->mailboxes->length;
+	row = (row + step + (long)count) % (long)count;
+	reset_message_view(account);
 	free(account->selected);
-	struct aerc_mailbox *next = account->mailboxes->items[i];
+	struct aerc_mailbox *next = account->mailboxes->items[rows[row]];
 	account->selected = strdup(next->name);
 	worker_post_action(account->worker.pipe, WORKER_SELECT_MAILBOX,
 			NULL, strdup(next->name));
 }
 
+static void handle_next_folder(int argc, char **argv) {
+	step_folder(1);
+}
+
 static void handle_previous_folder(int argc, char **argv) {
+	step_folder(-1);
+}
+
+static void handle_expand_folder(int argc, char **argv) {
+	/*
+	 * Shows the selected folder's children. They're listed the first time,
+	 * and kept after that.
+	 */
 	struct account_state *account =
 		state->accounts->items[state->selected_account];
-	int i = -1;
-	for (i = 0; i < (int)account->mailboxes->length; ++i) {
-		struct aerc_mailbox *mbox = account->mailboxes->items[i];
-		if (!strcmp(mbox->name, account->selected)) {
-			break;
-		}
-	}
-	if (i == -1 || i == (int)account->mailboxes->length) {
+	struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
+	if (!mbox || !mbox->has_children || mbox->expanded) {
 		return;
 	}
-	i--;
-	if (i == -1) {
-		i = account->mailboxes->length - 1;
+	mbox->expanded = true;
+	if (!mbox->children_listed) {
+		mbox->children_listed = true;
+		worker_post_action(account->worker.pipe, WORKER_LIST, NULL,
+				strdup(mbox->name));
 	}
-	free(account->selected);
-	struct aerc_mailbox *next = account->mailboxes->items[i];
-	account->selected = strdup(next->name);
-	worker_post_action(account->worker.pipe, WORKER_SELECT_MAILBOX,
-			NULL, strdup(next->name));
+	invalidate_folder_rows(account);
+	damage(DAMAGE_FOLDERS);
+}
+
+static void handle_collapse_folder(int argc, char **argv) {
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
+	if (!mbox || !mbox->expanded) {
+		return;
+	}
+	mbox->expanded = false;
+	invalidate_folder_rows(account);
+	damage(DAMAGE_FOLDERS);
 }
 
 static void handle_cd(int argc, char **argv) {
 	struct account_state *account =
 		state->accounts->items[state->selected_account];
+	reset_message_view(account);
 	free(account->selected);
 	char *joined = join_args(argv, argc);
-	account->selected = strdup(joined);
+	/* Folders are named as they're shown, unless it's the server's name */
+	if (!get_aerc_mailbox(account, joined)) {
+		char *encoded = utf7_encode(joined);
+		free(joined);
+		joined = encoded;
+	}
+	account->selected = joined;
 	worker_post_action(account->worker.pipe, WORKER_SELECT_MAILBOX,
 			NULL, strdup(joined));
-	free(joined);
 }
 
 static void handle_delete_mailbox(int argc, char **argv) {
@@ -114,6 +153,290 @@ static void handle_delete_mailbox(int argc, char **argv) {
 	free(joined);
 }
 
+static void handle_find(int argc, char **argv) {
+	/*
+	 * Searches the local index of message headers, e.g. :find bob invoice*
+	 * This works offline and doesn't cost a round trip.
+	 */
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	if (argc == 0) {
+		uidset_free(account->ui.search);
+		account->ui.search = NULL;
+		rerender();
+		return;
+	}
+	struct search_request *request = calloc(1, sizeof(struct search_request));
+	request->criteria = join_args(argv, argc);
+	request->local = true;
+	worker_post_action(account->worker.pipe, WORKER_SEARCH, NULL, request);
+	set_status(account, ACCOUNT_OKAY, "Searching...");
+}
+
+static long selected_uid(struct account_state *account,
+		struct aerc_mailbox *mbox) {
+	size_t row = account->ui.selected_message;
+	if (account->ui.sort) {
+		return row < account->ui.row_count ? account->ui.rows[row] : -1;
+	}
+	if (row >= mbox->messages->count) {
+		return -1;
+	}
+	struct aerc_message *msg = seqmap_get(mbox->messages,
+			mbox->messages->count - row);
+	return msg && msg->fetched ? msg->uid : -1;
+}
+
+static void store_flags(struct account_state *account,
+		struct aerc_mailbox *mbox, const uidset_t *uids,
+		flagset_t flags, bool add) {
+	/*
+	 * The change shows up right away; the server catches up when it
+	 * catches up, and if it refuses we put things back.
+	 */
+	if (!flags) {
+		return;
+	}
+	struct flag_request *request = calloc(1, sizeof(struct flag_request));
+	request->uids = create_uidset();
+	for (size_t i = 0; i < uids->length; ++i) {
+		uidset_add_range(request->uids, uids->ranges[i].min, uids->ranges[i].max);
+	}
+	request->add = add;
+	request->flags = flags;
+	request->changed = set_message_flags(mbox, uids, flags, add);
+	worker_post_action(account->worker.pipe, WORKER_STORE_FLAGS, NULL, request);
+}
+
+static void handle_flag(int argc, char **argv) {
+	/*
+	 * :flag [-s] +\Seen -\Flagged ...
+	 *
+	 * Changes flags on the selected message, or with -s on every result of the
+	 * last search. Use +\Deleted to delete messages.
+	 */
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
+	if (!mbox || !mbox->messages) {
+		return;
+	}
+	uidset_t *uids = create_uidset();
+	if (argc > 0 && strcmp(argv[0], "-s") == 0) {
+		--argc, ++argv;
+		if (!account->ui.search) {
+			set_status(account, ACCOUNT_ERROR, "No search results");
+			uidset_free(uids);
+			return;
+		}
+		for (size_t i = 0; i < account->ui.search->length; ++i) {
+			uidset_add_range(uids, account->ui.search->ranges[i].min,
+					account->ui.search->ranges[i].max);
+		}
+	} else {
+		long uid = selected_uid(account, mbox);
+		if (uid > 0) {
+			uidset_add(uids, uid);
+		}
+	}
+	flagset_t add = 0, remove = 0;
+	for (int i = 0; i < argc; ++i) {
+		if ((argv[i][0] != '+' && argv[i][0] != '-') || !argv[i][1]) {
+			set_status(account, ACCOUNT_ERROR,
+					"Usage: flag [-s] +flag|-flag...");
+			uidset_free(uids);
+			return;
+		}
+		flagset_t flag = flag_intern(account->worker.pipe->flags, argv[i] + 1);
+		if (!flag) {
+			set_status(account, ACCOUNT_ERROR, "Too many keywords");
+			uidset_free(uids);
+			return;
+		}
+		if (argv[i][0] == '+') {
+			add |= flag;
+		} else {
+			remove |= flag;
+		}
+	}
+	store_flags(account, mbox, uids, add, true);
+	store_flags(account, mbox, uids, remove, false);
+	uidset_free(uids);
+	rerender();
+}
+
+static void handle_search(int argc, char **argv) {
+	/*
+	 * The arguments are IMAP search criteria, e.g. :search from bob unseen
+	 */
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	if (argc == 0) {
+		uidset_free(account->ui.search);
+		account->ui.search = NULL;
+		rerender();
+		return;
+	}
+	struct search_request *request = calloc(1, sizeof(struct search_request));
+	request->criteria = join_args(argv, argc);
+	worker_post_action(account->worker.pipe, WORKER_SEARCH, NULL, request);
+	set_status(account, ACCOUNT_OKAY, "Searching...");
+}
+
+static void handle_sort(int argc, char **argv) {
+	/*
+	 * The arguments are IMAP sort criteria, e.g. :sort reverse date
+	 */
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	if (argc == 0) {
+		set_sort(account, NULL, NULL);
+		rerender();
+		return;
+	}
+	char *order = join_args(argv, argc);
+	for (char *c = order; *c; ++c) {
+		*c = toupper(*c);
+	}
+	/*
+	 * Once every message is loaded we can sort them ourselves, without
+	 * waiting for the server.
+	 */
+	struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
+	if (mbox && mbox->columns && mbox->messages
+			&& mbox->columns->count == mbox->messages->count) {
+		uidset_t *sort = message_columns_sort(mbox->columns, order);
+		if (sort) {
+			set_sort(account, sort, NULL);
+			free(order);
+			rerender();
+			return;
+		}
+	}
+	struct search_request *request = calloc(1, sizeof(struct search_request));
+	request->order = order;
+	request->criteria = strdup("ALL");
+	worker_post_action(account->worker.pipe, WORKER_SORT, NULL, request);
+	set_status(account, ACCOUNT_OKAY, "Sorting...");
+}
+
+static void handle_thread(int argc, char **argv) {
+	/*
+	 * Toggles the threaded view. Use :sort with no arguments to go back to the
+	 * plain message list as well.
+	 */
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	if (account->ui.depths) {
+		handle_sort(0, NULL);
+		return;
+	}
+	worker_post_action(account->worker.pipe, WORKER_THREAD, NULL, NULL);
+	set_status(account, ACCOUNT_OKAY, "Threading...");
+}
+
+static bool find_sorted_result(struct account_state *account, bool forward,
+		size_t *result) {
+	/*
+	 * Walks the sort order once, remembering the closest match on the
+	 * requested side of the selected row.
+	 */
+	bool found = false;
+	for (size_t row = 0; row < account->ui.row_count; ++row) {
+		if (!uidset_contains(account->ui.search, account->ui.rows[row])) {
+			continue;
+		}
+		if (forward && row > account->ui.selected_message) {
+			*result = row;
+			return true;
+		}
+		if (!forward && row < account->ui.selected_message) {
+			*result = row;
+			found = true;
+		}
+	}
+	return found;
+}
+
+static void select_result(bool forward) {
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
+	if (!mbox || !account->ui.search) {
+		return;
+	}
+	size_t row = account->ui.selected_message;
+	if (account->ui.sort) {
+		if (!find_sorted_result(account, forward, &row)) {
+			return;
+		}
+	} else {
+		/*
+		 * Rows are in reverse order of sequence numbers. We look up where each
+		 * result is rather than walking the list, since there are usually
+		 * far fewer results than messages.
+		 */
+		size_t len = mbox->messages->count;
+		size_t current = len - row, best = 0;
+		uidset_t *search = account->ui.search;
+		for (size_t i = 0; i < search->length; ++i) {
+			for (long uid = search->ranges[i].min;
+					uid <= search->ranges[i].max; ++uid) {
+				size_t seq = seqmap_seq(mbox->messages, uid);
+				if (!seq) {
+					continue;
+				}
+				if (forward ? seq < current && seq > best
+						: seq > current && (!best || seq < best)) {
+					best = seq;
+				}
+			}
+		}
+		if (!best) {
+			return;
+		}
+		row = len - best;
+	}
+	damage_row(account->ui.selected_message);
+	account->ui.selected_message = row;
+	show_row(row);
+	damage_row(row);
+}
+
+static void handle_frame_stats(int argc, char **argv) {
+	/* Average milliseconds per frame, overall and for each region */
+	static const char *names[] = {
+		[FRAME_ACCOUNT_BAR] = "accounts",
+		[FRAME_FOLDERS] = "folders",
+		[FRAME_STATUS] = "status",
+		[FRAME_MESSAGES] = "messages",
+		[FRAME_PRESENT] = "present",
+	};
+	const struct frame_stats *stats = get_frame_stats();
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	unsigned long frames = stats->frames ? stats->frames : 1;
+	char text[512];
+	int l = snprintf(text, sizeof(text),
+			"%lu frames (%lu deferred), %.2f ms avg, %.2f ms worst;",
+			stats->frames, stats->deferred,
+			stats->total * 1000 / frames, stats->worst * 1000);
+	for (int i = 0; i < FRAME_REGION_COUNT; ++i) {
+		l += snprintf(text + l, sizeof(text) - l, " %s %.2f/%.2f",
+				names[i], stats->regions[i] * 1000 / frames,
+				stats->worst_regions[i] * 1000);
+	}
+	set_status(account, ACCOUNT_OKAY, text);
+}
+
+static void handle_next_result(int argc, char **argv) {
+	select_result(true);
+}
+
+static void handle_previous_result(int argc, char **argv) {
+	select_result(false);
+}
+
 struct cmd_handler {
 	char *command;
 	void (*handler)(int argc, char **argv);
@@ -122,16 +445,26 @@ struct cmd_handler {
 // Keep alphabetized, please
 struct cmd_handler cmd_handlers[] = {
 	{ "cd", handle_cd },
+	{ "collapse-folder", handle_collapse_folder },
 	{ "delete-mailbox", handle_delete_mailbox },
 	{ "exit", handle_quit },
+	{ "expand-folder", handle_expand_folder },
+	{ "find", handle_find },
+	{ "flag", handle_flag },
+	{ "frame-stats", handle_frame_stats },
 	{ "next-account", handle_next_account },
 	{ "next-folder", handle_next_folder },
 	{ "next-message", handle_next_message },
+	{ "next-result", handle_next_result },
 	{ "previous-account", handle_previous_account },
 	{ "previous-folder", handle_previous_folder },
 	{ "previous-message", handle_previous_message },
+	{ "previous-result", handle_previous_result },
 	{ "q", handle_quit },
-	{ "quit", handle_quit }
+	{ "quit", handle_quit },
+	{ "search", handle_search },
+	{ "sort", handle_sort },
+	{ "thread", handle_thread },
 };
 
 static int handler_compare(const void *_a, const void *_b) {
@@ -26,6 +26,7 @@
 #include "colors.h"
 #include "log.h"
 #include "config.h"
+#include "index_format.h"
 #include "state.h"
 
 struct aerc_config *config = NULL;
@@ -99,7 +100,8 @@ static int handle_config_option(void *_config, const char *section,
 		{ "ui", "border-style", &config->ui.border_style }
 	};
 	struct { const char *section; const char *key; int *value; } integers[] = {
-		{ "ui", "sidebar-width", &config->ui.sidebar_width }
+		{ "ui", "sidebar-width", &config->ui.sidebar_width },
+		{ "ui", "max-fps", &config->ui.max_fps }
 	};
 	struct {
 		const char *section;
@@ -110,7 +112,9 @@ static int handle_config_option(void *_config, const char *section,
 	};
 
 	if (strcmp(section, "colors") == 0) {
-		set_color(key, value);
+		if (!set_color(key, value)) {
+			worker_log(L_ERROR, "Unknown color [%s]%s", section, key);
+		}
 		return 1;
 	}
 
@@ -261,6 +265,7 @@ static void config_defaults(struct aerc_config *config) {
 	config->ui.index_format = strdup("%4C %Z %D %-17.17n %s");
 	config->ui.timestamp_format = strdup("%F %l:%M %p");
 	config->ui.show_all_headers = false;
+	config->ui.max_fps = 60;
 }
 
 void free_config(struct aerc_config *config) {
@@ -279,6 +284,7 @@ void free_config(struct aerc_config *config) {
 	}
 	list_free(config->accounts);
 	free(config->ui.index_format);
+	free_index_format(config->ui.index);
 	free(config->ui.timestamp_format);
 }
 
@@ -315,6 +321,7 @@ bool load_main_config(const char *file) {
 	config_defaults(config);
 
 	bool success = load_config(path, config);
+	config->ui.index = compile_index_format(config->ui.index_format);
 
 	if (old_config) {
 		free_config(old_config);
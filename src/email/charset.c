@@ -0,0 +1,109 @@
+/*
+ * email/charset.c - charset conversion with pooled iconv handles
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <iconv.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "email/charset.h"
+
+struct pooled_handle {
+	char *charset;
+	iconv_t cd; // (iconv_t)-1 if iconv doesn't know the charset
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct pooled_handle *handles;
+	size_t length, capacity;
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+bool charset_is_utf8(const char *charset) {
+	return strcasecmp(charset, "utf-8") == 0
+		|| strcasecmp(charset, "utf8") == 0
+		|| strcasecmp(charset, "us-ascii") == 0
+		|| strcasecmp(charset, "ascii") == 0;
+}
+
+static struct pooled_handle *get_handle(const char *charset) {
+	/* Called with the pool locked */
+	for (size_t i = 0; i < pool.length; ++i) {
+		if (strcasecmp(pool.handles[i].charset, charset) == 0) {
+			return &pool.handles[i];
+		}
+	}
+	if (pool.length == pool.capacity) {
+		pool.capacity = pool.capacity ? pool.capacity * 2 : 8;
+		pool.handles = realloc(pool.handles,
+				sizeof(struct pooled_handle) * pool.capacity);
+	}
+	struct pooled_handle *handle = &pool.handles[pool.length++];
+	handle->charset = strdup(charset);
+	handle->cd = iconv_open("UTF-8", charset);
+	return handle;
+}
+
+char *charset_to_utf8(const char *charset, const char *text, size_t len) {
+	if (charset_is_utf8(charset)) {
+		char *copy = malloc(len + 1);
+		memcpy(copy, text, len);
+		copy[len] = '\0';
+		return copy;
+	}
+	pthread_mutex_lock(&pool.lock);
+	struct pooled_handle *handle = get_handle(charset);
+	if (handle->cd == (iconv_t)-1) {
+		pthread_mutex_unlock(&pool.lock);
+		return NULL;
+	}
+	/* Most charsets take at most 3 UTF-8 bytes per input byte */
+	size_t size = len * 3 + 4;
+	char *out = malloc(size);
+	char *in = (char *)text, *dest = out;
+	size_t in_left = len, out_left = size - 1;
+	iconv(handle->cd, NULL, NULL, NULL, NULL);
+	while (in_left > 0) {
+		if (iconv(handle->cd, &in, &in_left, &dest, &out_left) != (size_t)-1) {
+			break;
+		}
+		if (errno == E2BIG || out_left < 4) {
+			size_t used = dest - out;
+			size *= 2;
+			out = realloc(out, size);
+			dest = out + used;
+			out_left = size - used - 1;
+		} else {
+			/* EILSEQ or EINVAL: skip a byte and carry on */
+			memcpy(dest, "\xEF\xBF\xBD", 3);
+			dest += 3;
+			out_left -= 3;
+			++in;
+			--in_left;
+			iconv(handle->cd, NULL, NULL, NULL, NULL);
+		}
+	}
+	iconv(handle->cd, NULL, NULL, &dest, &out_left);
+	pthread_mutex_unlock(&pool.lock);
+	*dest = '\0';
+	return out;
+}
+
+void charset_pool_free(void) {
+	pthread_mutex_lock(&pool.lock);
+	for (size_t i = 0; i < pool.length; ++i) {
+		if (pool.handles[i].cd != (iconv_t)-1) {
+			iconv_close(pool.handles[i].cd);
+		}
+		free(pool.handles[i].charset);
+	}
+	free(pool.handles);
+	pool.handles = NULL;
+	pool.length = pool.capacity = 0;
+	pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,410 @@
+/*
+ * email/columns.c - columnar index of the messages in a mailbox
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "email/columns.h"
+#include "util/uidset.h"
+#include "util/wcwidth.h"
+
+static size_t hash_uid(long uid) {
+	uint64_t key = (uint64_t)uid;
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return (size_t)key;
+}
+
+static size_t bucket_of(const struct message_columns *columns, long uid) {
+	size_t mask = columns->bucket_count - 1;
+	for (size_t i = hash_uid(uid) & mask; columns->buckets[i] != COLUMNS_NONE;
+			i = (i + 1) & mask) {
+		if (columns->uids[columns->buckets[i]] == uid) {
+			return i;
+		}
+	}
+	return COLUMNS_NONE;
+}
+
+static void hash_insert(struct message_columns *columns, size_t row) {
+	size_t mask = columns->bucket_count - 1;
+	size_t i = hash_uid(columns->uids[row]) & mask;
+	while (columns->buckets[i] != COLUMNS_NONE) {
+		i = (i + 1) & mask;
+	}
+	columns->buckets[i] = row;
+}
+
+static void hash_delete(struct message_columns *columns, size_t i) {
+	/* Backward-shift deletion, as in util/seqmap.c */
+	size_t mask = columns->bucket_count - 1;
+	size_t j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		if (columns->buckets[j] == COLUMNS_NONE) {
+			break;
+		}
+		size_t home = hash_uid(columns->uids[columns->buckets[j]]) & mask;
+		if ((j > i && (home <= i || home > j))
+				|| (j < i && (home <= i && home > j))) {
+			columns->buckets[i] = columns->buckets[j];
+			i = j;
+		}
+	}
+	columns->buckets[i] = COLUMNS_NONE;
+}
+
+static void hash_build(struct message_columns *columns, size_t bucket_count) {
+	free(columns->buckets);
+	columns->bucket_count = bucket_count;
+	columns->buckets = malloc(sizeof(size_t) * bucket_count);
+	for (size_t i = 0; i < bucket_count; ++i) {
+		columns->buckets[i] = COLUMNS_NONE;
+	}
+	for (size_t i = 0; i < columns->length; ++i) {
+		if (columns->uids[i]) {
+			hash_insert(columns, i);
+		}
+	}
+}
+
+static uint32_t pool_add(struct message_columns *columns, const char *str) {
+	if (!str) str = "";
+	size_t len = strlen(str) + 1;
+	if (columns->pool_length + len > columns->pool_capacity) {
+		size_t capacity = columns->pool_capacity * 2;
+		while (columns->pool_length + len > capacity) {
+			capacity *= 2;
+		}
+		columns->pool = realloc(columns->pool, capacity);
+		columns->pool_capacity = capacity;
+	}
+	uint32_t offset = columns->pool_length;
+	memcpy(columns->pool + offset, str, len);
+	columns->pool_length += len;
+	return offset;
+}
+
+static void compact(struct message_columns *columns) {
+	/*
+	 * Drops removed rows and rebuilds the string pool without the strings
+	 * that were replaced or removed.
+	 */
+	char *old_pool = columns->pool;
+	columns->pool = malloc(columns->pool_capacity);
+	columns->pool_length = columns->pool_garbage = 0;
+	size_t n = 0;
+	for (size_t i = 0; i < columns->length; ++i) {
+		if (!columns->uids[i]) {
+			continue;
+		}
+		columns->uids[n] = columns->uids[i];
+		columns->flags[n] = columns->flags[i];
+		columns->dates[n] = columns->dates[i];
+		columns->sent_dates[n] = columns->sent_dates[i];
+		columns->sizes[n] = columns->sizes[i];
+		memcpy(columns->date_texts[n], columns->date_texts[i],
+				COLUMNS_DATE_MAX);
+		columns->subject_widths[n] = columns->subject_widths[i];
+		columns->subjects[n] = pool_add(columns, old_pool + columns->subjects[i]);
+		columns->froms[n] = pool_add(columns, old_pool + columns->froms[i]);
+		++n;
+	}
+	free(old_pool);
+	columns->length = n;
+	hash_build(columns, columns->bucket_count);
+}
+
+static void resize(struct message_columns *columns, size_t capacity) {
+	columns->capacity = capacity;
+	columns->uids = realloc(columns->uids, sizeof(long) * capacity);
+	columns->flags = realloc(columns->flags, sizeof(flagset_t) * capacity);
+	columns->dates = realloc(columns->dates, sizeof(int64_t) * capacity);
+	columns->sent_dates = realloc(columns->sent_dates,
+			sizeof(int64_t) * capacity);
+	columns->sizes = realloc(columns->sizes, sizeof(uint32_t) * capacity);
+	columns->date_texts = realloc(columns->date_texts,
+			COLUMNS_DATE_MAX * capacity);
+	columns->subjects = realloc(columns->subjects, sizeof(uint32_t) * capacity);
+	columns->froms = realloc(columns->froms, sizeof(uint32_t) * capacity);
+	columns->subject_widths = realloc(columns->subject_widths,
+			sizeof(int) * capacity);
+}
+
+struct message_columns *create_message_columns(void) {
+	struct message_columns *columns = calloc(1, sizeof(struct message_columns));
+	resize(columns, 64);
+	columns->pool_capacity = 4096;
+	columns->pool = malloc(columns->pool_capacity);
+	hash_build(columns, 128);
+	return columns;
+}
+
+void message_columns_free(struct message_columns *columns) {
+	if (!columns) return;
+	free(columns->uids);
+	free(columns->flags);
+	free(columns->dates);
+	free(columns->sent_dates);
+	free(columns->sizes);
+	free(columns->date_texts);
+	free(columns->subjects);
+	free(columns->froms);
+	free(columns->subject_widths);
+	free(columns->pool);
+	free(columns->buckets);
+	free(columns);
+}
+
+size_t message_columns_set(struct message_columns *columns, long uid,
+		flagset_t flags, int64_t date, int64_t sent_date, uint32_t size,
+		const char *subject, const char *from) {
+	size_t row = message_columns_row(columns, uid);
+	if (row == COLUMNS_NONE) {
+		if (columns->length == columns->capacity) {
+			if (columns->length - columns->count >= columns->count) {
+				compact(columns);
+			} else {
+				resize(columns, columns->capacity * 2);
+			}
+		}
+		if ((columns->count + 1) * 2 > columns->bucket_count) {
+			hash_build(columns, columns->bucket_count * 2);
+		}
+		row = columns->length++;
+		columns->uids[row] = uid;
+		columns->count++;
+		hash_insert(columns, row);
+	} else {
+		/* Replaced strings stay in the pool until the next compaction */
+		columns->pool_garbage += strlen(columns->pool + columns->subjects[row])
+			+ strlen(columns->pool + columns->froms[row]) + 2;
+	}
+	columns->flags[row] = flags;
+	columns->dates[row] = date;
+	/* RFC 5256 2.2: without a usable Date: header, use the internal date */
+	columns->sent_dates[row] = sent_date ? sent_date : date;
+	columns->sizes[row] = size;
+	columns->date_texts[row][0] = '\0';
+	columns->subjects[row] = pool_add(columns, subject);
+	columns->froms[row] = pool_add(columns, from);
+	columns->subject_widths[row] =
+		subject ? utf8_width(subject, strlen(subject)) : 0;
+	if (columns->pool_garbage > columns->pool_length / 2
+			&& columns->pool_garbage > 4096) {
+		compact(columns);
+		row = message_columns_row(columns, uid);
+	}
+	return row;
+}
+
+void message_columns_remove(struct message_columns *columns, long uid) {
+	size_t bucket = bucket_of(columns, uid);
+	if (bucket == COLUMNS_NONE) {
+		return;
+	}
+	size_t row = columns->buckets[bucket];
+	hash_delete(columns, bucket);
+	columns->pool_garbage += strlen(columns->pool + columns->subjects[row])
+		+ strlen(columns->pool + columns->froms[row]) + 2;
+	columns->uids[row] = 0;
+	columns->count--;
+}
+
+size_t message_columns_row(const struct message_columns *columns, long uid) {
+	size_t bucket = bucket_of(columns, uid);
+	return bucket == COLUMNS_NONE ? COLUMNS_NONE : columns->buckets[bucket];
+}
+
+const char *message_columns_subject(const struct message_columns *columns,
+		size_t row) {
+	return columns->pool + columns->subjects[row];
+}
+
+const char *message_columns_from(const struct message_columns *columns,
+		size_t row) {
+	return columns->pool + columns->froms[row];
+}
+
+void message_columns_date_stamp(struct message_columns *columns,
+		uint64_t stamp) {
+	if (stamp == columns->date_stamp) {
+		return;
+	}
+	for (size_t i = 0; i < columns->length; ++i) {
+		columns->date_texts[i][0] = '\0';
+	}
+	columns->date_stamp = stamp;
+}
+
+/*
+ * Sorting
+ */
+
+enum sort_key { SORT_ARRIVAL, SORT_DATE, SORT_FROM, SORT_SUBJECT };
+
+struct sort_criterion {
+	enum sort_key key;
+	bool reverse;
+};
+
+struct sort_context {
+	const struct message_columns *columns;
+	const struct sort_criterion *criteria;
+	size_t criteria_count;
+	const char **subjects, **froms; // By row, as compared
+};
+
+static const char *base_subject(const char *subject) {
+	/* Close enough to RFC 5256's base subject for ordering purposes */
+	const char *prefixes[] = { "re:", "fwd:", "fw:" };
+	bool stripped = true;
+	while (stripped) {
+		stripped = false;
+		while (*subject == ' ' || *subject == '\t') ++subject;
+		for (size_t i = 0; i < sizeof(prefixes) / sizeof(char *); ++i) {
+			size_t len = strlen(prefixes[i]);
+			if (strncasecmp(subject, prefixes[i], len) == 0) {
+				subject += len;
+				stripped = true;
+			}
+		}
+	}
+	return subject;
+}
+
+static const char *from_address(const char *from) {
+	const char *addr = strchr(from, '<');
+	return addr ? addr + 1 : from;
+}
+
+static int compare_rows(const struct sort_context *ctx, size_t a, size_t b) {
+	const struct message_columns *columns = ctx->columns;
+	for (size_t i = 0; i < ctx->criteria_count; ++i) {
+		int result = 0;
+		switch (ctx->criteria[i].key) {
+		case SORT_ARRIVAL:
+			result = (columns->dates[a] > columns->dates[b])
+				- (columns->dates[a] < columns->dates[b]);
+			break;
+		case SORT_DATE:
+			result = (columns->sent_dates[a] > columns->sent_dates[b])
+				- (columns->sent_dates[a] < columns->sent_dates[b]);
+			break;
+		case SORT_FROM:
+			result = strcasecmp(ctx->froms[a], ctx->froms[b]);
+			break;
+		case SORT_SUBJECT:
+			result = strcasecmp(ctx->subjects[a], ctx->subjects[b]);
+			break;
+		}
+		if (result) {
+			return ctx->criteria[i].reverse ? -result : result;
+		}
+	}
+	/* Ties go in UID order, like the server would */
+	return (columns->uids[a] > columns->uids[b])
+		- (columns->uids[a] < columns->uids[b]);
+}
+
+static void merge_sort(const struct sort_context *ctx, size_t *rows,
+		size_t *scratch, size_t length) {
+	for (size_t width = 1; width < length; width *= 2) {
+		for (size_t lo = 0; lo < length; lo += width * 2) {
+			size_t mid = lo + width < length ? lo + width : length;
+			size_t hi = lo + width * 2 < length ? lo + width * 2 : length;
+			size_t i = lo, j = mid, k = lo;
+			while (i < mid && j < hi) {
+				scratch[k++] = compare_rows(ctx, rows[j], rows[i]) < 0 ?
+					rows[j++] : rows[i++];
+			}
+			while (i < mid) scratch[k++] = rows[i++];
+			while (j < hi) scratch[k++] = rows[j++];
+		}
+		memcpy(rows, scratch, sizeof(size_t) * length);
+	}
+}
+
+static size_t parse_criteria(const char *order,
+		struct sort_criterion *criteria, size_t max) {
+	/* Returns the number of criteria, or 0 if any are unsupported */
+	const struct { const char *name; enum sort_key key; } keys[] = {
+		{ "ARRIVAL", SORT_ARRIVAL },
+		{ "DATE", SORT_DATE },
+		{ "FROM", SORT_FROM },
+		{ "SUBJECT", SORT_SUBJECT },
+	};
+	size_t count = 0;
+	bool reverse = false;
+	while (*order) {
+		while (*order == ' ') ++order;
+		size_t len = strcspn(order, " ");
+		if (len == 0) {
+			break;
+		}
+		if (len == 7 && strncasecmp(order, "REVERSE", len) == 0) {
+			reverse = true;
+			order += len;
+			continue;
+		}
+		size_t i;
+		for (i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+			if (strlen(keys[i].name) == len
+					&& strncasecmp(order, keys[i].name, len) == 0) {
+				break;
+			}
+		}
+		if (i == sizeof(keys) / sizeof(keys[0]) || count == max) {
+			return 0;
+		}
+		criteria[count].key = keys[i].key;
+		criteria[count].reverse = reverse;
+		++count;
+		reverse = false;
+		order += len;
+	}
+	return reverse ? 0 : count;
+}
+
+uidset_t *message_columns_sort(const struct message_columns *columns,
+		const char *order) {
+	struct sort_criterion criteria[8];
+	size_t criteria_count = parse_criteria(order, criteria, 8);
+	if (!criteria_count) {
+		return NULL;
+	}
+	struct sort_context ctx = {
+		.columns = columns,
+		.criteria = criteria,
+		.criteria_count = criteria_count,
+		.subjects = malloc(sizeof(char *) * (columns->length + 1)),
+		.froms = malloc(sizeof(char *) * (columns->length + 1)),
+	};
+	size_t *rows = malloc(sizeof(size_t) * (columns->count + 1));
+	size_t *scratch = malloc(sizeof(size_t) * (columns->count + 1));
+	size_t n = 0;
+	for (size_t i = 0; i < columns->length; ++i) {
+		if (!columns->uids[i]) {
+			continue;
+		}
+		rows[n++] = i;
+		ctx.subjects[i] = base_subject(message_columns_subject(columns, i));
+		ctx.froms[i] = from_address(message_columns_from(columns, i));
+	}
+	merge_sort(&ctx, rows, scratch, n);
+	uidset_t *uids = create_uidset();
+	for (size_t i = 0; i < n; ++i) {
+		uidset_append(uids, columns->uids[rows[i]]);
+	}
+	free(rows);
+	free(scratch);
+	free(ctx.subjects);
+	free(ctx.froms);
+	return uids;
+}
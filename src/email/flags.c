@@ -0,0 +1,104 @@
+/*
+ * email/flags.c - interns message flags as bits
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "email/flags.h"
+
+struct flag_table {
+	pthread_mutex_t lock;
+	char *names[FLAG_MAX];
+	int count;
+};
+
+static const char *system_flags[] = {
+	"\\Seen", "\\Answered", "\\Flagged", "\\Deleted", "\\Draft", "\\Recent"
+};
+
+struct flag_table *create_flag_table(void) {
+	struct flag_table *table = calloc(1, sizeof(struct flag_table));
+	pthread_mutex_init(&table->lock, NULL);
+	for (size_t i = 0; i < sizeof(system_flags) / sizeof(char *); ++i) {
+		table->names[table->count++] = strdup(system_flags[i]);
+	}
+	return table;
+}
+
+void flag_table_free(struct flag_table *table) {
+	if (!table) return;
+	for (int i = 0; i < table->count; ++i) {
+		free(table->names[i]);
+	}
+	pthread_mutex_destroy(&table->lock);
+	free(table);
+}
+
+static int find(struct flag_table *table, const char *name) {
+	/*
+	 * There are rarely more than a handful of keywords, and this only runs
+	 * when flags come in from the server or the user, not when rendering.
+	 */
+	for (int i = 0; i < table->count; ++i) {
+		if (strcasecmp(table->names[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+flagset_t flag_intern(struct flag_table *table, const char *name) {
+	pthread_mutex_lock(&table->lock);
+	int i = find(table, name);
+	if (i == -1 && table->count < FLAG_MAX) {
+		i = table->count;
+		table->names[table->count++] = strdup(name);
+	}
+	pthread_mutex_unlock(&table->lock);
+	return i == -1 ? 0 : (flagset_t)1 << i;
+}
+
+flagset_t flag_lookup(struct flag_table *table, const char *name) {
+	pthread_mutex_lock(&table->lock);
+	int i = find(table, name);
+	pthread_mutex_unlock(&table->lock);
+	return i == -1 ? 0 : (flagset_t)1 << i;
+}
+
+const char *flag_name(struct flag_table *table, flagset_t flag) {
+	/* Names are never removed or moved, so this is safe to hand out */
+	const char *name = NULL;
+	pthread_mutex_lock(&table->lock);
+	for (int i = 0; i < table->count; ++i) {
+		if (flag == (flagset_t)1 << i) {
+			name = table->names[i];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&table->lock);
+	return name;
+}
+
+char *flagset_serialize(struct flag_table *table, flagset_t flags) {
+	pthread_mutex_lock(&table->lock);
+	size_t len = 1;
+	for (int i = 0; i < table->count; ++i) {
+		if (flags & ((flagset_t)1 << i)) {
+			len += strlen(table->names[i]) + 1;
+		}
+	}
+	char *str = malloc(len);
+	str[0] = '\0';
+	for (int i = 0; i < table->count; ++i) {
+		if (flags & ((flagset_t)1 << i)) {
+			if (*str) strcat(str, " ");
+			strcat(str, table->names[i]);
+		}
+	}
+	pthread_mutex_unlock(&table->lock);
+	return str;
+}
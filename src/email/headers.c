@@ -1,82 +1,422 @@
-#include <stdio.h>
+#define _POSIX_C_SOURCE 200809L
 #include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 
 #include "email/headers.h"
-#include "log.h"
+#include "email/rfc2047.h"
 #include "util/list.h"
 
-int parse_headers(const char *headers, list_t *output) {
-	while (*headers && strstr(headers, "\r\n") == headers) {
-		headers += 2;
-	}
-	if (strstr(headers, "From: \"United") == headers) {
-		headers++;
-		headers--;
-	}
-	while (*headers) {
-		char *crlf = strstr(headers, "\r\n");
-		char *null = strchr(headers, '\0');
-		char *eol = crlf == NULL ? null : crlf;
-		int eol_i = eol - headers;
-
-		if (isspace(*headers)) {
-			while (isspace(*++headers));
-			if (output->length != 0) {
-				/* Concat with previous line */
-				struct email_header *h = output->items[output->length - 1];
-				char *prev = h->value;
-				char *new = malloc(strlen(prev) + eol_i + 2);
-				strcpy(new, prev);
-				strcat(new, " ");
-				strncat(new, headers, eol_i);
-				new[eol_i + strlen(prev)] = '\0';
-				h->value = new;
-				free(prev);
-				headers = eol;
-				if (*headers) headers += 2;
-				worker_log(L_DEBUG, "Extended previous header: %s: %s",
-						h->key, h->value);
-				continue;
+static const char *field_names[HEADER_FIELD_COUNT] = {
+	[HEADER_DATE] = "Date",
+	[HEADER_FROM] = "From",
+	[HEADER_SUBJECT] = "Subject",
+	[HEADER_TO] = "To",
+	[HEADER_CC] = "Cc",
+	[HEADER_MESSAGE_ID] = "Message-ID",
+	[HEADER_REFERENCES] = "References",
+	[HEADER_IN_REPLY_TO] = "In-Reply-To",
+	[HEADER_CONTENT_TYPE] = "Content-Type",
+	[HEADER_REPLY_TO] = "Reply-To",
+};
+
+/*
+ * Interned header names, shared by every thread. There are only ever a few
+ * hundred distinct ones, so they're never freed.
+ */
+static struct {
+	pthread_mutex_t lock;
+	const char **slots;
+	size_t slot_count, count;
+} keys = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint32_t hash_key(const char *key, size_t len) {
+	/* FNV-1a, ignoring case */
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (uint8_t)tolower((unsigned char)key[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void insert_key(const char *key) {
+	size_t mask = keys.slot_count - 1;
+	size_t i = hash_key(key, strlen(key)) & mask;
+	while (keys.slots[i]) {
+		i = (i + 1) & mask;
+	}
+	keys.slots[i] = key;
+	keys.count++;
+}
+
+static void grow_keys(void) {
+	const char **old = keys.slots;
+	size_t old_count = keys.slot_count;
+	keys.slot_count = old_count ? old_count * 2 : 256;
+	keys.slots = calloc(keys.slot_count, sizeof(char *));
+	keys.count = 0;
+	if (!old) {
+		for (size_t i = 0; i < HEADER_FIELD_COUNT; ++i) {
+			insert_key(field_names[i]);
+		}
+	}
+	for (size_t i = 0; i < old_count; ++i) {
+		if (old[i]) {
+			insert_key(old[i]);
+		}
+	}
+	free(old);
+}
+
+static const char *intern_key(const char *key, size_t len) {
+	pthread_mutex_lock(&keys.lock);
+	if ((keys.count + 1) * 2 > keys.slot_count) {
+		grow_keys();
+	}
+	size_t mask = keys.slot_count - 1;
+	size_t i = hash_key(key, len) & mask;
+	for (; keys.slots[i]; i = (i + 1) & mask) {
+		if (strncasecmp(keys.slots[i], key, len) == 0
+				&& keys.slots[i][len] == '\0') {
+			break;
+		}
+	}
+	if (!keys.slots[i]) {
+		keys.slots[i] = strndup(key, len);
+		keys.count++;
+	}
+	const char *interned = keys.slots[i];
+	pthread_mutex_unlock(&keys.lock);
+	return interned;
+}
+
+const char *intern_header_key(const char *key) {
+	return intern_key(key, strlen(key));
+}
+
+struct email_headers *create_email_headers(void) {
+	struct email_headers *headers = calloc(1, sizeof(struct email_headers));
+	headers->headers = create_list();
+	return headers;
+}
+
+static void fill_fields(struct email_headers *output) {
+	for (size_t i = 0; i < HEADER_FIELD_COUNT; ++i) {
+		output->fields[i] = NULL;
+	}
+	for (size_t i = output->headers->length; i > 0; --i) {
+		struct email_header *header = output->headers->items[i - 1];
+		for (size_t j = 0; j < HEADER_FIELD_COUNT; ++j) {
+			if (header->key == field_names[j]) {
+				output->fields[j] = header->value;
+				break;
 			}
 		}
+	}
+}
+
+static void finish(struct email_headers *output, struct email_header *records,
+		size_t count, char *arena, size_t arena_size) {
+	/*
+	 * The list points into the records, so it's only built once they're
+	 * done moving around.
+	 */
+	output->records = records;
+	output->arena = arena;
+	output->arena_size = arena_size;
+	for (size_t i = 0; i < count; ++i) {
+		list_add(output->headers, &records[i]);
+	}
+	fill_fields(output);
+}
 
-		char *colon = strchr(headers, ':');
-		if (!colon) {
-			headers = eol;
-			if (*headers) headers += 2;
-		}
-		int colon_i = colon - headers;
-		char *key = malloc(colon_i + 1);
-		strncpy(key, headers, colon_i);
-		key[colon_i] = '\0';
-		if (strstr(colon + 1, "\r\n") != colon + 1) {
-			colon_i += 2;
-		}
-		char *value = malloc(eol_i - colon_i + 1);
-		strncpy(value, headers + colon_i, eol_i - colon_i);
-		value[eol_i - colon_i] = '\0';
-		worker_log(L_DEBUG, "Parsed header: %s: %s", key, value);
-		headers = eol;
-		if (*headers) headers += 2;
-		struct email_header *header = calloc(1, sizeof(struct email_header));
-		header->key = key;
-		header->value = value;
-		list_add(output, header);
+static const char *end_of_line(const char *p, const char *end) {
+	/* Returns the start of the next line, for CRLF or bare LF */
+	p = memchr(p, '\n', end - p);
+	return p ? p + 1 : end;
+}
+
+int parse_headers(const char *text, struct email_headers *output) {
+	/*
+	 * One pass over the text. Unfolding never makes a value longer, so every
+	 * value fits in one buffer the size of the input, and is written there
+	 * directly. Folded lines are joined with a single space, and whitespace
+	 * around each value is trimmed.
+	 *
+	 * Parsing stops at the blank line that ends the header block. Lines
+	 * without a colon are skipped, along with their continuation lines.
+	 */
+	size_t len = strlen(text);
+	const char *p = text, *end = text + len;
+	char *arena = malloc(len + 1), *out = arena;
+	size_t count = 0, capacity = 16;
+	struct email_header *records = malloc(sizeof(struct email_header) * capacity);
+
+	while (p < end && (*p == '\r' || *p == '\n')) {
+		++p;
 	}
+	while (p < end && *p != '\r' && *p != '\n') {
+		const char *name = p;
+		while (p < end && *p != ':' && *p != '\r' && *p != '\n') {
+			++p;
+		}
+		const char *name_end = p;
+		while (name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\t')) {
+			--name_end;
+		}
+		if (p == end || *p != ':' || name_end == name) {
+			do {
+				p = end_of_line(p, end);
+			} while (p < end && (*p == ' ' || *p == '\t'));
+			continue;
+		}
+		++p;
+
+		/* Each physical line of the value is copied in one go */
+		char *value = out;
+		while (p < end && (*p == ' ' || *p == '\t')) {
+			++p;
+		}
+		while (1) {
+			const char *next = end_of_line(p, end);
+			const char *line_end = next;
+			if (line_end > p && line_end[-1] == '\n') --line_end;
+			if (line_end > p && line_end[-1] == '\r') --line_end;
+			if (line_end > p) {
+				if (out != value) {
+					*out++ = ' ';
+				}
+				memcpy(out, p, line_end - p);
+				out += line_end - p;
+				while (out > value && (out[-1] == ' ' || out[-1] == '\t')) {
+					--out;
+				}
+			}
+			p = next;
+			if (p == end || (*p != ' ' && *p != '\t')) {
+				break;
+			}
+			while (p < end && (*p == ' ' || *p == '\t')) {
+				++p;
+			}
+		}
+		*out++ = '\0';
+
+		if (count == capacity) {
+			capacity *= 2;
+			records = realloc(records, sizeof(struct email_header) * capacity);
+		}
+		records[count].key = intern_key(name, name_end - name);
+		records[count].value = value;
+		++count;
+	}
+	finish(output, records, count, arena, out - arena);
 	return 0;
 }
 
-void free_headers(list_t *headers) {
+void free_headers(struct email_headers *headers) {
 	if (!headers) return;
-	for (size_t i = 0; i < headers->length; ++i) {
-		struct email_header *header = headers->items[i];
-		if (header) {
-			free(header->key);
-			free(header->value);
-			free(header);
+	for (size_t i = 0; i < HEADER_FIELD_COUNT; ++i) {
+		free(headers->decoded[i]);
+	}
+	list_free(headers->headers);
+	free(headers->records);
+	free(headers->arena);
+	free(headers);
+}
+
+struct email_headers *copy_headers(const struct email_headers *headers) {
+	struct email_headers *copy = create_email_headers();
+	size_t count = headers->headers->length;
+	struct email_header *records =
+		malloc(sizeof(struct email_header) * (count ? count : 1));
+	char *arena = malloc(headers->arena_size ? headers->arena_size : 1);
+	if (headers->arena_size) {
+		memcpy(arena, headers->arena, headers->arena_size);
+	}
+	for (size_t i = 0; i < count; ++i) {
+		struct email_header *header = headers->headers->items[i];
+		records[i].key = header->key;
+		records[i].value = arena + (header->value - headers->arena);
+	}
+	finish(copy, records, count, arena, headers->arena_size);
+	for (size_t i = 0; i < HEADER_FIELD_COUNT; ++i) {
+		if (headers->decoded[i]) {
+			copy->decoded[i] = strdup(headers->decoded[i]);
+		}
+	}
+	return copy;
+}
+
+void decode_headers(struct email_headers *headers) {
+	static const enum header_field text_fields[] = {
+		HEADER_SUBJECT, HEADER_FROM, HEADER_TO, HEADER_CC, HEADER_REPLY_TO
+	};
+	for (size_t i = 0; i < sizeof(text_fields) / sizeof(text_fields[0]); ++i) {
+		enum header_field field = text_fields[i];
+		if (!headers->decoded[field]) {
+			headers->decoded[field] = rfc2047_decode(headers->fields[field]);
+		}
+	}
+}
+
+const char *header_text(const struct email_headers *headers,
+		enum header_field field) {
+	return headers->decoded[field] ? headers->decoded[field]
+		: headers->fields[field];
+}
+
+const char *header_field_name(enum header_field field) {
+	return field_names[field];
+}
+
+const char *get_header(const struct email_headers *headers, const char *key) {
+	key = intern_header_key(key);
+	for (size_t i = 0; i < HEADER_FIELD_COUNT; ++i) {
+		if (key == field_names[i]) {
+			return headers->fields[i];
+		}
+	}
+	for (size_t i = 0; i < headers->headers->length; ++i) {
+		struct email_header *header = headers->headers->items[i];
+		if (header->key == key) {
+			return header->value;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Dates
+ */
+
+static const char *skip_cfws(const char *p) {
+	/* Whitespace and (nested) comments, which obsolete dates may contain */
+	int depth = 0;
+	while (*p) {
+		if (*p == '(') {
+			++depth;
+		} else if (*p == ')' && depth) {
+			--depth;
+		} else if (!depth && !isspace((unsigned char)*p)) {
+			break;
+		}
+		++p;
+	}
+	return p;
+}
+
+static bool parse_digits(const char **p, int min, int max, int *value) {
+	int n = 0;
+	*value = 0;
+	while (isdigit((unsigned char)**p) && n < max) {
+		*value = *value * 10 + (**p - '0');
+		++*p;
+		++n;
+	}
+	return n >= min;
+}
+
+static int64_t days_from_civil(int64_t y, int m, int d) {
+	/* Days since 1970-01-01 in the proleptic Gregorian calendar */
+	y -= m <= 2;
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	int64_t yoe = y - era * 400;
+	int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+int64_t parse_header_date(const char *value) {
+	static const char *months[] = {
+		"jan", "feb", "mar", "apr", "may", "jun",
+		"jul", "aug", "sep", "oct", "nov", "dec",
+	};
+	static const struct { const char *name; int offset; } zones[] = {
+		{ "UT", 0 }, { "GMT", 0 }, { "Z", 0 },
+		{ "EST", -500 }, { "EDT", -400 }, { "CST", -600 }, { "CDT", -500 },
+		{ "MST", -700 }, { "MDT", -600 }, { "PST", -800 }, { "PDT", -700 },
+	};
+	if (!value) {
+		return 0;
+	}
+	const char *p = skip_cfws(value);
+	if (isalpha((unsigned char)*p)) {
+		/* Day of the week, which we don't need */
+		while (isalpha((unsigned char)*p)) ++p;
+		p = skip_cfws(p);
+		if (*p == ',') ++p;
+		p = skip_cfws(p);
+	}
+	int day, year, hour, minute, second = 0;
+	if (!parse_digits(&p, 1, 2, &day)) {
+		return 0;
+	}
+	p = skip_cfws(p);
+	int month;
+	for (month = 0; month < 12; ++month) {
+		if (strncasecmp(p, months[month], 3) == 0) {
+			break;
+		}
+	}
+	if (month == 12) {
+		return 0;
+	}
+	p = skip_cfws(p + 3);
+	const char *start = p;
+	if (!parse_digits(&p, 2, 4, &year)) {
+		return 0;
+	}
+	if (p - start == 2) {
+		/* RFC 5322 4.3: two digit years below 50 are in this century */
+		year += year < 50 ? 2000 : 1900;
+	} else if (p - start == 3) {
+		year += 1900;
+	}
+	p = skip_cfws(p);
+	if (!parse_digits(&p, 1, 2, &hour) || *(p = skip_cfws(p)) != ':') {
+		return 0;
+	}
+	p = skip_cfws(p + 1);
+	if (!parse_digits(&p, 1, 2, &minute)) {
+		return 0;
+	}
+	p = skip_cfws(p);
+	if (*p == ':') {
+		p = skip_cfws(p + 1);
+		if (!parse_digits(&p, 1, 2, &second)) {
+			return 0;
+		}
+		p = skip_cfws(p);
+	}
+	if (day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+		return 0;
+	}
+	int offset = 0;
+	if (*p == '+' || *p == '-') {
+		const char *sign = p++;
+		if (!parse_digits(&p, 4, 4, &offset)) {
+			return 0;
+		}
+		if (*sign == '-') offset = -offset;
+	} else {
+		/* Unknown zones, military ones included, are taken as UTC */
+		size_t len = 0;
+		while (isalpha((unsigned char)p[len])) ++len;
+		for (size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); ++i) {
+			if (strlen(zones[i].name) == len
+					&& strncasecmp(p, zones[i].name, len) == 0) {
+				offset = zones[i].offset;
+				break;
+			}
 		}
 	}
-	list_free(headers);
+	return days_from_civil(year, month + 1, day) * 86400
+		+ hour * 3600 + minute * 60 + second
+		- (offset / 100 * 3600 + offset % 100 * 60);
 }
@@ -0,0 +1,831 @@
+/*
+ * email/index.c - local inverted index for offline message search
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "email/index.h"
+#include "log.h"
+#include "util/list.h"
+#include "util/uidset.h"
+
+#define INDEX_MAGIC "AERCIDX2"
+#define JOURNAL_MAGIC "AERCJNL2"
+#define MAX_TOKEN 64
+// Fold the journal into the snapshot after this many new documents
+#define JOURNAL_LIMIT 50000
+
+struct posting {
+	uint32_t count, last;
+	size_t length, capacity;
+	uint8_t *data;
+};
+
+struct index_term {
+	size_t name; // Offset into the string pool
+	struct posting posting;
+};
+
+// Removed docs stay in the posting lists until the next save, under no mailbox
+#define REMOVED UINT32_MAX
+
+struct index_doc {
+	uint32_t mailbox, uid;
+};
+
+struct index_mailbox {
+	char *name;
+	uint32_t uidvalidity; // 0 if not known
+};
+
+// What each record in the journal does
+enum journal_op {
+	JOURNAL_ADD = 'A',
+	JOURNAL_REMOVE = 'R',
+	JOURNAL_UIDVALIDITY = 'V',
+};
+
+struct email_index {
+	char *path;
+	FILE *journal;
+	size_t journal_docs;
+	list_t *mailboxes; // struct index_mailbox
+
+	struct index_doc *docs;
+	size_t doc_count, doc_capacity, removed_count;
+	/* Open addressing, maps mailbox/uid to doc id + 1 */
+	uint32_t *doc_slots;
+	size_t doc_slot_count;
+
+	char *pool;
+	size_t pool_length, pool_capacity;
+	struct index_term *terms;
+	size_t term_count, term_capacity;
+	/* Open addressing, maps token to term index + 1 */
+	uint32_t *term_slots;
+	size_t term_slot_count;
+};
+
+/*
+ * Hashing and lookup
+ */
+
+static uint32_t hash_bytes(const char *str, size_t len) {
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (uint8_t)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static uint32_t hash_doc(uint32_t mailbox, uint32_t uid) {
+	uint64_t key = ((uint64_t)mailbox << 32) | uid;
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return (uint32_t)key;
+}
+
+static void rehash_docs(struct email_index *index) {
+	size_t count = index->doc_slot_count ? index->doc_slot_count * 2 : 1024;
+	free(index->doc_slots);
+	index->doc_slots = calloc(count, sizeof(uint32_t));
+	index->doc_slot_count = count;
+	for (size_t i = 0; i < index->doc_count; ++i) {
+		struct index_doc *doc = &index->docs[i];
+		if (doc->mailbox == REMOVED) {
+			continue;
+		}
+		size_t slot = hash_doc(doc->mailbox, doc->uid) & (count - 1);
+		while (index->doc_slots[slot]) {
+			slot = (slot + 1) & (count - 1);
+		}
+		index->doc_slots[slot] = i + 1;
+	}
+}
+
+static long find_doc(struct email_index *index, uint32_t mailbox, uint32_t uid) {
+	if (!index->doc_slot_count) {
+		return -1;
+	}
+	size_t mask = index->doc_slot_count - 1;
+	size_t slot = hash_doc(mailbox, uid) & mask;
+	while (index->doc_slots[slot]) {
+		struct index_doc *doc = &index->docs[index->doc_slots[slot] - 1];
+		if (doc->mailbox == mailbox && doc->uid == uid) {
+			return index->doc_slots[slot] - 1;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+static uint32_t add_doc(struct email_index *index, uint32_t mailbox,
+		uint32_t uid) {
+	if (index->doc_count == index->doc_capacity) {
+		index->doc_capacity = index->doc_capacity ? index->doc_capacity * 2 : 1024;
+		index->docs = realloc(index->docs,
+				sizeof(struct index_doc) * index->doc_capacity);
+	}
+	uint32_t id = index->doc_count++;
+	index->docs[id].mailbox = mailbox;
+	index->docs[id].uid = uid;
+	if (mailbox == REMOVED) {
+		index->removed_count++;
+	} else if (index->doc_count * 10 >= index->doc_slot_count * 7) {
+		rehash_docs(index);
+	} else {
+		size_t mask = index->doc_slot_count - 1;
+		size_t slot = hash_doc(mailbox, uid) & mask;
+		while (index->doc_slots[slot]) {
+			slot = (slot + 1) & mask;
+		}
+		index->doc_slots[slot] = id + 1;
+	}
+	return id;
+}
+
+static void rehash_terms(struct email_index *index) {
+	size_t count = index->term_slot_count ? index->term_slot_count * 2 : 4096;
+	free(index->term_slots);
+	index->term_slots = calloc(count, sizeof(uint32_t));
+	index->term_slot_count = count;
+	for (size_t i = 0; i < index->term_count; ++i) {
+		const char *name = index->pool + index->terms[i].name;
+		size_t slot = hash_bytes(name, strlen(name)) & (count - 1);
+		while (index->term_slots[slot]) {
+			slot = (slot + 1) & (count - 1);
+		}
+		index->term_slots[slot] = i + 1;
+	}
+}
+
+static struct index_term *find_term(struct email_index *index,
+		const char *token, size_t len, bool create) {
+	if (index->term_count * 10 >= index->term_slot_count * 7) {
+		rehash_terms(index);
+	}
+	size_t mask = index->term_slot_count - 1;
+	size_t slot = hash_bytes(token, len) & mask;
+	while (index->term_slots[slot]) {
+		struct index_term *term = &index->terms[index->term_slots[slot] - 1];
+		const char *name = index->pool + term->name;
+		if (strncmp(name, token, len) == 0 && name[len] == '\0') {
+			return term;
+		}
+		slot = (slot + 1) & mask;
+	}
+	if (!create) {
+		return NULL;
+	}
+	/*
+	 * Add the token to the string pool and make a new term for it.
+	 */
+	if (index->pool_length + len + 1 > index->pool_capacity) {
+		while (index->pool_length + len + 1 > index->pool_capacity) {
+			index->pool_capacity = index->pool_capacity ?
+				index->pool_capacity * 2 : 65536;
+		}
+		index->pool = realloc(index->pool, index->pool_capacity);
+	}
+	if (index->term_count == index->term_capacity) {
+		index->term_capacity = index->term_capacity ?
+			index->term_capacity * 2 : 1024;
+		index->terms = realloc(index->terms,
+				sizeof(struct index_term) * index->term_capacity);
+	}
+	struct index_term *term = &index->terms[index->term_count];
+	memset(term, 0, sizeof(struct index_term));
+	term->name = index->pool_length;
+	memcpy(index->pool + index->pool_length, token, len);
+	index->pool[index->pool_length + len] = '\0';
+	index->pool_length += len + 1;
+	index->term_slots[slot] = ++index->term_count;
+	return term;
+}
+
+static uint32_t mailbox_id(struct email_index *index, const char *mailbox,
+		bool create) {
+	for (size_t i = 0; i < index->mailboxes->length; ++i) {
+		struct index_mailbox *mbox = index->mailboxes->items[i];
+		if (strcmp(mbox->name, mailbox) == 0) {
+			return i;
+		}
+	}
+	if (!create) {
+		return UINT32_MAX;
+	}
+	struct index_mailbox *mbox = calloc(1, sizeof(struct index_mailbox));
+	mbox->name = strdup(mailbox);
+	list_add(index->mailboxes, mbox);
+	return index->mailboxes->length - 1;
+}
+
+static void free_mailboxes(list_t *mailboxes) {
+	for (size_t i = 0; i < mailboxes->length; ++i) {
+		struct index_mailbox *mbox = mailboxes->items[i];
+		free(mbox->name);
+		free(mbox);
+	}
+	list_free(mailboxes);
+}
+
+static void remove_doc(struct email_index *index, uint32_t doc) {
+	/*
+	 * Its slot is left in place, so as not to break the probe sequence of
+	 * the docs after it, but no lookup matches it any more.
+	 */
+	index->docs[doc].mailbox = REMOVED;
+	index->removed_count++;
+}
+
+/*
+ * Posting lists
+ */
+
+static void posting_add(struct posting *posting, uint32_t doc) {
+	if (posting->count && posting->last == doc) {
+		return; // Token appeared twice in the same document
+	}
+	uint32_t delta = posting->count ? doc - posting->last : doc;
+	if (posting->length + 5 > posting->capacity) {
+		posting->capacity = posting->capacity ? posting->capacity * 2 : 8;
+		posting->data = realloc(posting->data, posting->capacity);
+	}
+	do {
+		uint8_t byte = delta & 0x7F;
+		delta >>= 7;
+		posting->data[posting->length++] = byte | (delta ? 0x80 : 0);
+	} while (delta);
+	posting->last = doc;
+	posting->count++;
+}
+
+static uint32_t *posting_decode(const struct posting *posting) {
+	uint32_t *docs = malloc(sizeof(uint32_t) * (posting->count + 1));
+	uint32_t doc = 0;
+	size_t n = 0;
+	for (size_t i = 0; i < posting->length && n < posting->count;) {
+		uint32_t delta = 0;
+		int shift = 0;
+		uint8_t byte;
+		do {
+			byte = posting->data[i++];
+			delta |= (uint32_t)(byte & 0x7F) << shift;
+			shift += 7;
+		} while (byte & 0x80 && i < posting->length);
+		doc = n == 0 ? delta : doc + delta;
+		docs[n++] = doc;
+	}
+	return docs;
+}
+
+/*
+ * Tokenizing
+ */
+
+static const char *next_token(const char *text, char *token, size_t *len,
+		bool *prefix) {
+	/*
+	 * Tokens are runs of ASCII letters and digits, or any non-ASCII bytes
+	 * (so UTF-8 words stay intact). ASCII is folded to lowercase. Returns a
+	 * pointer past the token, or NULL when there are no more.
+	 */
+	const unsigned char *s = (const unsigned char *)text;
+	while (*s && !(isalnum(*s) || *s >= 0x80)) {
+		++s;
+	}
+	if (!*s) {
+		return NULL;
+	}
+	*len = 0;
+	while (*s && (isalnum(*s) || *s >= 0x80)) {
+		if (*len < MAX_TOKEN) {
+			token[(*len)++] = tolower(*s);
+		}
+		++s;
+	}
+	if (prefix) {
+		*prefix = *s == '*';
+	}
+	return (const char *)s;
+}
+
+static void index_text(struct email_index *index, uint32_t doc,
+		const char *text) {
+	char token[MAX_TOKEN];
+	size_t len;
+	while ((text = next_token(text, token, &len, NULL))) {
+		if (len < 2) {
+			continue;
+		}
+		struct index_term *term = find_term(index, token, len, true);
+		posting_add(&term->posting, doc);
+	}
+}
+
+static bool _email_index_add(struct email_index *index, const char *mailbox,
+		long uid, const char *text) {
+	uint32_t mbox = mailbox_id(index, mailbox, true);
+	if (find_doc(index, mbox, uid) != -1) {
+		return false;
+	}
+	uint32_t doc = add_doc(index, mbox, uid);
+	index_text(index, doc, text);
+	return true;
+}
+
+static bool _email_index_remove(struct email_index *index,
+		const char *mailbox, long uid) {
+	uint32_t mbox = mailbox_id(index, mailbox, false);
+	long doc = mbox == UINT32_MAX ? -1 : find_doc(index, mbox, uid);
+	if (doc == -1) {
+		return false;
+	}
+	remove_doc(index, doc);
+	return true;
+}
+
+static bool _email_index_set_uidvalidity(struct email_index *index,
+		const char *mailbox, uint32_t uidvalidity) {
+	uint32_t id = mailbox_id(index, mailbox, true);
+	struct index_mailbox *mbox = index->mailboxes->items[id];
+	if (mbox->uidvalidity == uidvalidity) {
+		return false;
+	}
+	if (mbox->uidvalidity) {
+		/* Every UID we had for this mailbox may now be another message */
+		for (size_t i = 0; i < index->doc_count; ++i) {
+			if (index->docs[i].mailbox == id) {
+				remove_doc(index, i);
+			}
+		}
+	}
+	mbox->uidvalidity = uidvalidity;
+	return true;
+}
+
+static void compact_docs(struct email_index *index) {
+	/*
+	 * Drops removed docs for good, renumbering the rest and rewriting every
+	 * posting list to match.
+	 */
+	uint32_t *ids = malloc(sizeof(uint32_t) * (index->doc_count + 1));
+	size_t n = 0;
+	for (size_t i = 0; i < index->doc_count; ++i) {
+		ids[i] = index->docs[i].mailbox == REMOVED ? REMOVED : n;
+		if (ids[i] != REMOVED) {
+			index->docs[n++] = index->docs[i];
+		}
+	}
+	for (size_t i = 0; i < index->term_count; ++i) {
+		struct posting *posting = &index->terms[i].posting;
+		uint32_t *docs = posting_decode(posting);
+		size_t count = posting->count;
+		posting->count = posting->length = posting->last = 0;
+		for (size_t j = 0; j < count; ++j) {
+			if (ids[docs[j]] != REMOVED) {
+				posting_add(posting, ids[docs[j]]);
+			}
+		}
+		free(docs);
+	}
+	free(ids);
+	index->doc_count = n;
+	index->removed_count = 0;
+	/* Rebuild the doc slots at the same size */
+	index->doc_slot_count /= 2;
+	rehash_docs(index);
+}
+
+/*
+ * Persistence
+ */
+
+static bool write_u32(FILE *f, uint32_t value) {
+	return fwrite(&value, sizeof(value), 1, f) == 1;
+}
+
+static bool read_u32(FILE *f, uint32_t *value) {
+	return fread(value, sizeof(*value), 1, f) == 1;
+}
+
+static char *read_string(FILE *f) {
+	uint32_t len;
+	if (!read_u32(f, &len) || len > 1 << 20) {
+		return NULL;
+	}
+	char *str = malloc(len + 1);
+	if (fread(str, 1, len, f) != len) {
+		free(str);
+		return NULL;
+	}
+	str[len] = '\0';
+	return str;
+}
+
+static bool write_string(FILE *f, const char *str) {
+	uint32_t len = strlen(str);
+	return write_u32(f, len) && fwrite(str, 1, len, f) == len;
+}
+
+static bool load_snapshot(struct email_index *index, FILE *f) {
+	char magic[sizeof(INDEX_MAGIC) - 1];
+	if (fread(magic, 1, sizeof(magic), f) != sizeof(magic)
+			|| memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) {
+		return false;
+	}
+	uint32_t count;
+	if (!read_u32(f, &count)) return false;
+	for (uint32_t i = 0; i < count; ++i) {
+		struct index_mailbox *mbox = calloc(1, sizeof(struct index_mailbox));
+		list_add(index->mailboxes, mbox);
+		if (!(mbox->name = read_string(f))) return false;
+		if (!read_u32(f, &mbox->uidvalidity)) return false;
+	}
+	if (!read_u32(f, &count)) return false;
+	for (uint32_t i = 0; i < count; ++i) {
+		struct index_doc doc;
+		if (fread(&doc, sizeof(doc), 1, f) != 1) return false;
+		add_doc(index, doc.mailbox, doc.uid);
+	}
+	if (!read_u32(f, &count)) return false;
+	for (uint32_t i = 0; i < count; ++i) {
+		char *name = read_string(f);
+		if (!name) return false;
+		struct index_term *term = find_term(index, name, strlen(name), true);
+		free(name);
+		struct posting *p = &term->posting;
+		uint32_t length;
+		if (!read_u32(f, &p->count) || !read_u32(f, &p->last)
+				|| !read_u32(f, &length)) {
+			return false;
+		}
+		p->length = p->capacity = length;
+		p->data = malloc(length ? length : 1);
+		if (fread(p->data, 1, length, f) != length) return false;
+	}
+	return true;
+}
+
+static bool replay_journal(struct email_index *index, FILE *f) {
+	/*
+	 * Each record is an op, a mailbox and a number (a UID, or the
+	 * UIDVALIDITY), and the text for JOURNAL_ADD. A record cut short by a
+	 * crash ends the journal.
+	 */
+	char magic[sizeof(JOURNAL_MAGIC) - 1];
+	if (fread(magic, 1, sizeof(magic), f) != sizeof(magic)
+			|| memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0) {
+		return false;
+	}
+	while (1) {
+		int op = fgetc(f);
+		char *mailbox = read_string(f);
+		uint32_t value;
+		char *text = NULL;
+		if (op == EOF || !mailbox || !read_u32(f, &value)
+				|| (op == JOURNAL_ADD && !(text = read_string(f)))) {
+			free(mailbox);
+			break;
+		}
+		bool changed = false;
+		switch (op) {
+		case JOURNAL_ADD:
+			changed = _email_index_add(index, mailbox, value, text);
+			break;
+		case JOURNAL_REMOVE:
+			changed = _email_index_remove(index, mailbox, value);
+			break;
+		case JOURNAL_UIDVALIDITY:
+			changed = _email_index_set_uidvalidity(index, mailbox, value);
+			break;
+		}
+		if (changed) {
+			index->journal_docs++;
+		}
+		free(mailbox);
+		free(text);
+	}
+	return true;
+}
+
+static void open_journal(struct email_index *index, bool truncate) {
+	char *journal = malloc(strlen(index->path) + strlen(".journal") + 1);
+	strcpy(journal, index->path);
+	strcat(journal, ".journal");
+	index->journal = fopen(journal, truncate ? "wb" : "ab");
+	free(journal);
+	if (index->journal && fseek(index->journal, 0, SEEK_END) == 0
+			&& ftell(index->journal) == 0) {
+		fwrite(JOURNAL_MAGIC, 1, strlen(JOURNAL_MAGIC), index->journal);
+	}
+}
+
+static void journal_write(struct email_index *index, enum journal_op op,
+		const char *mailbox, uint32_t value, const char *text) {
+	if (!index->journal) {
+		return;
+	}
+	fputc(op, index->journal);
+	write_string(index->journal, mailbox);
+	write_u32(index->journal, value);
+	if (text) {
+		write_string(index->journal, text);
+	}
+	if (++index->journal_docs >= JOURNAL_LIMIT) {
+		email_index_save(index);
+	}
+}
+
+static void email_index_reset(struct email_index *index) {
+	free_mailboxes(index->mailboxes);
+	index->mailboxes = create_list();
+	for (size_t i = 0; i < index->term_count; ++i) {
+		free(index->terms[i].posting.data);
+	}
+	index->doc_count = index->term_count = index->pool_length = 0;
+	index->removed_count = 0;
+	memset(index->doc_slots, 0, index->doc_slot_count * sizeof(uint32_t));
+	memset(index->term_slots, 0, index->term_slot_count * sizeof(uint32_t));
+}
+
+struct email_index *email_index_open(const char *path) {
+	struct email_index *index = calloc(1, sizeof(struct email_index));
+	index->mailboxes = create_list();
+	rehash_docs(index);
+	rehash_terms(index);
+	if (!path) {
+		return index;
+	}
+	index->path = strdup(path);
+
+	FILE *f = fopen(path, "rb");
+	if (f) {
+		if (!load_snapshot(index, f)) {
+			worker_log(L_ERROR, "Search index %s is corrupt, rebuilding", path);
+			email_index_reset(index);
+		}
+		fclose(f);
+	}
+
+	char *journal = malloc(strlen(path) + strlen(".journal") + 1);
+	strcpy(journal, path);
+	strcat(journal, ".journal");
+	f = fopen(journal, "rb");
+	/* A journal from an older version is dropped */
+	bool replayed = true;
+	if (f) {
+		replayed = replay_journal(index, f);
+		fclose(f);
+	}
+	free(journal);
+	open_journal(index, !replayed);
+	worker_log(L_DEBUG, "Loaded search index with %zd messages, %zd terms",
+			index->doc_count, index->term_count);
+	return index;
+}
+
+bool email_index_save(struct email_index *index) {
+	if (!index->path) {
+		return false;
+	}
+	char *tmp = malloc(strlen(index->path) + strlen(".tmp") + 1);
+	strcpy(tmp, index->path);
+	strcat(tmp, ".tmp");
+	FILE *f = fopen(tmp, "wb");
+	if (!f) {
+		worker_log(L_ERROR, "Unable to write search index %s", tmp);
+		free(tmp);
+		return false;
+	}
+	if (index->removed_count) {
+		compact_docs(index);
+	}
+	bool ok = fwrite(INDEX_MAGIC, 1, strlen(INDEX_MAGIC), f)
+		== strlen(INDEX_MAGIC);
+	ok = ok && write_u32(f, index->mailboxes->length);
+	for (size_t i = 0; ok && i < index->mailboxes->length; ++i) {
+		struct index_mailbox *mbox = index->mailboxes->items[i];
+		ok = write_string(f, mbox->name) && write_u32(f, mbox->uidvalidity);
+	}
+	ok = ok && write_u32(f, index->doc_count);
+	ok = ok && fwrite(index->docs, sizeof(struct index_doc),
+			index->doc_count, f) == index->doc_count;
+	ok = ok && write_u32(f, index->term_count);
+	for (size_t i = 0; ok && i < index->term_count; ++i) {
+		struct index_term *term = &index->terms[i];
+		ok = write_string(f, index->pool + term->name)
+			&& write_u32(f, term->posting.count)
+			&& write_u32(f, term->posting.last)
+			&& write_u32(f, term->posting.length)
+			&& fwrite(term->posting.data, 1, term->posting.length, f)
+				== term->posting.length;
+	}
+	ok = fclose(f) == 0 && ok;
+	if (ok && rename(tmp, index->path) == 0) {
+		/* Everything in the journal is in the snapshot now */
+		if (index->journal) {
+			fclose(index->journal);
+			open_journal(index, true);
+		}
+		index->journal_docs = 0;
+	} else {
+		worker_log(L_ERROR, "Unable to write search index %s", tmp);
+		remove(tmp);
+		ok = false;
+	}
+	free(tmp);
+	return ok;
+}
+
+void email_index_close(struct email_index *index) {
+	if (!index) return;
+	if (index->journal_docs) {
+		email_index_save(index);
+	}
+	if (index->journal) {
+		fclose(index->journal);
+	}
+	for (size_t i = 0; i < index->term_count; ++i) {
+		free(index->terms[i].posting.data);
+	}
+	free_mailboxes(index->mailboxes);
+	free(index->terms);
+	free(index->term_slots);
+	free(index->pool);
+	free(index->docs);
+	free(index->doc_slots);
+	free(index->path);
+	free(index);
+}
+
+char *email_index_path(const char *key) {
+	/*
+	 * $XDG_CACHE_HOME/aerc/<key>.idx, creating the directory if needed.
+	 */
+	const char *cache = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	if (!cache && !home) {
+		return NULL;
+	}
+	int len = cache ? snprintf(NULL, 0, "%s/aerc", cache)
+		: snprintf(NULL, 0, "%s/.cache/aerc", home);
+	char *dir = malloc(len + 1);
+	if (cache) {
+		snprintf(dir, len + 1, "%s", cache);
+	} else {
+		snprintf(dir, len + 1, "%s/.cache", home);
+		mkdir(dir, 0700);
+	}
+	strcat(dir, "/aerc");
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+		free(dir);
+		return NULL;
+	}
+	len = snprintf(NULL, 0, "%s/%s.idx", dir, key);
+	char *path = malloc(len + 1);
+	snprintf(path, len + 1, "%s/%s.idx", dir, key);
+	for (char *c = path + strlen(dir) + 1; *c; ++c) {
+		if (*c == '/') *c = '_';
+	}
+	free(dir);
+	return path;
+}
+
+/*
+ * Public interface
+ */
+
+bool email_index_contains(struct email_index *index, const char *mailbox,
+		long uid) {
+	uint32_t mbox = mailbox_id(index, mailbox, false);
+	return mbox != UINT32_MAX && find_doc(index, mbox, uid) != -1;
+}
+
+void email_index_add(struct email_index *index, const char *mailbox,
+		long uid, const char *text) {
+	if (_email_index_add(index, mailbox, uid, text)) {
+		journal_write(index, JOURNAL_ADD, mailbox, uid, text);
+	}
+}
+
+void email_index_remove(struct email_index *index, const char *mailbox,
+		long uid) {
+	if (_email_index_remove(index, mailbox, uid)) {
+		journal_write(index, JOURNAL_REMOVE, mailbox, uid, NULL);
+	}
+}
+
+void email_index_set_uidvalidity(struct email_index *index,
+		const char *mailbox, uint32_t uidvalidity) {
+	if (_email_index_set_uidvalidity(index, mailbox, uidvalidity)) {
+		journal_write(index, JOURNAL_UIDVALIDITY, mailbox, uidvalidity, NULL);
+	}
+}
+
+static uint32_t *resolve_token(struct email_index *index, const char *token,
+		size_t len, bool prefix, size_t *count) {
+	/*
+	 * Returns the sorted doc IDs for a token. Prefix tokens take the union of
+	 * every matching term, which we build in a bitmap.
+	 */
+	if (!prefix) {
+		struct index_term *term = find_term(index, token, len, false);
+		if (!term) {
+			*count = 0;
+			return NULL;
+		}
+		*count = term->posting.count;
+		return posting_decode(&term->posting);
+	}
+	size_t words = (index->doc_count + 63) / 64;
+	uint64_t *bitmap = calloc(words ? words : 1, sizeof(uint64_t));
+	for (size_t i = 0; i < index->term_count; ++i) {
+		struct index_term *term = &index->terms[i];
+		if (strncmp(index->pool + term->name, token, len) != 0) {
+			continue;
+		}
+		uint32_t *docs = posting_decode(&term->posting);
+		for (uint32_t j = 0; j < term->posting.count; ++j) {
+			bitmap[docs[j] / 64] |= 1ULL << (docs[j] % 64);
+		}
+		free(docs);
+	}
+	uint32_t *docs = malloc(sizeof(uint32_t) * (index->doc_count + 1));
+	*count = 0;
+	for (size_t i = 0; i < index->doc_count; ++i) {
+		if (bitmap[i / 64] & (1ULL << (i % 64))) {
+			docs[(*count)++] = i;
+		}
+	}
+	free(bitmap);
+	return docs;
+}
+
+uidset_t *email_index_query(struct email_index *index, const char *mailbox,
+		const char *query) {
+	uidset_t *result = create_uidset();
+	uint32_t mbox = mailbox_id(index, mailbox, false);
+	if (mbox == UINT32_MAX) {
+		return result;
+	}
+	/*
+	 * Intersect the doc lists of every token in the query, then keep the
+	 * docs that belong to the requested mailbox.
+	 */
+	uint32_t *matches = NULL;
+	size_t match_count = 0;
+	bool first = true;
+	char token[MAX_TOKEN];
+	size_t len;
+	bool prefix;
+	while ((query = next_token(query, token, &len, &prefix))) {
+		if (len < 2 && !prefix) {
+			/* These aren't indexed, so nothing would match */
+			continue;
+		}
+		size_t count;
+		uint32_t *docs = resolve_token(index, token, len, prefix, &count);
+		if (first) {
+			matches = docs;
+			match_count = count;
+			first = false;
+		} else {
+			size_t i = 0, j = 0, n = 0;
+			while (i < match_count && j < count) {
+				if (matches[i] < docs[j]) {
+					++i;
+				} else if (matches[i] > docs[j]) {
+					++j;
+				} else {
+					matches[n++] = matches[i];
+					++i, ++j;
+				}
+			}
+			match_count = n;
+			free(docs);
+		}
+		if (match_count == 0) {
+			break;
+		}
+	}
+	for (size_t i = 0; i < match_count; ++i) {
+		struct index_doc *doc = &index->docs[matches[i]];
+		if (doc->mailbox == mbox) {
+			uidset_add(result, doc->uid);
+		}
+	}
+	free(matches);
+	return result;
+}
@@ -0,0 +1,200 @@
+/*
+ * email/rfc2047.c - decodes MIME encoded words in headers
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "email/charset.h"
+#include "email/rfc2047.h"
+#include "email/transfer.h"
+
+#define MAX_CHARSET 64
+
+struct buffer {
+	char *data;
+	size_t length, capacity;
+};
+
+static void buffer_append(struct buffer *buf, const char *data, size_t len) {
+	if (buf->length + len + 1 > buf->capacity) {
+		size_t capacity = buf->capacity ? buf->capacity : 64;
+		while (buf->length + len + 1 > capacity) {
+			capacity *= 2;
+		}
+		buf->data = realloc(buf->data, capacity);
+		buf->capacity = capacity;
+	}
+	memcpy(buf->data + buf->length, data, len);
+	buf->length += len;
+	buf->data[buf->length] = '\0';
+}
+
+struct encoded_word {
+	const char *end; // Just past the closing ?=
+	char charset[MAX_CHARSET];
+	char encoding;
+	const char *text;
+	size_t text_len;
+};
+
+static bool parse_word(const char *p, struct encoded_word *word) {
+	/*
+	 * =?charset?encoding?encoded-text?=
+	 *
+	 * The charset may carry an RFC 2231 language suffix (utf-8*en), which we
+	 * drop. None of the parts may contain spaces.
+	 */
+	p += 2;
+	size_t len = strcspn(p, "? \t\r\n");
+	if (p[len] != '?' || len == 0 || len >= MAX_CHARSET) {
+		return false;
+	}
+	memcpy(word->charset, p, len);
+	word->charset[len] = '\0';
+	char *star = strchr(word->charset, '*');
+	if (star) *star = '\0';
+	p += len + 1;
+	if ((*p != 'B' && *p != 'b' && *p != 'Q' && *p != 'q') || p[1] != '?') {
+		return false;
+	}
+	word->encoding = *p == 'b' || *p == 'B' ? 'B' : 'Q';
+	p += 2;
+	word->text = p;
+	len = strcspn(p, "? \t\r\n");
+	if (p[len] != '?' || p[len + 1] != '=') {
+		return false;
+	}
+	word->text_len = len;
+	word->end = p + len + 2;
+	return true;
+}
+
+static bool decode_b(const char *text, size_t len, struct buffer *out) {
+	for (size_t i = 0; i < len; ++i) {
+		char c = text[i];
+		if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+				|| (c >= '0' && c <= '9') || c == '+' || c == '/'
+				|| (c == '=' && i >= len - 2))) {
+			return false;
+		}
+	}
+	/* Some mailers leave out the padding, which finish makes up for */
+	char *decoded = malloc(BASE64_DECODED_MAX(len));
+	struct base64_decoder dec;
+	base64_decoder_init(&dec);
+	size_t decoded_len = base64_decode(&dec, text, len, (unsigned char *)decoded);
+	decoded_len += base64_decode_finish(&dec,
+			(unsigned char *)decoded + decoded_len);
+	buffer_append(out, decoded, decoded_len);
+	free(decoded);
+	return true;
+}
+
+static int hex_value(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+static bool decode_q(const char *text, size_t len, struct buffer *out) {
+	for (size_t i = 0; i < len; ++i) {
+		char c = text[i];
+		if (c == '_') {
+			c = ' ';
+		} else if (c == '=') {
+			if (i + 2 >= len) {
+				return false;
+			}
+			int hi = hex_value(text[i + 1]), lo = hex_value(text[i + 2]);
+			if (hi < 0 || lo < 0) {
+				return false;
+			}
+			c = (char)(hi << 4 | lo);
+			i += 2;
+		}
+		buffer_append(out, &c, 1);
+	}
+	return true;
+}
+
+static void flush(struct buffer *out, struct buffer *pending,
+		const char *charset) {
+	/*
+	 * Adjacent words in the same charset are converted together, since
+	 * mailers happily split a multi-byte character across two words.
+	 */
+	if (!pending->length) {
+		return;
+	}
+	char *utf8 = charset_to_utf8(charset, pending->data, pending->length);
+	if (utf8) {
+		buffer_append(out, utf8, strlen(utf8));
+		free(utf8);
+	} else {
+		buffer_append(out, pending->data, pending->length);
+	}
+	pending->length = 0;
+}
+
+static bool is_whitespace(const char *start, const char *end) {
+	for (; start < end; ++start) {
+		if (*start != ' ' && *start != '\t' && *start != '\r' && *start != '\n') {
+			return false;
+		}
+	}
+	return true;
+}
+
+char *rfc2047_decode(const char *text) {
+	if (!text || !strstr(text, "=?")) {
+		return NULL;
+	}
+	struct buffer out = { 0 }, pending = { 0 }, word_bytes = { 0 };
+	char charset[MAX_CHARSET] = "";
+	const char *literal = text; // Start of text not yet copied to out
+	bool after_word = false, decoded_any = false;
+	const char *p = text;
+	while ((p = strstr(p, "=?"))) {
+		struct encoded_word word;
+		word_bytes.length = 0;
+		if (!parse_word(p, &word) || !(word.encoding == 'B' ?
+				decode_b(word.text, word.text_len, &word_bytes) :
+				decode_q(word.text, word.text_len, &word_bytes))) {
+			p += 2;
+			continue;
+		}
+		decoded_any = true;
+		/* Whitespace between two encoded words is dropped */
+		if (!after_word || !is_whitespace(literal, p)) {
+			flush(&out, &pending, charset);
+			buffer_append(&out, literal, p - literal);
+		} else if (strcasecmp(charset, word.charset) != 0) {
+			flush(&out, &pending, charset);
+		}
+		strcpy(charset, word.charset);
+		buffer_append(&pending, word_bytes.data ? word_bytes.data : "",
+				word_bytes.length);
+		literal = p = word.end;
+		after_word = true;
+	}
+	flush(&out, &pending, charset);
+	buffer_append(&out, literal, strlen(literal));
+	free(pending.data);
+	free(word_bytes.data);
+	if (!decoded_any) {
+		free(out.data);
+		return NULL;
+	}
+	/* Encoded words can smuggle in line breaks and other controls */
+	for (char *c = out.data; *c; ++c) {
+		if ((unsigned char)*c < 0x20 || *c == 0x7F) {
+			*c = ' ';
+		}
+	}
+	return out.data;
+}
@@ -0,0 +1,279 @@
+/*
+ * email/thread.c - incremental JWZ message threading
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "email/thread.h"
+#include "util/uidset.h"
+
+static uint32_t hash_id(const char *str, size_t len) {
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (uint8_t)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void rehash(struct thread_index *index) {
+	size_t count = index->slot_count ? index->slot_count * 2 : 1024;
+	struct thread_node **slots = calloc(count, sizeof(struct thread_node *));
+	for (size_t i = 0; i < index->slot_count; ++i) {
+		struct thread_node *node = index->slots[i];
+		if (!node) continue;
+		size_t slot = hash_id(node->message_id,
+				strlen(node->message_id)) & (count - 1);
+		while (slots[slot]) {
+			slot = (slot + 1) & (count - 1);
+		}
+		slots[slot] = node;
+	}
+	free(index->slots);
+	index->slots = slots;
+	index->slot_count = count;
+}
+
+static struct thread_node *get_node(struct thread_index *index,
+		const char *id, size_t len) {
+	/*
+	 * Finds the node for a Message-ID, creating an empty one if we haven't
+	 * seen this ID before.
+	 */
+	if (index->node_count * 10 >= index->slot_count * 7) {
+		rehash(index);
+	}
+	size_t mask = index->slot_count - 1;
+	size_t slot = hash_id(id, len) & mask;
+	while (index->slots[slot]) {
+		struct thread_node *node = index->slots[slot];
+		if (strncmp(node->message_id, id, len) == 0
+				&& node->message_id[len] == '\0') {
+			return node;
+		}
+		slot = (slot + 1) & mask;
+	}
+	struct thread_node *node = calloc(1, sizeof(struct thread_node));
+	node->message_id = malloc(len + 1);
+	memcpy(node->message_id, id, len);
+	node->message_id[len] = '\0';
+	index->slots[slot] = node;
+	index->node_count++;
+	return node;
+}
+
+static void unlink_node(struct thread_node *node) {
+	struct thread_node *parent = node->parent;
+	if (!parent) return;
+	if (node->prev) {
+		node->prev->next = node->next;
+	} else {
+		parent->child = node->next;
+	}
+	if (node->next) {
+		node->next->prev = node->prev;
+	} else {
+		parent->last_child = node->prev;
+	}
+	node->parent = node->prev = node->next = NULL;
+}
+
+static void append_child(struct thread_node *parent, struct thread_node *node) {
+	node->parent = parent;
+	node->prev = parent->last_child;
+	node->next = NULL;
+	if (parent->last_child) {
+		parent->last_child->next = node;
+	} else {
+		parent->child = node;
+	}
+	parent->last_child = node;
+}
+
+static bool is_ancestor(struct thread_node *node, struct thread_node *of) {
+	for (; of; of = of->parent) {
+		if (of == node) return true;
+	}
+	return false;
+}
+
+static void set_parent(struct thread_node *parent, struct thread_node *node) {
+	if (node->parent == parent || is_ancestor(node, parent)) {
+		return; // Already there, or it would introduce a loop
+	}
+	unlink_node(node);
+	append_child(parent, node);
+}
+
+static const char *next_id(const char *str, size_t *len) {
+	/*
+	 * Returns the next <message-id> in str, without the angle brackets.
+	 */
+	if (!str) return NULL;
+	const char *start = strchr(str, '<');
+	if (!start) return NULL;
+	const char *end = strchr(++start, '>');
+	if (!end) return NULL;
+	*len = end - start;
+	return start;
+}
+
+struct thread_index *create_thread_index(void) {
+	struct thread_index *index = calloc(1, sizeof(struct thread_index));
+	index->uids = create_uidset();
+	rehash(index);
+	return index;
+}
+
+static void free_children(struct thread_node *top) {
+	/*
+	 * Frees the deepest leaf under top until there's none left. Following the
+	 * parent links back up, rather than recursing, means a long References
+	 * chain can't run us out of stack.
+	 */
+	struct thread_node *node = top;
+	while (top->child) {
+		while (node->child) {
+			node = node->child;
+		}
+		struct thread_node *parent = node->parent;
+		parent->child = node->next;
+		free(node->message_id);
+		free(node);
+		node = parent;
+	}
+	top->last_child = NULL;
+}
+
+void thread_index_free(struct thread_index *index) {
+	if (!index) return;
+	/* Every node we create is somewhere under the root */
+	free_children(&index->root);
+	free(index->slots);
+	uidset_free(index->uids);
+	free(index);
+}
+
+void thread_index_add(struct thread_index *index, long uid,
+		const char *message_id, const char *references,
+		const char *in_reply_to) {
+	if (uidset_contains(index->uids, uid)) {
+		return;
+	}
+	uidset_add(index->uids, uid);
+
+	/*
+	 * Find the node for this message. It may already exist if another message
+	 * referred to it. If a different message already claimed this ID, or
+	 * there is no ID, the message gets a node of its own that can't be
+	 * referenced.
+	 */
+	struct thread_node *node = NULL;
+	size_t len;
+	const char *id = next_id(message_id, &len);
+	if (id) {
+		node = get_node(index, id, len);
+	}
+	if (!node || node->uid) {
+		node = calloc(1, sizeof(struct thread_node));
+	}
+	node->uid = uid;
+
+	/*
+	 * Link each message in References to the next one, unless the latter
+	 * already has a parent (earlier links win). In-Reply-To is used if there
+	 * are no References. Messages we haven't seen get empty nodes at the top
+	 * level, so that their replies can find each other.
+	 */
+	struct thread_node *parent = NULL;
+	const char *refs = references ? references : in_reply_to;
+	while ((id = next_id(refs, &len))) {
+		refs = id + len;
+		struct thread_node *ref = get_node(index, id, len);
+		if (ref == node) {
+			continue;
+		}
+		if (parent && (!ref->parent || ref->parent == &index->root)) {
+			set_parent(parent, ref);
+		}
+		if (!ref->parent) {
+			append_child(&index->root, ref);
+		}
+		parent = ref;
+	}
+
+	/*
+	 * The message's own last reference is authoritative for its parent.
+	 */
+	if (!parent || is_ancestor(node, parent)) {
+		parent = &index->root;
+	}
+	if (node->parent != parent) {
+		unlink_node(node);
+		append_child(parent, node);
+	}
+}
+
+static void flatten(struct thread_list *list, struct thread_node *top) {
+	/*
+	 * Walks the thread under top in order, following the links between nodes
+	 * instead of recursing, so that however deep it goes it takes no stack.
+	 * Messages we've never seen aren't displayed; their replies take their
+	 * place.
+	 */
+	int depth = 0;
+	struct thread_node *node = top;
+	while (node) {
+		if (node->uid) {
+			thread_list_append(list, node->uid, depth);
+		}
+		if (node->child) {
+			depth += node->uid ? 1 : 0;
+			node = node->child;
+			continue;
+		}
+		while (node != top && !node->next) {
+			node = node->parent;
+			depth -= node->uid ? 1 : 0;
+		}
+		node = node == top ? NULL : node->next;
+	}
+}
+
+struct thread_list *thread_index_flatten(struct thread_index *index) {
+	struct thread_list *list = create_thread_list();
+	for (struct thread_node *node = index->root.last_child;
+			node; node = node->prev) {
+		flatten(list, node);
+	}
+	return list;
+}
+
+struct thread_list *create_thread_list(void) {
+	struct thread_list *list = calloc(1, sizeof(struct thread_list));
+	list->uids = create_uidset();
+	list->capacity = 64;
+	list->depths = malloc(sizeof(int) * list->capacity);
+	return list;
+}
+
+void thread_list_append(struct thread_list *list, long uid, int depth) {
+	if (list->length == list->capacity) {
+		list->capacity *= 2;
+		list->depths = realloc(list->depths, sizeof(int) * list->capacity);
+	}
+	uidset_append(list->uids, uid);
+	list->depths[list->length++] = depth;
+}
+
+void thread_list_free(struct thread_list *list) {
+	if (!list) return;
+	uidset_free(list->uids);
+	free(list->depths);
+	free(list);
+}
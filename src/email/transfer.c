@@ -0,0 +1,443 @@
+/*
+ * email/transfer.c - streaming base64 and quoted-printable decoders
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "email/transfer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static enum transfer_impl best_impl = TRANSFER_SCALAR;
+// Sextet value of each base64 character, or -1
+static int8_t base64_values[256];
+
+static void transfer_init(void) {
+	static const char alphabet[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	memset(base64_values, -1, sizeof(base64_values));
+	for (int i = 0; i < 64; ++i) {
+		base64_values[(unsigned char)alphabet[i]] = i;
+	}
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		best_impl = TRANSFER_AVX2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		best_impl = TRANSFER_SSE;
+	}
+#endif
+}
+
+enum transfer_impl transfer_impl_best(void) {
+	pthread_once(&init_once, transfer_init);
+	return best_impl;
+}
+
+const char *transfer_impl_name(enum transfer_impl impl) {
+	switch (impl) {
+	case TRANSFER_SCALAR:
+		return "scalar";
+	case TRANSFER_SSE:
+		return "sse";
+	case TRANSFER_AVX2:
+		return "avx2";
+	}
+	return "unknown";
+}
+
+#ifdef HAVE_X86_SIMD
+/*
+ * The vector base64 decoder is Wojciech Muła's: the high and low nibble of
+ * each character index two tables whose AND is zero only for characters in
+ * the alphabet, and a third table (indexed by the high nibble, with '/' moved
+ * out of the way) gives the offset from ASCII to the sextet. Two multiplies
+ * pack four sextets into three bytes, and a shuffle puts the bytes in order.
+ *
+ * Each function decodes whole blocks until it meets one holding anything
+ * outside the alphabet. Mailers wrap base64 at 76 columns, which no block
+ * size divides, so when that is a line break after a whole number of quanta
+ * the rest of the line is decoded by one more block ending at the break and
+ * overlapping the last, and the line break is skipped. Anything else
+ * (usually the padding) is left for the scalar loop. The stores write a few
+ * bytes past the decoded data, so they stop while there is enough input left
+ * to keep those bytes within BASE64_DECODED_MAX.
+ */
+static size_t skip_line_break(const unsigned char *in, size_t len) {
+	if (len >= 2 && in[0] == '\r' && in[1] == '\n') {
+		return 2;
+	}
+	return len >= 1 && in[0] == '\n';
+}
+
+__attribute__((target("ssse3")))
+static unsigned int base64_block_sse(const unsigned char *in,
+		unsigned char *out) {
+	/*
+	 * Decodes 16 characters into 12 bytes and returns 0, or returns a mask
+	 * of the characters outside the alphabet and stores nothing.
+	 */
+	const __m128i lut_lo = _mm_setr_epi8(
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+			0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lut_hi = _mm_setr_epi8(
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+			0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i order = _mm_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m128i mask_2f = _mm_set1_epi8(0x2F);
+	__m128i str = _mm_loadu_si128((const __m128i *)in);
+	__m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+	__m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+	__m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+	__m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+	unsigned int invalid = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_and_si128(lo, hi), _mm_setzero_si128())) & 0xFFFF;
+	if (invalid) {
+		return invalid;
+	}
+	__m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+	__m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+	str = _mm_add_epi8(str, roll);
+	str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+	str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+	str = _mm_shuffle_epi8(str, order);
+	_mm_storeu_si128((__m128i *)out, str);
+	return 0;
+}
+
+__attribute__((target("ssse3")))
+static size_t base64_blocks_sse(const unsigned char *in, size_t len,
+		unsigned char *out, size_t *written) {
+	size_t i = 0, o = 0;
+	while (len - i >= 28) {
+		unsigned int invalid = base64_block_sse(in + i, out + o);
+		if (!invalid) {
+			i += 16;
+			o += 12;
+			continue;
+		}
+		size_t end = __builtin_ctz(invalid), skip;
+		if (end % 4 || i + end < 16
+				|| !(skip = skip_line_break(in + i + end, len - i - end))
+				|| base64_block_sse(in + i + end - 16,
+					out + o + end / 4 * 3 - 12)) {
+			break;
+		}
+		i += end + skip;
+		o += end / 4 * 3;
+	}
+	*written = o;
+	return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int base64_block_avx2(const unsigned char *in,
+		unsigned char *out) {
+	/* As base64_block_sse, with 32 characters into 24 bytes */
+	const __m256i lut_lo = _mm256_setr_epi8(
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+			0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+			0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lut_hi = _mm256_setr_epi8(
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+			0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+			0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i order = _mm256_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+	__m256i str = _mm256_loadu_si256((const __m256i *)in);
+	__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+	__m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+	__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+	__m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+	unsigned int invalid = ~(unsigned int)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi),
+				_mm256_setzero_si256()));
+	if (invalid) {
+		return invalid;
+	}
+	__m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+	__m256i roll = _mm256_shuffle_epi8(lut_roll,
+			_mm256_add_epi8(eq_2f, hi_nibbles));
+	str = _mm256_add_epi8(str, roll);
+	str = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+	str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00011000));
+	str = _mm256_shuffle_epi8(str, order);
+	str = _mm256_permutevar8x32_epi32(str, lanes);
+	_mm256_storeu_si256((__m256i *)out, str);
+	return 0;
+}
+
+__attribute__((target("avx2")))
+static size_t base64_blocks_avx2(const unsigned char *in, size_t len,
+		unsigned char *out, size_t *written) {
+	size_t i = 0, o = 0;
+	while (len - i >= 48) {
+		unsigned int invalid = base64_block_avx2(in + i, out + o);
+		if (!invalid) {
+			i += 32;
+			o += 24;
+			continue;
+		}
+		size_t end = __builtin_ctz(invalid), skip;
+		if (end % 4 || i + end < 32
+				|| !(skip = skip_line_break(in + i + end, len - i - end))
+				|| base64_block_avx2(in + i + end - 32,
+					out + o + end / 4 * 3 - 24)) {
+			break;
+		}
+		i += end + skip;
+		o += end / 4 * 3;
+	}
+	*written = o;
+	return i;
+}
+#endif
+
+void base64_decoder_init(struct base64_decoder *dec) {
+	dec->impl = transfer_impl_best();
+	dec->bits = 0;
+	dec->count = 0;
+}
+
+static size_t base64_flush(struct base64_decoder *dec, unsigned char *out) {
+	size_t o = 0;
+	if (dec->count == 2) {
+		out[o++] = dec->bits >> 4;
+	} else if (dec->count == 3) {
+		out[o++] = dec->bits >> 10;
+		out[o++] = dec->bits >> 2;
+	}
+	dec->bits = 0;
+	dec->count = 0;
+	return o;
+}
+
+size_t base64_decode(struct base64_decoder *dec,
+		const char *text, size_t len, unsigned char *out) {
+	const unsigned char *in = (const unsigned char *)text;
+	size_t i = 0, o = 0;
+	while (i < len) {
+#ifdef HAVE_X86_SIMD
+		if (dec->count == 0 && dec->impl != TRANSFER_SCALAR) {
+			size_t written;
+			if (dec->impl == TRANSFER_AVX2) {
+				i += base64_blocks_avx2(in + i, len - i, out + o, &written);
+				o += written;
+			}
+			i += base64_blocks_sse(in + i, len - i, out + o, &written);
+			o += written;
+			if (i == len) {
+				break;
+			}
+		}
+#endif
+		/*
+		 * Whatever stopped the vector loop (most likely a line break), get
+		 * past it and finish the quantum before giving it another go.
+		 */
+		bool skipped = false;
+		do {
+			/* Whole quanta at a time where we can */
+			while (dec->count == 0 && len - i >= 4) {
+				int8_t a = base64_values[in[i]], b = base64_values[in[i + 1]],
+					c = base64_values[in[i + 2]], d = base64_values[in[i + 3]];
+				if ((a | b | c | d) < 0) {
+					break;
+				}
+				uint32_t bits = (uint32_t)a << 18 | b << 12 | c << 6 | d;
+				out[o++] = bits >> 16;
+				out[o++] = bits >> 8;
+				out[o++] = bits;
+				i += 4;
+			}
+			if (i == len) {
+				break;
+			}
+			unsigned char c = in[i++];
+			int8_t value = base64_values[c];
+			if (value < 0) {
+				if (c == '=') {
+					o += base64_flush(dec, out + o);
+				}
+				skipped = true;
+				continue;
+			}
+			dec->bits = dec->bits << 6 | value;
+			if (++dec->count == 4) {
+				out[o++] = dec->bits >> 16;
+				out[o++] = dec->bits >> 8;
+				out[o++] = dec->bits;
+				dec->bits = 0;
+				dec->count = 0;
+			}
+		} while (i < len && (dec->count != 0 || !skipped));
+	}
+	return o;
+}
+
+size_t base64_decode_finish(struct base64_decoder *dec, unsigned char *out) {
+	return base64_flush(dec, out);
+}
+
+#ifdef HAVE_X86_SIMD
+/*
+ * Quoted-printable text is mostly literal, so the vector loops copy whole
+ * blocks until one holds an '=', and copy up to it. Line breaks are copied
+ * as they are.
+ */
+__attribute__((target("sse2")))
+static size_t qp_literal_sse(const char *in, size_t len, char *out) {
+	const __m128i equals = _mm_set1_epi8('=');
+	size_t i = 0;
+	while (len - i >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), block);
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, equals));
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+		i += 16;
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t qp_literal_avx2(const char *in, size_t len, char *out) {
+	const __m256i equals = _mm256_set1_epi8('=');
+	size_t i = 0;
+	while (len - i >= 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i *)(in + i));
+		_mm256_storeu_si256((__m256i *)(out + i), block);
+		unsigned int mask = _mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(block, equals));
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+		i += 32;
+	}
+	return i;
+}
+#endif
+
+static int hex_value(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+static size_t qp_escape(const char *p, size_t avail, char *out, size_t *written) {
+	/*
+	 * p points at an '='. Returns the number of bytes consumed, or 0 if
+	 * there isn't enough input to tell what the escape is.
+	 */
+	*written = 0;
+	if (avail < 2) {
+		return 0;
+	}
+	if (p[1] == '\n') {
+		return 2;
+	}
+	if (p[1] == '\r' || hex_value(p[1]) >= 0) {
+		if (avail < 3) {
+			return 0;
+		}
+		if (p[1] == '\r' && p[2] == '\n') {
+			return 3;
+		}
+		int hi = hex_value(p[1]), lo = hex_value(p[2]);
+		if (hi >= 0 && lo >= 0) {
+			*out = (char)(hi << 4 | lo);
+			*written = 1;
+			return 3;
+		}
+	}
+	*out = '=';
+	*written = 1;
+	return 1;
+}
+
+void qp_decoder_init(struct qp_decoder *dec) {
+	dec->impl = transfer_impl_best();
+	dec->pending_length = 0;
+}
+
+size_t qp_decode(struct qp_decoder *dec,
+		const char *in, size_t len, char *out) {
+	size_t i = 0, o = 0, written;
+	if (dec->pending_length) {
+		char buf[3];
+		size_t n = dec->pending_length;
+		memcpy(buf, dec->pending, n);
+		while (n < 3 && i < len) {
+			buf[n++] = in[i++];
+		}
+		size_t used = qp_escape(buf, n, out, &written);
+		if (!used) {
+			memcpy(dec->pending, buf, n);
+			dec->pending_length = n;
+			return 0;
+		}
+		o += written;
+		if (used >= (size_t)dec->pending_length) {
+			i = used - dec->pending_length;
+		} else {
+			/* A lone '=' followed by plain characters we held on to */
+			memcpy(out + o, buf + used, dec->pending_length - used);
+			o += dec->pending_length - used;
+			i = 0;
+		}
+		dec->pending_length = 0;
+	}
+	while (i < len) {
+#ifdef HAVE_X86_SIMD
+		size_t n = 0;
+		if (dec->impl == TRANSFER_AVX2) {
+			n = qp_literal_avx2(in + i, len - i, out + o);
+		} else if (dec->impl == TRANSFER_SSE) {
+			n = qp_literal_sse(in + i, len - i, out + o);
+		}
+		i += n;
+		o += n;
+#endif
+		for (; i < len && in[i] != '='; ++i) {
+			out[o++] = in[i];
+		}
+		if (i == len) {
+			break;
+		}
+		size_t used = qp_escape(in + i, len - i, out + o, &written);
+		if (!used) {
+			dec->pending_length = len - i;
+			memcpy(dec->pending, in + i, dec->pending_length);
+			break;
+		}
+		i += used;
+		o += written;
+	}
+	return o;
+}
+
+size_t qp_decode_finish(struct qp_decoder *dec, char *out) {
+	size_t n = dec->pending_length;
+	memcpy(out, dec->pending, n);
+	dec->pending_length = 0;
+	return n;
+}
@@ -9,10 +9,12 @@
 #include <time.h>
 
 #include "config.h"
+#include "email/thread.h"
 #include "log.h"
 #include "state.h"
 #include "ui.h"
 #include "util/list.h"
+#include "util/uidset.h"
 #include "worker.h"
 
 void handle_worker_connect_done(struct account_state *account,
@@ -26,9 +28,31 @@ void handle_worker_connect_error(struct account_state *account,
 	set_status(account, ACCOUNT_ERROR, (char *)message->data);
 }
 
+static void list_children_done(struct account_state *account,
+		struct mailbox_list *result) {
+	/* Children go in under their parent, which we now know all about */
+	for (size_t i = 0; i < result->mailboxes->length; ++i) {
+		put_aerc_mailbox(account, result->mailboxes->items[i]);
+	}
+	struct aerc_mailbox *parent = get_aerc_mailbox(account, result->parent);
+	if (parent) {
+		parent->has_children = result->mailboxes->length != 0;
+	}
+	list_free(result->mailboxes);
+	free(result->parent);
+	free(result);
+	damage(DAMAGE_FOLDERS);
+}
+
 void handle_worker_list_done(struct account_state *account,
 		struct worker_message *message) {
-	account->mailboxes = message->data;
+	struct mailbox_list *result = message->data;
+	if (result->parent) {
+		list_children_done(account, result);
+		return;
+	}
+	set_aerc_mailboxes(account, result->mailboxes);
+	free(result);
 	char *wanted = "INBOX";
 	struct account_config *c = config_for_account(account->name);
 	for (size_t i = 0; i < c->extras->length; ++i) {
@@ -38,14 +62,8 @@ void handle_worker_list_done(struct account_state *account,
 			break;
 		}
 	}
-	bool have_wanted = false;
-	for (size_t i = 0; i < account->mailboxes->length; ++i) {
-		struct aerc_mailbox *mbox = account->mailboxes->items[i];
-		if (strcmp(mbox->name, wanted) == 0) {
-			have_wanted = true;
-		}
-	}
-	if (have_wanted) {
+	if (get_aerc_mailbox(account, wanted)) {
+		reset_message_view(account);
 		free(account->selected);
 		account->selected = strdup(wanted);
 		worker_post_action(account->worker.pipe, WORKER_SELECT_MAILBOX,
@@ -56,7 +74,19 @@ void handle_worker_list_done(struct account_state *account,
 
 void handle_worker_list_error(struct account_state *account,
 		struct worker_message *message) {
-	set_status(account, ACCOUNT_ERROR, "Unable to list folders!");
+	char *parent = message->data;
+	if (!parent) {
+		set_status(account, ACCOUNT_ERROR, "Unable to list folders!");
+		return;
+	}
+	/* Collapse it again, so expanding it tries once more */
+	struct aerc_mailbox *mbox = get_aerc_mailbox(account, parent);
+	if (mbox) {
+		mbox->expanded = mbox->children_listed = false;
+		invalidate_folder_rows(account);
+	}
+	free(parent);
+	set_status(account, ACCOUNT_ERROR, "Unable to list child folders");
 }
 
 void handle_worker_connect_cert_check(struct account_state *account,
@@ -68,63 +98,105 @@ void handle_worker_connect_cert_check(struct account_state *account,
 #endif
 }
 
-static void fetch_necessary(struct account_state *account,
+static void post_fetch(struct account_state *account, int min, int max) {
+	struct message_range *range = malloc(sizeof(struct message_range));
+	range->min = min;
+	range->max = max;
+	worker_log(L_DEBUG, "Fetching message range %d - %d", range->min, range->max);
+	worker_post_action(account->worker.pipe, WORKER_FETCH_MESSAGES,
+			NULL, range);
+}
+
+static void fetch_missing_uids(struct account_state *account,
 		struct aerc_mailbox *mbox) {
-	int min = -1, max = -1;
-	size_t i;
-	for (i = 0; i < mbox->messages->length; ++i) {
-		struct aerc_message *message = mbox->messages->items[i];
-		if (min == -1) {
-			if (message->should_fetch && !message->fetching) {
-				message->fetching = true;
-				min = i;
+	/*
+	 * Sorted rows are asked for by UID, since the messages may be further
+	 * down the mailbox than we've loaded, or not known here at all yet.
+	 */
+	uidset_t *missing = account->ui.missing_uids;
+	if (!missing || !missing->length) {
+		return;
+	}
+	if (!account->ui.requested_uids) {
+		account->ui.requested_uids = create_uidset();
+	}
+	uidset_t *wanted = create_uidset();
+	for (size_t i = 0; i < missing->length; ++i) {
+		for (long uid = missing->ranges[i].min;
+				uid <= missing->ranges[i].max; ++uid) {
+			struct aerc_message *message = get_aerc_message_by_uid(mbox, uid);
+			if (message ? message->fetched || message->fetching
+					: uidset_contains(account->ui.requested_uids, uid)) {
+				continue;
 			}
-		} else {
-			if (!message->should_fetch) {
-				max = i - 1;
-				struct message_range *range = malloc(
-						sizeof(struct message_range));
-				range->min = min + 1;
-				range->max = max + 1;
-				worker_log(L_DEBUG, "Fetching message range %d - %d",
-						range->min, range->max);
-				worker_post_action(account->worker.pipe, WORKER_FETCH_MESSAGES,
-						NULL, range);
-				min = max = -1;
+			if (message) {
+				message->fetching = true;
+			} else {
+				uidset_add(account->ui.requested_uids, uid);
 			}
+			uidset_add(wanted, uid);
 		}
 	}
-	if (min != -1) {
-		max = i - 1;
-		struct message_range *range = malloc(sizeof(struct message_range));
-		range->min = min + 1;
-		range->max = max + 1;
-		worker_log(L_DEBUG, "Fetching message range %d - %d", range->min, range->max);
-		worker_post_action(account->worker.pipe, WORKER_FETCH_MESSAGES,
-				NULL, range);
+	missing->length = 0;
+	if (!wanted->length) {
+		uidset_free(wanted);
+		return;
+	}
+	worker_post_action(account->worker.pipe, WORKER_FETCH_UIDS, NULL, wanted);
+}
+
+void fetch_necessary(struct account_state *account,
+		struct aerc_mailbox *mbox) {
+	/*
+	 * Asks the worker for the messages that rendering found missing, in
+	 * contiguous ranges. This runs after every frame that draws the message
+	 * list, so messages already on their way are skipped. Only the rows that
+	 * were drawn are looked at, never the whole mailbox.
+	 */
+	fetch_missing_uids(account, mbox);
+	uidset_t *missing = account->ui.missing;
+	if (!missing) {
+		return;
+	}
+	for (size_t i = 0; i < missing->length; ++i) {
+		long min = 0;
+		for (long seq = missing->ranges[i].min;
+				seq <= missing->ranges[i].max; ++seq) {
+			struct aerc_message *message = seqmap_get(mbox->messages, seq);
+			if (message && !message->fetched && !message->fetching) {
+				message->fetching = true;
+				if (!min) {
+					min = seq;
+				}
+			} else if (min) {
+				post_fetch(account, min, seq - 1);
+				min = 0;
+			}
+		}
+		if (min) {
+			post_fetch(account, min, missing->ranges[i].max);
+		}
 	}
+	missing->length = 0;
 }
 
 void handle_worker_mailbox_updated(struct account_state *account,
 		struct worker_message *message) {
 	struct aerc_mailbox *new = message->data;
-	struct aerc_mailbox *old = NULL;
-
-	bool rerendered = false;
-	for (size_t i = 0; i < account->mailboxes->length; ++i) {
-		old = account->mailboxes->items[i];
-		if (strcmp(old->name, new->name) == 0) {
-			account->mailboxes->items[i] = new;
-			rerender();
-			rerendered = true;
-			break;
-		}
+
+	size_t cursor = 0;
+	void *msg;
+	while (seqmap_iter(new->messages, &cursor, &msg)) {
+		update_message_columns(new, msg);
 	}
 
-	if (rerendered && new->selected) {
-		fetch_necessary(account, new);
+	if (!account->mailboxes) {
+		/* There's no folder list to put it in yet */
+		free_aerc_mailbox(new);
+		return;
 	}
-	free_aerc_mailbox(old);
+	put_aerc_mailbox(account, new);
+	damage(DAMAGE_FOLDERS | DAMAGE_MESSAGES);
 }
 
 void handle_worker_message_updated(struct account_state *account,
@@ -132,27 +204,166 @@ void handle_worker_message_updated(struct account_state *account,
 	worker_log(L_DEBUG, "Updated message on main thread");
 	struct aerc_message *new = message->data;
 	struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
-	for (size_t i = 0; i < mbox->messages->length; ++i) {
-		struct aerc_message *old = mbox->messages->items[i];
-		if (old->index == new->index) {
-			free_aerc_message(mbox->messages->items[i]);
-			new->fetched = true;
-			new->should_fetch = false;
-			mbox->messages->items[i] = new;
-			rerender_item(i);
+	/*
+	 * Messages we've seen before are found by UID. Otherwise this is the first
+	 * fetch of a placeholder, which is where the worker says it is.
+	 */
+	size_t seq = new->uid ? seqmap_seq(mbox->messages, new->uid) : 0;
+	if (!seq) {
+		seq = new->index + 1;
+		if (seq > mbox->messages->count) {
+			free_aerc_message(new);
+			return;
 		}
+		seqmap_set_uid(mbox->messages, seq, new->uid);
 	}
+	free_aerc_message(seqmap_get(mbox->messages, seq));
+	new->fetched = true;
+	seqmap_set(mbox->messages, seq, new);
+	update_message_columns(mbox, new);
+	damage_message(seq - 1);
 }
 
-void handle_worker_mailbox_deleted(struct account_state *account,
+static void remove_sorted(struct account_state *account, uidset_t *uids) {
+	/*
+	 * Takes expunged messages out of the sort order, keeping the thread depths
+	 * of the rest lined up.
+	 */
+	uidset_t *sort = create_uidset();
+	int *depths = account->ui.depths;
+	size_t kept = 0;
+	for (size_t n = 0; n < account->ui.row_count; ++n) {
+		long uid = account->ui.rows[n];
+		if (uidset_contains(uids, uid)) {
+			continue;
+		}
+		uidset_append(sort, uid);
+		if (depths) {
+			depths[kept] = depths[n];
+		}
+		++kept;
+	}
+	uidset_free(account->ui.sort);
+	account->ui.sort = sort;
+	index_sort_rows(account);
+}
+
+void handle_worker_messages_expunged(struct account_state *account,
 		struct worker_message *message) {
-	worker_log(L_DEBUG, "Deleting mailbox on main thread");
-	struct aerc_mailbox *mbox = get_aerc_mailbox(account, (const char *)message->data);
-	for (size_t i = 0; i < account->mailboxes->length; ++i) {
-		if (account->mailboxes->items[i] == mbox) {
-			list_del(account->mailboxes, i);
+	uidset_t *seqs = message->data;
+	struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
+	if (!mbox || !mbox->messages) {
+		uidset_free(seqs);
+		return;
+	}
+	/*
+	 * Removing from the highest sequence number down means none of the
+	 * removals renumber the ones still to come.
+	 */
+	uidset_t *uids = create_uidset();
+	for (size_t i = seqs->length; i > 0; --i) {
+		struct uid_range *range = &seqs->ranges[i - 1];
+		for (long seq = range->max; seq >= range->min; --seq) {
+			struct aerc_message *msg = seqmap_remove(mbox->messages, seq);
+			if (msg && msg->uid) {
+				uidset_add(uids, msg->uid);
+				if (mbox->columns) {
+					message_columns_remove(mbox->columns, msg->uid);
+				}
+			}
+			free_aerc_message(msg);
+		}
+	}
+	mbox->exists = mbox->messages->count;
+	if (account->ui.sort && uids->length) {
+		remove_sorted(account, uids);
+	}
+	size_t rows = account->ui.sort ?
+		account->ui.row_count : mbox->messages->count;
+	if (account->ui.selected_message >= rows) {
+		account->ui.selected_message = rows ? rows - 1 : 0;
+	}
+	if (account->ui.list_offset > account->ui.selected_message) {
+		account->ui.list_offset = account->ui.selected_message;
+	}
+	uidset_free(uids);
+	uidset_free(seqs);
+	rerender();
+}
+
+void handle_worker_store_flags_done(struct account_state *account,
+		struct worker_message *message) {
+	free_flag_request(message->data);
+}
+
+void handle_worker_store_flags_error(struct account_state *account,
+		struct worker_message *message) {
+	/*
+	 * We changed the flags before the server agreed to it, so put them back,
+	 * but only where it refused: the worker keeps the rest.
+	 */
+	struct flag_request *request = message->data;
+	struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
+	uidset_t *refused = create_uidset();
+	for (size_t i = 0; request->failed && i < request->changed->length; ++i) {
+		struct uid_range *range = &request->changed->ranges[i];
+		for (long uid = range->min; uid <= range->max; ++uid) {
+			if (uidset_contains(request->failed, uid)) {
+				uidset_add(refused, uid);
+			}
 		}
 	}
-	free_aerc_mailbox(mbox);
+	uidset_free(set_message_flags(mbox, refused, request->flags,
+				!request->add));
+	uidset_free(refused);
+	free_flag_request(request);
+	set_status(account, ACCOUNT_ERROR, "Unable to change message flags");
+	rerender();
+}
+
+void handle_worker_mailbox_deleted(struct account_state *account,
+		struct worker_message *message) {
+	worker_log(L_DEBUG, "Deleting mailbox on main thread");
+	remove_aerc_mailbox(account, (const char *)message->data);
+	damage(DAMAGE_FOLDERS | DAMAGE_MESSAGES);
+}
+
+void handle_worker_search_done(struct account_state *account,
+		struct worker_message *message) {
+	uidset_free(account->ui.search);
+	account->ui.search = message->data;
+	char status[64];
+	snprintf(status, sizeof(status), "%ld messages match",
+			uidset_count(account->ui.search));
+	set_status(account, ACCOUNT_OKAY, status);
+}
+
+void handle_worker_search_error(struct account_state *account,
+		struct worker_message *message) {
+	set_status(account, ACCOUNT_ERROR, "Search failed");
+}
+
+void handle_worker_sort_done(struct account_state *account,
+		struct worker_message *message) {
+	set_sort(account, message->data, NULL);
 	rerender();
 }
+
+void handle_worker_thread_done(struct account_state *account,
+		struct worker_message *message) {
+	struct thread_list *threads = message->data;
+	set_sort(account, threads->uids, threads->depths);
+	free(threads);
+	rerender();
+}
+
+void handle_worker_thread_error(struct account_state *account,
+		struct worker_message *message) {
+	set_status(account, ACCOUNT_ERROR, "Threading failed");
+}
+
+void handle_worker_sort_error(struct account_state *account,
+		struct worker_message *message) {
+	set_status(account, ACCOUNT_ERROR, "Sort failed. "
+			"Does your server support the SORT extension?");
+}
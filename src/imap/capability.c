@@ -31,7 +31,11 @@ void handle_imap_capability(struct imap_connection *imap, const char *token,
 		{ "AUTH=PLAIN", &cap->auth_plain },
 		{ "AUTH=LOGIN", &cap->auth_login },
 		{ "IDLE", &cap->idle },
-		{ "SASL-IR", &cap->sasl_ir }
+		{ "SASL-IR", &cap->sasl_ir },
+		{ "ESEARCH", &cap->esearch }, // RFC 4731
+		{ "SORT", &cap->sort }, // RFC 5256
+		{ "ESORT", &cap->esort }, // RFC 5267
+		{ "THREAD=REFERENCES", &cap->thread_references } // RFC 5256
 	};
 
 	while (args) {
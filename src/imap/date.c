@@ -1,5 +1,7 @@
 #define _XOPEN_SOURCE
+#define _DEFAULT_SOURCE
 
+#include <stdint.h>
 #include <time.h>
 
 char *parse_imap_date(const char *str, struct tm *time) {
@@ -9,3 +11,9 @@ char *parse_imap_date(const char *str, struct tm *time) {
 	 */
 	return strptime(str, "%d-%b-%Y %H:%M:%S %z", time);
 }
+
+int64_t imap_date_epoch(const struct tm *time) {
+	/* strptime leaves the zone offset in tm_gmtoff */
+	struct tm utc = *time;
+	return (int64_t)timegm(&utc) - time->tm_gmtoff;
+}
@@ -0,0 +1,77 @@
+/*
+ * imap/expunge.c - handles IMAP EXPUNGE and VANISHED responses
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include "imap/imap.h"
+#include "internal/imap.h"
+#include "log.h"
+#include "util/seqmap.h"
+#include "util/uidset.h"
+
+static void expunge(struct imap_connection *imap, struct mailbox *mbox,
+		size_t seq) {
+	struct mailbox_message *msg = seqmap_remove(mbox->messages, seq);
+	if (!msg) {
+		worker_log(L_ERROR, "Got EXPUNGE for unknown message %zd", seq);
+		return;
+	}
+	mbox->exists--;
+	if (imap->events.message_expunged) {
+		imap->events.message_expunged(imap, seq, msg->uid);
+	}
+	mailbox_message_free(msg);
+}
+
+void handle_imap_expunge(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args) {
+	/*
+	 * * 5 EXPUNGE
+	 *
+	 * Every message after the expunged one moves up by one, which the sequence
+	 * map takes care of in O(log n).
+	 */
+	struct mailbox *mbox = get_mailbox(imap, imap->selected);
+	if (!mbox || !args || args->type != IMAP_NUMBER) {
+		return;
+	}
+	expunge(imap, mbox, args->num);
+}
+
+void handle_imap_vanished(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args) {
+	/*
+	 * With QRESYNC (RFC 7162), servers report expunged messages by UID:
+	 *
+	 * * VANISHED 405,407,410:420
+	 * * VANISHED (EARLIER) 300:310
+	 *
+	 * We can only remove messages we know the UID of. Others are left for the
+	 * next EXISTS to sort out.
+	 */
+	struct mailbox *mbox = get_mailbox(imap, imap->selected);
+	if (!mbox || !args) {
+		return;
+	}
+	if (args->type == IMAP_LIST) {
+		args = args->next; // (EARLIER)
+	}
+	uidset_t *uids = create_uidset();
+	if (args && args->type == IMAP_NUMBER) {
+		uidset_add(uids, args->num);
+	} else if (args && args->type == IMAP_ATOM
+			&& !uidset_parse(uids, args->str, false)) {
+		worker_log(L_ERROR, "Invalid sequence set in VANISHED: %s", args->str);
+	}
+	for (size_t i = 0; i < uids->length; ++i) {
+		for (long uid = uids->ranges[i].min; uid <= uids->ranges[i].max; ++uid) {
+			size_t seq = seqmap_seq(mbox->messages, uid);
+			if (seq) {
+				expunge(imap, mbox, seq);
+			}
+		}
+	}
+	uidset_free(uids);
+}
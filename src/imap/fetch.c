@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <time.h>
 
+#include "email/flags.h"
 #include "email/headers.h"
 #include "imap/date.h"
 #include "imap/imap.h"
@@ -17,6 +18,7 @@
 #include "log.h"
 #include "util/list.h"
 #include "util/stringop.h"
+#include "util/uidset.h"
 
 void imap_fetch(struct imap_connection *imap, imap_callback_t callback,
 		void *data, size_t min, size_t max, const char *what) {
@@ -27,9 +29,9 @@ void imap_fetch(struct imap_connection *imap, imap_callback_t callback,
 
 	struct mailbox *mbox = get_mailbox(imap, imap->selected);
 	assert(min >= 1);
-	assert(max <= mbox->messages->length);
+	assert(max <= mbox->messages->count);
 	for (size_t i = min; i < max; ++i) {
-		struct mailbox_message *msg = mbox->messages->items[i - 1];
+		struct mailbox_message *msg = seqmap_get(mbox->messages, i);
 		if (msg->fetching) {
 			seperate = true;
 			msg->fetching = true;
@@ -45,42 +47,62 @@ void imap_fetch(struct imap_connection *imap, imap_callback_t callback,
 	}
 }
 
-static int handle_flags(struct mailbox_message *msg, imap_arg_t *args) {
-	args = args->list;
-	free_flat_list(msg->flags);
-	msg->flags = create_list();
-	while (args) {
+void imap_uid_fetch(struct imap_connection *imap, imap_callback_t callback,
+		void *data, const uidset_t *uids, const char *what) {
+	char *set = uidset_serialize(uids);
+	imap_send(imap, callback, data, "UID FETCH %s (%s)", set, what);
+	free(set);
+}
+
+static int handle_flags(struct imap_connection *imap,
+		struct mailbox_message *msg, imap_arg_t *args) {
+	/* FETCH FLAGS always has the complete set of flags */
+	flagset_t flags = 0;
+	for (args = args->list; args; args = args->next) {
 		assert(args->type == IMAP_ATOM);
-		list_add(msg->flags, strdup(args->str));
-		worker_log(L_DEBUG, "Set flag for message: %s", args->str);
-		args = args->next;
+		flagset_t flag = flag_intern(imap->flags, args->str);
+		if (!flag) {
+			worker_log(L_DEBUG, "Too many keywords, ignoring %s", args->str);
+		}
+		flags |= flag;
 	}
+	msg->flags = flags;
 	return 0;
 }
 
-static int handle_uid(struct mailbox_message *msg, imap_arg_t *args) {
+static int handle_uid(struct imap_connection *imap,
+		struct mailbox_message *msg, imap_arg_t *args) {
 	assert(args->type == IMAP_NUMBER);
 	worker_log(L_DEBUG, "Message UID: %ld", args->num);
 	msg->uid = args->num;
 	return 0;
 }
 
-static int handle_internaldate(struct mailbox_message *msg, imap_arg_t *args) {
+static int handle_rfc822_size(struct imap_connection *imap,
+		struct mailbox_message *msg, imap_arg_t *args) {
+	assert(args->type == IMAP_NUMBER);
+	msg->size = args->num;
+	return 0;
+}
+
+static int handle_internaldate(struct imap_connection *imap,
+		struct mailbox_message *msg, imap_arg_t *args) {
 	assert(args->type == IMAP_STRING);
-	msg->internal_date = malloc(sizeof(struct tm));
-	char *r = parse_imap_date(args->str, msg->internal_date);
+	struct tm date;
+	char *r = parse_imap_date(args->str, &date);
 	if (!r || *r) {
 		worker_log(L_DEBUG, "Warning: received invalid date for message (%s)",
 				args->str);
 	} else {
-		char date[64];
-		strftime(date, sizeof(date), "%F %H:%M %z", msg->internal_date);
-		worker_log(L_DEBUG, "Message internal date: %s", date);
+		msg->internal_date = imap_date_epoch(&date);
+		worker_log(L_DEBUG, "Message internal date: %lld",
+				(long long)msg->internal_date);
 	}
 	return 0;
 }
 
-static int handle_body(struct mailbox_message *msg, imap_arg_t *args) {
+static int handle_body(struct imap_connection *imap,
+		struct mailbox_message *msg, imap_arg_t *args) {
 	assert(args->type == IMAP_RESPONSE);
 	worker_log(L_DEBUG, "Handling message body fields");
 	/*
@@ -89,8 +111,9 @@ static int handle_body(struct mailbox_message *msg, imap_arg_t *args) {
 	 */
 	args = args->next;
 	assert(args && args->type == IMAP_STRING);
-	list_t *headers = create_list();
+	struct email_headers *headers = create_email_headers();
 	parse_headers(args->str, headers);
+	decode_headers(headers);
 	free_headers(msg->headers);
 	msg->headers = headers;
 	return 1; // We used one extra argument
@@ -101,7 +124,12 @@ void handle_imap_fetch(struct imap_connection *imap, const char *token,
 	assert(args->type == IMAP_NUMBER);
 	struct mailbox *mbox = get_mailbox(imap, imap->selected);
 	int index = args->num - 1;
-	struct mailbox_message *msg = mbox->messages->items[index];
+	struct mailbox_message *msg = seqmap_get(mbox->messages, args->num);
+	if (!msg) {
+		worker_log(L_ERROR, "Received FETCH for unknown message %ld",
+				args->num);
+		return;
+	}
 	worker_log(L_DEBUG, "Received FETCH for message %d", index + 1);
 	args = args->next;
 	assert(args->type == IMAP_LIST);
@@ -111,11 +139,13 @@ void handle_imap_fetch(struct imap_connection *imap, const char *token,
 	const struct {
 		const char *name;
 		enum imap_type expected_type;
-		int (*handler)(struct mailbox_message *, imap_arg_t *);
+		int (*handler)(struct imap_connection *,
+				struct mailbox_message *, imap_arg_t *);
 	} handlers[] = {
 		{ "UID", IMAP_NUMBER, handle_uid },
 		{ "FLAGS", IMAP_LIST, handle_flags },
 		{ "INTERNALDATE", IMAP_STRING, handle_internaldate },
+		{ "RFC822.SIZE", IMAP_NUMBER, handle_rfc822_size },
 		{ "BODY", IMAP_RESPONSE, handle_body }
 		// TODO: More fields, I guess
 	};
@@ -126,12 +156,10 @@ void handle_imap_fetch(struct imap_connection *imap, const char *token,
 		if (!args) {
 			break;
 		}
-		for (size_t i = 0;
-				i < sizeof(handlers) / (sizeof(void *) * 2 + sizeof(enum imap_type));
-				++i) {
+		for (size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); ++i) {
 			if (strcmp(handlers[i].name, name) == 0) {
 				assert(args->type == handlers[i].expected_type);
-				int j = handlers[i].handler(msg, args);
+				int j = handlers[i].handler(imap, msg, args);
 				while (j-- && args) args = args->next;
 			}
 		}
@@ -139,6 +167,9 @@ void handle_imap_fetch(struct imap_connection *imap, const char *token,
 			args = args->next;
 		}
 	}
+	if (msg->uid) {
+		seqmap_set_uid(mbox->messages, index + 1, msg->uid);
+	}
 	msg->index = index;
 	msg->fetching = false;
 	msg->populated = true;
@@ -239,6 +239,8 @@ void imap_init(struct imap_connection *imap) {
 	imap->next_tag = 1;
 	imap->pending = create_hashtable(128, hash_string);
 	imap->mailboxes = create_list();
+	imap->searches = create_list();
+	imap->threads = create_list();
 	if (internal_handlers == NULL) {
 		/*
 		 * Internal IMAP handlers are stored in a hashtable keyed on the IMAP
@@ -259,15 +261,23 @@ void imap_init(struct imap_connection *imap) {
 		hashtable_set(internal_handlers, "RECENT", handle_imap_existsunseenrecent);
 		hashtable_set(internal_handlers, "UIDNEXT", handle_imap_uidnext);
 		hashtable_set(internal_handlers, "READ-WRITE", handle_imap_readwrite);
-		hashtable_set(internal_handlers, "UIDVALIDITY", handle_noop);
+		hashtable_set(internal_handlers, "UIDVALIDITY", handle_imap_uidvalidity);
 		hashtable_set(internal_handlers, "HIGHESTMODSET", handle_noop); // RFC 4551
 		hashtable_set(internal_handlers, "FETCH", handle_imap_fetch);
+		hashtable_set(internal_handlers, "SEARCH", handle_imap_search);
+		hashtable_set(internal_handlers, "SORT", handle_imap_search);
+		hashtable_set(internal_handlers, "ESEARCH", handle_imap_esearch);
+		hashtable_set(internal_handlers, "THREAD", handle_imap_thread);
+		hashtable_set(internal_handlers, "EXPUNGE", handle_imap_expunge);
+		hashtable_set(internal_handlers, "VANISHED", handle_imap_vanished);
 	}
 }
 
 void imap_close(struct imap_connection *imap) {
 	absocket_free(imap->socket);
 	free(imap->line);
+	list_free(imap->searches);
+	list_free(imap->threads);
 	free(imap);
 }
 
@@ -18,12 +18,16 @@ void imap_list(struct imap_connection *imap, imap_callback_t callback,
 void handle_imap_list(struct imap_connection *imap, const char *token,
 		const char *cmd, imap_arg_t *args) {
 	imap_arg_t *flags = args->list;
-	//const char *delim = args->next->str;
+	const imap_arg_t *delim = args->next;
 	const char *name = args->next->next->str;
 
 	struct mailbox *mbox = get_or_make_mailbox(imap, name);
+	/* NIL comes through as an atom */
+	mbox->delimiter = delim->type == IMAP_STRING ? delim->str[0] : '\0';
 	while (flags) {
-		if (flags->type == IMAP_ATOM) {
+		/* The same folder may be listed again */
+		if (flags->type == IMAP_ATOM
+				&& !mailbox_get_flag(imap, name, flags->str)) {
 			struct mailbox_flag *flag = calloc(1, sizeof(struct mailbox_flag));
 			flag->name = strdup(flags->str);
 			list_add(mbox->flags, flag);
@@ -79,7 +79,7 @@ static char *parse_atom(const char **str) {
 	 * string.
 	 */
 	char *end = NULL;
-	char *delims = " )[\r";
+	const char delims[] = " )[\r";
 	for (size_t i = 0; i < sizeof(delims) - 1; ++i) {
 		char *_ = strchr(*str, delims[i]);
 		if (_ && (!end || _ < end)) end = _;
@@ -125,7 +125,15 @@ static int _imap_parse_args(const char **str, imap_arg_t *args) {
 	while (**str
 			&& **str != ')' /* ) for recursive list parsing */
 			&& **str != '\r' /* end of args */) {
-		if (isdigit(**str)) {
+		size_t digits = strspn(*str, "0123456789");
+		if (digits && ((*str)[digits] == ':' || (*str)[digits] == ',')) {
+			/*
+			 * Sequence sets (e.g. 1:5,7) start with a digit, but they aren't
+			 * numbers. We treat them as atoms so they stay in one piece.
+			 */
+			args->type = IMAP_ATOM;
+			args->str = parse_atom(str);
+		} else if (isdigit(**str)) {
 			args->type = IMAP_NUMBER;
 			args->num = parse_number(str);
 		} else if (**str == '"' || **str == '{') {
@@ -0,0 +1,179 @@
+/*
+ * imap/search.c - issues IMAP SEARCH and SORT commands and handles their
+ * responses, including the extended forms from RFC 4731 and RFC 5267
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "imap/imap.h"
+#include "internal/imap.h"
+#include "log.h"
+#include "util/list.h"
+#include "util/uidset.h"
+
+struct search_data {
+	void *data;
+	imap_search_callback_t callback;
+	char tag[16];
+	bool sorted;
+	uidset_t *uids;
+};
+
+static struct search_data *make_search(struct imap_connection *imap,
+		imap_search_callback_t callback, void *data, bool sorted) {
+	/*
+	 * We remember the tag the command is about to be sent with, so that we can
+	 * match up ESEARCH responses (which name the tag they belong to).
+	 * Untagged SEARCH and SORT responses are attributed to the oldest search
+	 * in flight.
+	 */
+	struct search_data *search = calloc(1, sizeof(struct search_data));
+	search->data = data;
+	search->callback = callback;
+	search->sorted = sorted;
+	search->uids = create_uidset();
+	snprintf(search->tag, sizeof(search->tag), "a%04d", imap->next_tag);
+	list_add(imap->searches, search);
+	return search;
+}
+
+static void imap_search_callback(struct imap_connection *imap,
+		void *data, enum imap_status status, const char *args) {
+	struct search_data *search = data;
+	for (size_t i = 0; i < imap->searches->length; ++i) {
+		if (imap->searches->items[i] == search) {
+			list_del(imap->searches, i);
+			break;
+		}
+	}
+	if (status != STATUS_OK) {
+		worker_log(L_DEBUG, "Search failed: %s", args);
+		uidset_free(search->uids);
+		search->uids = NULL;
+	}
+	if (search->callback) {
+		search->callback(imap, search->data, status, search->uids);
+	} else {
+		uidset_free(search->uids);
+	}
+	free(search);
+}
+
+void imap_search(struct imap_connection *imap, imap_search_callback_t callback,
+		void *data, const char *criteria) {
+	/*
+	 * With ESEARCH the server sends the results back as a compact sequence-set
+	 * instead of one number per match, which matters for large mailboxes.
+	 */
+	struct search_data *search = make_search(imap, callback, data, false);
+	if (imap->cap && imap->cap->esearch) {
+		imap_send(imap, imap_search_callback, search,
+				"UID SEARCH RETURN (ALL) %s", criteria);
+	} else {
+		imap_send(imap, imap_search_callback, search, "UID SEARCH %s",
+				criteria);
+	}
+}
+
+void imap_sort(struct imap_connection *imap, imap_search_callback_t callback,
+		void *data, const char *order, const char *criteria) {
+	if (!imap->cap || !imap->cap->sort) {
+		if (callback) {
+			callback(imap, data, STATUS_PRE_ERROR, NULL);
+		}
+		return;
+	}
+	struct search_data *search = make_search(imap, callback, data, true);
+	if (imap->cap->esort) {
+		imap_send(imap, imap_search_callback, search,
+				"UID SORT RETURN (ALL) (%s) UTF-8 %s", order, criteria);
+	} else {
+		imap_send(imap, imap_search_callback, search,
+				"UID SORT (%s) UTF-8 %s", order, criteria);
+	}
+}
+
+void handle_imap_search(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args) {
+	/*
+	 * Plain SEARCH and SORT responses are a list of numbers:
+	 *
+	 * * SEARCH 2 84 882
+	 */
+	if (imap->searches->length == 0) {
+		worker_log(L_DEBUG, "Got %s response with no search in flight", cmd);
+		return;
+	}
+	struct search_data *search = imap->searches->items[0];
+	while (args) {
+		if (args->type == IMAP_NUMBER) {
+			if (search->sorted) {
+				uidset_append(search->uids, args->num);
+			} else {
+				uidset_add(search->uids, args->num);
+			}
+		}
+		args = args->next;
+	}
+}
+
+void handle_imap_esearch(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args) {
+	/*
+	 * Extended search responses look like this:
+	 *
+	 * * ESEARCH (TAG "a0005") UID ALL 4:18,21
+	 *
+	 * The results may be a single number, in which case our parser gives us
+	 * an IMAP_NUMBER rather than an atom.
+	 */
+	struct search_data *search = NULL;
+	if (args && args->type == IMAP_LIST) {
+		imap_arg_t *corr = args->list;
+		if (corr && corr->next && strcasecmp(corr->str, "TAG") == 0) {
+			for (size_t i = 0; i < imap->searches->length; ++i) {
+				struct search_data *s = imap->searches->items[i];
+				if (strcmp(s->tag, corr->next->str) == 0) {
+					search = s;
+					break;
+				}
+			}
+		}
+		args = args->next;
+	}
+	if (!search) {
+		worker_log(L_DEBUG, "Got ESEARCH response for unknown search");
+		return;
+	}
+	while (args) {
+		if (args->type != IMAP_ATOM || !args->next) {
+			args = args->next;
+			continue;
+		}
+		imap_arg_t *value = args->next;
+		if (strcasecmp(args->str, "ALL") != 0) {
+			/* UID (which takes no value), COUNT, MIN, MAX, etc */
+			args = strcasecmp(args->str, "UID") == 0 ? value : value->next;
+			continue;
+		}
+		if (value && value->type == IMAP_NUMBER) {
+			if (search->sorted) {
+				uidset_append(search->uids, value->num);
+			} else {
+				uidset_add(search->uids, value->num);
+			}
+		} else if (value && value->type == IMAP_ATOM
+				&& strcasecmp(value->str, "NIL") != 0) {
+			if (!uidset_parse(search->uids, value->str, search->sorted)) {
+				worker_log(L_ERROR, "Invalid sequence set in ESEARCH: %s",
+						value->str);
+			}
+		}
+		args = args->next->next;
+	}
+}
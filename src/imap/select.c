@@ -76,8 +76,8 @@ void handle_imap_existsunseenrecent(struct imap_connection *imap, const char *to
 					while (diff--) {
 						struct mailbox_message *msg = calloc(1,
 								sizeof(struct mailbox_message));
-						msg->index = mbox->messages->length;
-						list_add(mbox->messages, msg);
+						msg->index = mbox->messages->count;
+						seqmap_append(mbox->messages, msg);
 					}
 				} else if (diff == 0) {
 					/* no-op */
@@ -107,6 +107,22 @@ void handle_imap_uidnext(struct imap_connection *imap, const char *token,
 	mbox->nextuid = args->num;
 }
 
+void handle_imap_uidvalidity(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args) {
+	/*
+	 * If this changes, UIDs we remember from before may now belong to other
+	 * messages, which whoever keeps them hears about from mailbox_updated.
+	 */
+	struct mailbox *mbox = get_mailbox(imap, imap->selected);
+	if (!mbox || !args || args->type != IMAP_NUMBER) {
+		return;
+	}
+	mbox->uidvalidity = args->num;
+	if (imap->events.mailbox_updated) {
+		imap->events.mailbox_updated(imap);
+	}
+}
+
 void handle_imap_readwrite(struct imap_connection *imap, const char *token,
 		const char *cmd, imap_arg_t *args) {
 	struct mailbox *mbox = get_mailbox(imap, imap->selected);
@@ -0,0 +1,150 @@
+/*
+ * imap/store.c - issues IMAP UID STORE commands to change message flags
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "email/flags.h"
+#include "imap/imap.h"
+#include "internal/imap.h"
+#include "log.h"
+#include "util/seqmap.h"
+#include "util/uidset.h"
+
+/* Keeps each command line comfortably short for servers with line limits */
+#define RANGES_PER_COMMAND 500
+
+struct store_data {
+	void *data;
+	imap_callback_t callback;
+	bool add;
+	flagset_t flags;
+	size_t pending;
+	enum imap_status status;
+	uidset_t *failed; // May be NULL
+};
+
+struct store_chunk {
+	struct store_data *store;
+	uidset_t *uids; // What this command covers
+	uidset_t *changed;
+};
+
+static void apply(struct imap_connection *imap, struct store_data *store,
+		uidset_t *changed, bool add) {
+	/*
+	 * Applies the change to each message in changed, and drops the messages
+	 * it didn't change from the set. We don't raise message_updated for these:
+	 * the main thread makes the same change on its side, and it would mean
+	 * sending it thousands of messages for a bulk change.
+	 */
+	struct mailbox *mbox = get_mailbox(imap, imap->selected);
+	uidset_t *result = create_uidset();
+	for (size_t i = 0; mbox && i < changed->length; ++i) {
+		for (long uid = changed->ranges[i].min;
+				uid <= changed->ranges[i].max; ++uid) {
+			struct mailbox_message *msg = seqmap_find(mbox->messages, uid);
+			if (!msg || !msg->populated) {
+				continue;
+			}
+			flagset_t flags = add ? msg->flags | store->flags
+				: msg->flags & ~store->flags;
+			if (flags != msg->flags) {
+				msg->flags = flags;
+				uidset_add(result, uid);
+			}
+		}
+	}
+	free(changed->ranges);
+	*changed = *result;
+	free(result);
+}
+
+static void imap_store_callback(struct imap_connection *imap,
+		void *data, enum imap_status status, const char *args) {
+	struct store_chunk *chunk = data;
+	struct store_data *store = chunk->store;
+	if (status != STATUS_OK) {
+		worker_log(L_DEBUG, "STORE failed: %s", args);
+		/*
+		 * Put back the flags of the messages this command covered. The other
+		 * commands may well have worked, so only these are reported.
+		 */
+		apply(imap, store, chunk->changed, !store->add);
+		store->status = status;
+		for (size_t i = 0; store->failed && i < chunk->uids->length; ++i) {
+			uidset_add_range(store->failed, chunk->uids->ranges[i].min,
+					chunk->uids->ranges[i].max);
+		}
+	}
+	uidset_free(chunk->uids);
+	uidset_free(chunk->changed);
+	free(chunk);
+	if (--store->pending == 0) {
+		if (store->callback) {
+			store->callback(imap, store->data, store->status, args);
+		}
+		free(store);
+	}
+}
+
+static char *serialize_ranges(const uidset_t *set, size_t start, size_t end) {
+	uidset_t sub = {
+		.capacity = end - start,
+		.length = end - start,
+		.ranges = set->ranges + start,
+	};
+	return uidset_serialize(&sub);
+}
+
+void imap_store(struct imap_connection *imap, imap_callback_t callback,
+		void *data, const uidset_t *uids, bool add, flagset_t flags,
+		uidset_t *failed) {
+	/*
+	 * We ask for .SILENT so the server doesn't echo a FETCH back for every
+	 * message, and apply the change to our copy of the messages right away.
+	 * Large sets are split over several commands; if any of them fails, the
+	 * messages it covered are put back the way they were.
+	 */
+	struct store_data *store = calloc(1, sizeof(struct store_data));
+	store->data = data;
+	store->callback = callback;
+	store->add = add;
+	store->status = STATUS_OK;
+	store->flags = flags;
+	store->failed = failed;
+	store->pending = (uids->length + RANGES_PER_COMMAND - 1) / RANGES_PER_COMMAND;
+	if (store->pending == 0) {
+		if (callback) {
+			callback(imap, data, STATUS_OK, NULL);
+		}
+		free(store);
+		return;
+	}
+	char *flag_list = flagset_serialize(imap->flags, flags);
+	for (size_t i = 0; i < uids->length; i += RANGES_PER_COMMAND) {
+		size_t end = i + RANGES_PER_COMMAND;
+		if (end > uids->length) end = uids->length;
+		struct store_chunk *chunk = calloc(1, sizeof(struct store_chunk));
+		chunk->store = store;
+		chunk->uids = create_uidset();
+		chunk->changed = create_uidset();
+		for (size_t j = i; j < end; ++j) {
+			uidset_add_range(chunk->uids,
+					uids->ranges[j].min, uids->ranges[j].max);
+			uidset_add_range(chunk->changed,
+					uids->ranges[j].min, uids->ranges[j].max);
+		}
+		apply(imap, store, chunk->changed, add);
+		char *set = serialize_ranges(uids, i, end);
+		imap_send(imap, imap_store_callback, chunk,
+				"UID STORE %s %cFLAGS.SILENT (%s)",
+				set, add ? '+' : '-', flag_list);
+		free(set);
+	}
+	free(flag_list);
+}
@@ -0,0 +1,108 @@
+/*
+ * imap/thread.c - issues IMAP THREAD commands and handles their responses
+ * (RFC 5256)
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include "email/thread.h"
+#include "imap/imap.h"
+#include "internal/imap.h"
+#include "log.h"
+#include "util/list.h"
+
+struct thread_data {
+	void *data;
+	imap_thread_callback_t callback;
+	struct thread_list *threads;
+};
+
+static void imap_thread_callback(struct imap_connection *imap,
+		void *data, enum imap_status status, const char *args) {
+	struct thread_data *thread = data;
+	for (size_t i = 0; i < imap->threads->length; ++i) {
+		if (imap->threads->items[i] == thread) {
+			list_del(imap->threads, i);
+			break;
+		}
+	}
+	if (status != STATUS_OK) {
+		worker_log(L_DEBUG, "Thread failed: %s", args);
+		thread_list_free(thread->threads);
+		thread->threads = NULL;
+	}
+	if (thread->callback) {
+		thread->callback(imap, thread->data, status, thread->threads);
+	} else {
+		thread_list_free(thread->threads);
+	}
+	free(thread);
+}
+
+void imap_thread(struct imap_connection *imap, imap_thread_callback_t callback,
+		void *data, const char *criteria) {
+	if (!imap->cap || !imap->cap->thread_references) {
+		if (callback) {
+			callback(imap, data, STATUS_PRE_ERROR, NULL);
+		}
+		return;
+	}
+	struct thread_data *thread = calloc(1, sizeof(struct thread_data));
+	thread->data = data;
+	thread->callback = callback;
+	thread->threads = create_thread_list();
+	list_add(imap->threads, thread);
+	imap_send(imap, imap_thread_callback, thread,
+			"UID THREAD REFERENCES UTF-8 %s", criteria);
+}
+
+static void flatten_thread(struct thread_list *threads, imap_arg_t *arg,
+		int depth) {
+	/*
+	 * Within a list, each number is the parent of the one after it, and each
+	 * nested list is a separate branch under the last number:
+	 *
+	 * (3 6 (4 23)(44 7 96))
+	 *
+	 * 3
+	 * └─6
+	 *   ├─4
+	 *   │ └─23
+	 *   └─44
+	 *     └─7
+	 *       └─96
+	 */
+	for (; arg; arg = arg->next) {
+		if (arg->type == IMAP_NUMBER) {
+			thread_list_append(threads, arg->num, depth++);
+		} else if (arg->type == IMAP_LIST) {
+			flatten_thread(threads, arg->list, depth);
+		}
+	}
+}
+
+void handle_imap_thread(struct imap_connection *imap, const char *token,
+		const char *cmd, imap_arg_t *args) {
+	/*
+	 * * THREAD (2)(3 6 (4 23)(44 7 96))
+	 *
+	 * The server orders threads oldest first. We show the newest first, like
+	 * the unthreaded message list.
+	 */
+	if (imap->threads->length == 0) {
+		worker_log(L_DEBUG, "Got THREAD response with no thread in flight");
+		return;
+	}
+	struct thread_data *thread = imap->threads->items[0];
+	list_t *roots = create_list();
+	for (; args; args = args->next) {
+		if (args->type == IMAP_LIST) {
+			list_add(roots, args->list);
+		}
+	}
+	for (size_t i = roots->length; i > 0; --i) {
+		flatten_thread(thread->threads, roots->items[i - 1], 0);
+	}
+	list_free(roots);
+}
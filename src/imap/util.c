@@ -29,10 +29,10 @@ struct mailbox *get_or_make_mailbox(struct imap_connection *imap,
 		const char *name) {
 	struct mailbox *mbox = get_mailbox(imap, name);
 	if (!mbox) {
-		mbox = malloc(sizeof(struct mailbox));
+		mbox = calloc(1, sizeof(struct mailbox));
 		mbox->name = strdup(name);
 		mbox->flags = create_list();
-		mbox->messages = create_list();
+		mbox->messages = create_seqmap();
 		mbox->exists = mbox->unseen = mbox->recent = -1;
 		list_add(imap->mailboxes, mbox);
 	}
@@ -55,13 +55,7 @@ struct mailbox_flag *mailbox_get_flag(struct imap_connection *imap,
 }
 
 void mailbox_message_free(struct mailbox_message *msg) {
-	for (size_t i = 0; i < msg->flags->length; ++i) {
-		char *f = msg->flags->items[i];
-		free(f);
-	}
-	list_free(msg->flags);
 	free_headers(msg->headers);
-	free(msg->internal_date);
 	free(msg);
 }
 
@@ -72,11 +66,12 @@ void mailbox_free(struct mailbox *mbox) {
 		free(f);
 	}
 	list_free(mbox->flags);
-	for (size_t i = 0; i < mbox->messages->length; ++i) {
-		struct mailbox_message *m = mbox->messages->items[i];
+	size_t cursor = 0;
+	void *m;
+	while (seqmap_iter(mbox->messages, &cursor, &m)) {
 		mailbox_message_free(m);
 	}
-	list_free(mbox->messages);
+	seqmap_free(mbox->messages);
 	free(mbox->name);
 	free(mbox);
 }
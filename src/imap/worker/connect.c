@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "email/index.h"
 #include "util/base64.h"
 #include "imap/imap.h"
 #include "log.h"
@@ -88,6 +89,21 @@ void handle_worker_connect(struct worker_pipe *pipe, struct worker_message *mess
 				"Error connecting to IMAP server");
 	}
 	imap->uri = uri;
+	/*
+	 * Load the local search index for this account. This happens in the
+	 * worker so that reading a large index doesn't stall the UI.
+	 */
+	if (res && !imap->index) {
+		int len = snprintf(NULL, 0, "%s@%s",
+				uri->username ? uri->username : "", uri->hostname);
+		char *key = malloc(len + 1);
+		snprintf(key, len + 1, "%s@%s",
+				uri->username ? uri->username : "", uri->hostname);
+		char *path = email_index_path(key);
+		imap->index = email_index_open(path);
+		free(path);
+		free(key);
+	}
 }
 
 void handle_worker_cert_okay(struct worker_pipe *pipe, struct worker_message *message) {
@@ -3,24 +3,71 @@
  */
 #define _POSIX_C_SOURCE 200809L
 
+#include <stdio.h>
 #include <stdlib.h>
 
+#include "email/headers.h"
 #include "imap/imap.h"
+#include "util/uidset.h"
 #include "worker.h"
 
+static void fetch_items(struct imap_connection *imap, char *buf, size_t size) {
+	/*
+	 * Besides what the main thread shows, we always want the subject, sender
+	 * and date to sort by, the fields the local search index covers if there
+	 * is one, and the ones we thread by if the server can't thread for us.
+	 */
+	uint32_t headers = imap->fetch_headers
+		| 1 << HEADER_SUBJECT | 1 << HEADER_FROM | 1 << HEADER_DATE;
+	if (imap->index) {
+		headers |= 1 << HEADER_TO | 1 << HEADER_CC;
+	}
+	if (!imap->cap || !imap->cap->thread_references) {
+		headers |= 1 << HEADER_MESSAGE_ID | 1 << HEADER_REFERENCES
+			| 1 << HEADER_IN_REPLY_TO;
+	}
+	int len = snprintf(buf, size, "UID FLAGS INTERNALDATE%s "
+			"BODY.PEEK[HEADER.FIELDS (", imap->fetch_size ? " RFC822.SIZE" : "");
+	const char *sep = "";
+	for (int i = 0; i < HEADER_FIELD_COUNT; ++i) {
+		if (headers & 1 << i) {
+			len += snprintf(buf + len, size - len, "%s%s",
+					sep, header_field_name(i));
+			sep = " ";
+		}
+	}
+	snprintf(buf + len, size - len, ")]");
+}
+
+void handle_worker_set_fetch_fields(struct worker_pipe *pipe,
+		struct worker_message *message) {
+	struct imap_connection *imap = pipe->data;
+	struct fetch_fields *fields = message->data;
+	imap->fetch_headers = fields->headers;
+	imap->fetch_size = fields->size;
+	free(fields);
+}
+
 void handle_worker_fetch_messages(struct worker_pipe *pipe,
 		struct worker_message *message) {
 	struct imap_connection *imap = pipe->data;
 	struct message_range *range = message->data;
 
-	imap_arg_t *args = calloc(1, sizeof(imap_arg_t));
-	// TODO: Choose what we need smartly based on the index-format
-	const char *what = "UID FLAGS INTERNALDATE BODY.PEEK["
-			"HEADER.FIELDS (DATE FROM SUBJECT TO CC MESSAGE-ID REFERENCES "
-			"CONTENT-TYPE IN-REPLY-TO REPLY-TO)]";
+	char items[256];
+	fetch_items(imap, items, sizeof(items));
+	imap_fetch(imap, NULL, NULL, range->min, range->max, items);
 
-	imap_fetch(imap, NULL, NULL, range->min, range->max, what);
-
-	imap_arg_free(args);
 	free(range);
 }
+
+void handle_worker_fetch_uids(struct worker_pipe *pipe,
+		struct worker_message *message) {
+	struct imap_connection *imap = pipe->data;
+	uidset_t *uids = message->data;
+	if (uids->length != 0) {
+		char items[256];
+		fetch_items(imap, items, sizeof(items));
+		imap_uid_fetch(imap, NULL, NULL, uids, items);
+	}
+	uidset_free(uids);
+}
@@ -5,17 +5,33 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "imap/imap.h"
 #include "worker.h" // must be included before imap/worker.h
 #include "imap/worker.h"
+#include "internal/imap.h"
 #include "util/list.h"
 
 struct list_data {
 	struct worker_pipe *pipe;
 	struct worker_message *message;
+	char *parent;
 };
 
+static bool in_level(const struct mailbox *mbox, const char *parent) {
+	/* Children are one delimiter (and no more) below their parent */
+	if (!parent) {
+		return !mbox->delimiter || !strchr(mbox->name, mbox->delimiter);
+	}
+	size_t len = strlen(parent);
+	return mbox->delimiter
+		&& strncmp(mbox->name, parent, len) == 0
+		&& mbox->name[len] == mbox->delimiter
+		&& mbox->name[len + 1]
+		&& !strchr(mbox->name + len + 1, mbox->delimiter);
+}
+
 void imap_list_callback(struct imap_connection *imap,
 		void *_data, enum imap_status status, const char *args) {
 	/*
@@ -23,15 +39,19 @@ void imap_list_callback(struct imap_connection *imap,
 	 */
 	struct list_data *data = _data;
 	if (status == STATUS_OK) {
-		list_t *mboxes = create_list();
+		struct mailbox_list *result = malloc(sizeof(struct mailbox_list));
+		result->parent = data->parent;
+		result->mailboxes = create_list();
 		for (size_t i = 0; i < imap->mailboxes->length; ++i) {
 			struct mailbox *source = imap->mailboxes->items[i];
-			struct aerc_mailbox *dest = serialize_mailbox(source);
-			list_add(mboxes, dest);
+			if (in_level(source, data->parent)) {
+				list_add(result->mailboxes, serialize_mailbox(source));
+			}
 		}
-		worker_post_message(data->pipe, WORKER_LIST_DONE, data->message, mboxes);
+		worker_post_message(data->pipe, WORKER_LIST_DONE, data->message, result);
 	} else {
-		worker_post_message(data->pipe, WORKER_LIST_ERROR, data->message, NULL);
+		worker_post_message(data->pipe, WORKER_LIST_ERROR, data->message,
+				data->parent);
 	}
 	free(data);
 }
@@ -40,6 +60,25 @@ void handle_worker_list(struct worker_pipe *pipe, struct worker_message *message
 	struct imap_connection *imap = pipe->data;
 	struct list_data *data = malloc(sizeof(struct list_data));
 	data->pipe = pipe; data->message = message;
+	data->parent = message->data;
 	worker_post_message(pipe, WORKER_ACK, message, NULL);
-	imap_list(imap, imap_list_callback, data, "", "%");
+	if (!data->parent) {
+		imap_list(imap, imap_list_callback, data, "", "%");
+		return;
+	}
+	/* Children are listed a level at a time, as they're expanded */
+	struct mailbox *parent = get_mailbox(imap, data->parent);
+	if (!parent || !parent->delimiter) {
+		worker_post_message(pipe, WORKER_LIST_ERROR, message, data->parent);
+		free(data);
+		return;
+	}
+	size_t len = strlen(data->parent);
+	char *pattern = malloc(len + 3);
+	memcpy(pattern, data->parent, len);
+	pattern[len] = parent->delimiter;
+	pattern[len + 1] = '%';
+	pattern[len + 2] = '\0';
+	imap_list(imap, imap_list_callback, data, "", pattern);
+	free(pattern);
 }
@@ -0,0 +1,133 @@
+/*
+ * imap/worker/search.c - Handles IMAP worker search and sort actions
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include "email/index.h"
+#include "email/thread.h"
+#include "imap/imap.h"
+#include "internal/imap.h"
+#include "util/uidset.h"
+#include "worker.h"
+
+struct search_data {
+	struct worker_pipe *pipe;
+	struct worker_message *message;
+	bool sort;
+};
+
+static void search_callback(struct imap_connection *imap, void *_data,
+		enum imap_status status, uidset_t *uids) {
+	struct search_data *data = _data;
+	if (status == STATUS_OK) {
+		worker_post_message(data->pipe,
+				data->sort ? WORKER_SORT_DONE : WORKER_SEARCH_DONE,
+				data->message, uids);
+	} else {
+		uidset_free(uids);
+		worker_post_message(data->pipe,
+				data->sort ? WORKER_SORT_ERROR : WORKER_SEARCH_ERROR,
+				data->message, NULL);
+	}
+	free(data);
+}
+
+static void free_request(struct search_request *request) {
+	free(request->criteria);
+	free(request->order);
+	free(request);
+}
+
+void handle_worker_search(struct worker_pipe *pipe,
+		struct worker_message *message) {
+	struct imap_connection *imap = pipe->data;
+	struct search_request *request = message->data;
+	worker_post_message(pipe, WORKER_ACK, message, NULL);
+	if (request->local) {
+		if (imap->index && imap->selected) {
+			worker_post_message(pipe, WORKER_SEARCH_DONE, message,
+					email_index_query(imap->index, imap->selected,
+						request->criteria));
+		} else {
+			worker_post_message(pipe, WORKER_SEARCH_ERROR, message, NULL);
+		}
+		free_request(request);
+		return;
+	}
+	struct search_data *data = calloc(1, sizeof(struct search_data));
+	data->pipe = pipe; data->message = message;
+	imap_search(imap, search_callback, data, request->criteria);
+	free_request(request);
+}
+
+void handle_worker_sort(struct worker_pipe *pipe,
+		struct worker_message *message) {
+	struct imap_connection *imap = pipe->data;
+	struct search_request *request = message->data;
+	struct search_data *data = calloc(1, sizeof(struct search_data));
+	data->pipe = pipe; data->message = message; data->sort = true;
+	worker_post_message(pipe, WORKER_ACK, message, NULL);
+	imap_sort(imap, search_callback, data, request->order, request->criteria);
+	free_request(request);
+}
+
+static void thread_callback(struct imap_connection *imap, void *_data,
+		enum imap_status status, struct thread_list *threads) {
+	struct search_data *data = _data;
+	if (status == STATUS_OK) {
+		worker_post_message(data->pipe, WORKER_THREAD_DONE,
+				data->message, threads);
+	} else {
+		thread_list_free(threads);
+		worker_post_message(data->pipe, WORKER_THREAD_ERROR,
+				data->message, NULL);
+	}
+	free(data);
+}
+
+static struct thread_list *local_threads(struct imap_connection *imap) {
+	/*
+	 * The thread index never forgets a message, so we leave out the ones that
+	 * have been expunged since.
+	 */
+	struct thread_list *all = thread_index_flatten(imap->thread_index);
+	struct mailbox *mbox = get_mailbox(imap, imap->selected);
+	if (!mbox) {
+		return all;
+	}
+	struct thread_list *threads = create_thread_list();
+	size_t n = 0;
+	for (size_t i = 0; i < all->uids->length; ++i) {
+		struct uid_range *range = &all->uids->ranges[i];
+		for (long k = 0; k <= range->max - range->min; ++k, ++n) {
+			long uid = uid_range_at(range, k);
+			if (seqmap_find(mbox->messages, uid)) {
+				thread_list_append(threads, uid, all->depths[n]);
+			}
+		}
+	}
+	thread_list_free(all);
+	return threads;
+}
+
+void handle_worker_thread(struct worker_pipe *pipe,
+		struct worker_message *message) {
+	/*
+	 * The server can thread the whole mailbox, whereas we can only thread the
+	 * messages we've fetched, so we prefer to let it do the work.
+	 */
+	struct imap_connection *imap = pipe->data;
+	worker_post_message(pipe, WORKER_ACK, message, NULL);
+	if (imap->cap && imap->cap->thread_references) {
+		struct search_data *data = calloc(1, sizeof(struct search_data));
+		data->pipe = pipe; data->message = message;
+		imap_thread(imap, thread_callback, data, "ALL");
+	} else if (imap->thread_index) {
+		worker_post_message(pipe, WORKER_THREAD_DONE, message,
+				local_threads(imap));
+	} else {
+		worker_post_message(pipe, WORKER_THREAD_ERROR, message, NULL);
+	}
+}
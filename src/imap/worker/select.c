@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 
+#include "email/thread.h"
 #include "imap/imap.h"
 #include "worker.h"
 
@@ -15,5 +16,8 @@ void handle_worker_select_mailbox(struct worker_pipe *pipe, struct worker_messag
 	 */
 	struct imap_connection *imap = pipe->data;
 	worker_post_message(pipe, WORKER_ACK, message, NULL);
+	/* Threads are per mailbox, so start over */
+	thread_index_free(imap->thread_index);
+	imap->thread_index = create_thread_index();
 	imap_select(imap, NULL, NULL, (const char *)message->data);
 }
@@ -0,0 +1,42 @@
+/*
+ * imap/worker/store.c - Handles IMAP worker flag changes
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include "imap/imap.h"
+#include "util/uidset.h"
+#include "worker.h"
+
+struct store_data {
+	struct worker_pipe *pipe;
+	struct worker_message *message;
+	struct flag_request *request;
+};
+
+static void store_callback(struct imap_connection *imap, void *_data,
+		enum imap_status status, const char *args) {
+	/*
+	 * The request goes back to the main thread either way, so that it can put
+	 * its copy of the flags back if the server refused.
+	 */
+	struct store_data *data = _data;
+	worker_post_message(data->pipe,
+			status == STATUS_OK ?
+				WORKER_STORE_FLAGS_DONE : WORKER_STORE_FLAGS_ERROR,
+			data->message, data->request);
+	free(data);
+}
+
+void handle_worker_store_flags(struct worker_pipe *pipe,
+		struct worker_message *message) {
+	struct imap_connection *imap = pipe->data;
+	struct flag_request *request = message->data;
+	struct store_data *data = calloc(1, sizeof(struct store_data));
+	data->pipe = pipe; data->message = message; data->request = request;
+	worker_post_message(pipe, WORKER_ACK, message, NULL);
+	request->failed = create_uidset();
+	imap_store(imap, store_callback, data, request->uids, request->add,
+			request->flags, request->failed);
+}
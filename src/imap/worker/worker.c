@@ -10,6 +10,8 @@
 
 #include "worker.h"
 #include "email/headers.h"
+#include "email/index.h"
+#include "email/thread.h"
 #include "imap/imap.h"
 #include "imap/worker.h"
 #include "internal/imap.h"
@@ -29,6 +31,12 @@ struct action_handler handlers[] = {
 	{ WORKER_CONNECT_CERT_OKAY, handle_worker_cert_okay },
 #endif
 	{ WORKER_FETCH_MESSAGES, handle_worker_fetch_messages },
+	{ WORKER_FETCH_UIDS, handle_worker_fetch_uids },
+	{ WORKER_SET_FETCH_FIELDS, handle_worker_set_fetch_fields },
+	{ WORKER_SEARCH, handle_worker_search },
+	{ WORKER_SORT, handle_worker_sort },
+	{ WORKER_THREAD, handle_worker_thread },
+	{ WORKER_STORE_FLAGS, handle_worker_store_flags },
 	{ WORKER_DELETE_MAILBOX, handle_worker_delete_mailbox },
 };
 
@@ -55,56 +63,142 @@ struct aerc_message *serialize_message(struct mailbox_message *source) {
 		return dest;
 	}
 	dest->uid = source->uid;
-	dest->flags = create_list();
-	for (size_t i = 0; i < source->flags->length; ++i) {
-		list_add(dest->flags, strdup(source->flags->items[i]));
-	}
-	dest->headers = create_list();
-	for (size_t i = 0; i < source->headers->length; ++i) {
-		struct email_header *header = source->headers->items[i];
-		struct email_header *copy = malloc(sizeof(struct email_header));
-		copy->key = strdup(header->key);
-		copy->value = strdup(header->value);
-		list_add(dest->headers, copy);
-	}
-	dest->internal_date = calloc(1, sizeof(struct tm));
-	memcpy(dest->internal_date, source->internal_date, sizeof(struct tm));
+	dest->flags = source->flags;
+	dest->size = source->size;
+	dest->headers = copy_headers(source->headers);
+	dest->internal_date = source->internal_date;
 	return dest;
 }
 
 struct aerc_mailbox *serialize_mailbox(struct mailbox *source) {
-	struct aerc_mailbox *dest = calloc(1, sizeof(struct mailbox));
+	struct aerc_mailbox *dest = calloc(1, sizeof(struct aerc_mailbox));
 	dest->name = strdup(source->name);
 	dest->exists = source->exists;
 	dest->recent = source->recent;
 	dest->unseen = source->unseen;
 	dest->selected = source->selected;
+	dest->delimiter = source->delimiter;
 	dest->flags = create_list();
 	for (size_t i = 0; i < source->flags->length; ++i) {
 		struct mailbox_flag *flag = source->flags->items[i];
 		// TODO: Send along the permanent bool as well
 		list_add(dest->flags, strdup(flag->name));
 	}
-	dest->messages = create_list();
-	for (size_t i = 0; i < source->messages->length; ++i) {
-		list_add(dest->messages, serialize_message(source->messages->items[i]));
+	dest->messages = create_seqmap();
+	size_t cursor = 0;
+	void *msg;
+	while (seqmap_iter(source->messages, &cursor, &msg)) {
+		struct aerc_message *copy = serialize_message(msg);
+		seqmap_append(dest->messages, copy);
+		if (copy->uid) {
+			seqmap_set_uid(dest->messages, dest->messages->count, copy->uid);
+		}
 	}
 	return dest;
 }
 
+static void flush_expunged(struct imap_connection *imap) {
+	/*
+	 * Sends along the expunges since the last flush. This has to happen before
+	 * anything else that refers to messages by sequence number is sent, so
+	 * that the main thread's numbering agrees with ours.
+	 */
+	if (!imap->expunged || imap->expunged->length == 0) {
+		return;
+	}
+	struct worker_pipe *pipe = imap->data;
+	worker_post_message(pipe, WORKER_MESSAGES_EXPUNGED, NULL, imap->expunged);
+	imap->expunged = NULL;
+}
+
+static void expunge_message(struct imap_connection *imap, size_t seq,
+		long uid) {
+	/*
+	 * Expunges come one at a time, each numbered after the ones before it were
+	 * removed. We translate them back to the numbering the main thread still
+	 * has, so that a batch of them can be sent as one compact set.
+	 */
+	if (imap->index && imap->selected && uid) {
+		email_index_remove(imap->index, imap->selected, uid);
+	}
+	if (!imap->expunged) {
+		imap->expunged = create_uidset();
+	}
+	uidset_t *set = imap->expunged;
+	long original = seq;
+	for (size_t i = 0; i < set->length && set->ranges[i].min <= original; ++i) {
+		original += set->ranges[i].max - set->ranges[i].min + 1;
+	}
+	uidset_add(set, original);
+}
+
 static void update_mailbox(struct imap_connection *imap) {
 	/*
 	 * Some detail about the mailbox has changed. Re-serialize it and re-send it
 	 * to the main thread.
 	 */
-	struct aerc_mailbox *mbox = serialize_mailbox(
-			get_mailbox(imap, imap->selected));
+	flush_expunged(imap);
+	struct mailbox *selected = get_mailbox(imap, imap->selected);
+	if (imap->index && selected && selected->uidvalidity) {
+		email_index_set_uidvalidity(imap->index, imap->selected,
+				selected->uidvalidity);
+	}
+	struct aerc_mailbox *mbox = serialize_mailbox(selected);
 	struct worker_pipe *pipe = imap->data;
 	worker_post_message(pipe, WORKER_MAILBOX_UPDATED, NULL, mbox);
 }
 
+static void index_message(struct imap_connection *imap,
+		struct mailbox_message *msg) {
+	/*
+	 * Adds the searchable headers of a freshly fetched message to the local
+	 * index. We only cache headers so far, so bodies aren't indexed.
+	 */
+	if (!imap->index || !imap->selected || !msg->populated || !msg->headers
+			|| email_index_contains(imap->index, imap->selected, msg->uid)) {
+		return;
+	}
+	static const enum header_field fields[] = {
+		HEADER_SUBJECT, HEADER_FROM, HEADER_TO, HEADER_CC
+	};
+	size_t size = 1;
+	for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+		const char *value = header_text(msg->headers, fields[i]);
+		size += value ? strlen(value) + 1 : 0;
+	}
+	char *text = malloc(size);
+	char *_ = text;
+	for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+		const char *value = header_text(msg->headers, fields[i]);
+		if (value) {
+			_ += sprintf(_, "%s ", value);
+		}
+	}
+	*_ = '\0';
+	email_index_add(imap->index, imap->selected, msg->uid, text);
+	free(text);
+}
+
+static void thread_message(struct imap_connection *imap,
+		struct mailbox_message *msg) {
+	/*
+	 * Keeps the local threads up to date as messages come in, for servers
+	 * without THREAD=REFERENCES.
+	 */
+	if (!imap->thread_index || !msg->populated || !msg->headers) {
+		return;
+	}
+	thread_index_add(imap->thread_index, msg->uid,
+			msg->headers->fields[HEADER_MESSAGE_ID],
+			msg->headers->fields[HEADER_REFERENCES],
+			msg->headers->fields[HEADER_IN_REPLY_TO]);
+}
+
 static void update_message(struct imap_connection *imap,
 		struct mailbox_message *msg) {
+	index_message(imap, msg);
+	thread_message(imap, msg);
+	flush_expunged(imap);
 	struct aerc_message *aerc_msg = serialize_message(msg);
 	struct worker_pipe *pipe = imap->data;
 	worker_post_message(pipe, WORKER_MESSAGE_UPDATED, NULL, aerc_msg);
@@ -125,9 +219,11 @@ void *imap_worker(void *_pipe) {
 	struct imap_connection *imap = calloc(1, sizeof(struct imap_connection));
 	pipe->data = imap;
 	imap->data = pipe;
+	imap->flags = pipe->flags;
 	imap->events.mailbox_updated = update_mailbox;
 	imap->events.mailbox_deleted = delete_mailbox;
 	imap->events.message_updated = update_message;
+	imap->events.message_expunged = expunge_message;
 	worker_log(L_DEBUG, "Starting IMAP worker");
 	while (1) {
 		/*
@@ -140,6 +236,9 @@ void *imap_worker(void *_pipe) {
 			 * thread, or we pass it along to the message handlers.
 			 */
 			if (message->type == WORKER_END) {
+				email_index_close(imap->index);
+				thread_index_free(imap->thread_index);
+				uidset_free(imap->expunged);
 				imap_close(imap);
 				free(imap);
 				worker_message_free(message);
@@ -154,6 +253,7 @@ void *imap_worker(void *_pipe) {
 		 * messages and passing them along to various handlers.
 		 */
 		imap_receive(imap);
+		flush_expunged(imap);
 
 		/*
 		 * Finally, we sleep for a bit and then loop back around again.
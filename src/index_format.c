@@ -0,0 +1,279 @@
+/*
+ * index_format.c - compiles and runs the message list's index format
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termbox.h>
+#include <time.h>
+
+#include "config.h"
+#include "email/headers.h"
+#include "index_format.h"
+#include "util/wcwidth.h"
+
+static void add_literal(struct index_format *format, size_t *literals_length,
+		const char *text, size_t len) {
+	memcpy(format->literals + *literals_length, text, len);
+	/* Runs of literal text share one op */
+	struct index_op *last = format->length ?
+		&format->ops[format->length - 1] : NULL;
+	if (last && last->field == INDEX_LITERAL) {
+		last->literal_length += len;
+	} else {
+		format->ops[format->length++] = (struct index_op){
+			.field = INDEX_LITERAL,
+			.max_width = -1,
+			.literal = *literals_length,
+			.literal_length = len,
+		};
+	}
+	*literals_length += len;
+}
+
+struct index_format *compile_index_format(const char *text) {
+	struct index_format *format = calloc(1, sizeof(struct index_format));
+	size_t len = strlen(text);
+	/* Neither can outgrow the format string */
+	format->ops = malloc(sizeof(struct index_op) * (len + 1));
+	format->literals = malloc(len + 1);
+	size_t literals_length = 0;
+	const char *p = text;
+	while (*p) {
+		if (*p != '%') {
+			const char *end = strchr(p, '%');
+			size_t n = end ? (size_t)(end - p) : strlen(p);
+			add_literal(format, &literals_length, p, n);
+			p += n;
+			continue;
+		}
+		const char *start = p++;
+		struct index_op op = { .max_width = -1 };
+		if (*p == '-') {
+			op.left_align = true;
+			++p;
+		}
+		while (*p >= '0' && *p <= '9') {
+			op.min_width = op.min_width * 10 + (*p++ - '0');
+		}
+		if (*p == '.') {
+			op.max_width = 0;
+			++p;
+			while (*p >= '0' && *p <= '9') {
+				op.max_width = op.max_width * 10 + (*p++ - '0');
+			}
+		}
+		switch (*p) {
+		case 'C':
+			op.field = INDEX_NUMBER;
+			break;
+		case 'D':
+		case 'd':
+			/* This is the internal date, which is always fetched */
+			op.field = INDEX_DATE;
+			break;
+		case 'Z':
+			op.field = INDEX_FLAGS;
+			break;
+		case 'n':
+			op.field = INDEX_NAME;
+			format->headers |= 1 << HEADER_FROM;
+			break;
+		case 'a':
+		case 'f':
+			op.field = INDEX_FROM;
+			format->headers |= 1 << HEADER_FROM;
+			break;
+		case 's':
+			op.field = INDEX_SUBJECT;
+			format->headers |= 1 << HEADER_SUBJECT;
+			break;
+		case 'c':
+			op.field = INDEX_SIZE;
+			format->size = true;
+			break;
+		default:
+			/* %% and anything we don't know are shown as written */
+			if (*p == '%') {
+				start = p;
+			}
+			if (*p) {
+				++p;
+			}
+			add_literal(format, &literals_length, start, p - start);
+			continue;
+		}
+		++p;
+		format->ops[format->length++] = op;
+	}
+	format->literals[literals_length] = '\0';
+	return format;
+}
+
+void free_index_format(struct index_format *format) {
+	if (!format) return;
+	free(format->ops);
+	free(format->literals);
+	free(format);
+}
+
+static int put_text(struct tb_cell *cells, int width, const struct tb_cell *basis,
+		const char *text, size_t len) {
+	/*
+	 * The text has already been cut to fit. Wide characters take two cells,
+	 * the second blank, and zero-width ones none, as in tb_puts. Decoding
+	 * with next_codepoint draws stray bytes as the single U+FFFD column
+	 * utf8_truncate counted them as.
+	 */
+	int x = 0;
+	const char *end = text + len;
+	while (text < end) {
+		size_t n;
+		uint32_t ch = next_codepoint(text, end - text, &n);
+		text += n;
+		int w = codepoint_width(ch);
+		if (x + w > width) {
+			break;
+		}
+		for (int i = 0; i < w; ++i) {
+			cells[x + i] = *basis;
+			cells[x + i].ch = i ? ' ' : ch;
+		}
+		x += w;
+	}
+	return x;
+}
+
+static int put_spaces(struct tb_cell *cells, int width,
+		const struct tb_cell *basis, int count) {
+	int x = 0;
+	for (; x < width && x < count; ++x) {
+		cells[x] = *basis;
+		cells[x].ch = ' ';
+	}
+	return x;
+}
+
+static void author_name(const char *from, const char **name, size_t *len) {
+	/* "Name" <address>, Name <address>, <address> or address */
+	const char *lt = strchr(from, '<');
+	if (!lt) {
+		*name = from;
+		*len = strlen(from);
+		return;
+	}
+	const char *start = from, *end = lt;
+	while (end > start && end[-1] == ' ') --end;
+	if (end - start >= 2 && *start == '"' && end[-1] == '"') {
+		++start;
+		--end;
+	}
+	if (end > start) {
+		*name = start;
+		*len = end - start;
+		return;
+	}
+	const char *gt = strchr(lt, '>');
+	*name = lt + 1;
+	*len = gt ? (size_t)(gt - lt - 1) : strlen(lt + 1);
+}
+
+int render_index_format(const struct index_format *format,
+		const struct index_row *row, const struct tb_cell *basis,
+		struct tb_cell *cells, int width) {
+	int x = 0;
+	for (size_t i = 0; i < format->length && x < width; ++i) {
+		const struct index_op *op = &format->ops[i];
+		char buf[128];
+		const char *text = buf;
+		size_t len = 0;
+		int indent = 0, known_width = 0;
+		switch (op->field) {
+		case INDEX_LITERAL:
+			text = format->literals + op->literal;
+			len = op->literal_length;
+			break;
+		case INDEX_NUMBER:
+			len = snprintf(buf, sizeof(buf), "%zu", row->number);
+			break;
+		case INDEX_DATE:
+			if (row->date_text && row->date_text[0]) {
+				text = row->date_text;
+				len = strlen(text);
+			} else if (row->date) {
+				struct tm local;
+				time_t epoch = row->date;
+				localtime_r(&epoch, &local);
+				len = strftime(buf, sizeof(buf),
+						config->ui.timestamp_format, &local);
+				if (row->date_text && len < row->date_text_size) {
+					memcpy(row->date_text, buf, len + 1);
+				}
+			}
+			break;
+		case INDEX_SIZE:
+			if (row->size < 1000) {
+				len = snprintf(buf, sizeof(buf), "%u", (unsigned)row->size);
+			} else if (row->size < 10 * 1024) {
+				len = snprintf(buf, sizeof(buf), "%.1fK", row->size / 1024.0);
+			} else if (row->size < 1024 * 1024) {
+				len = snprintf(buf, sizeof(buf), "%uK",
+						(unsigned)(row->size + 512) / 1024);
+			} else {
+				len = snprintf(buf, sizeof(buf), "%.1fM",
+						row->size / (1024.0 * 1024.0));
+			}
+			break;
+		case INDEX_FLAGS:
+			buf[0] = row->flags & FLAG_DELETED ? 'D'
+				: !(row->flags & FLAG_SEEN) ? 'N' : ' ';
+			buf[1] = row->flags & FLAG_FLAGGED ? '!' : ' ';
+			buf[2] = row->flags & FLAG_ANSWERED ? 'r' : ' ';
+			len = 3;
+			break;
+		case INDEX_NAME:
+			if (row->from) {
+				author_name(row->from, &text, &len);
+			}
+			break;
+		case INDEX_FROM:
+			if (row->from) {
+				text = row->from;
+				len = strlen(text);
+			}
+			break;
+		case INDEX_SUBJECT:
+			/* Replies are indented under their parent, up to a point */
+			indent = (row->depth > 8 ? 8 : row->depth) * 2;
+			if (row->subject) {
+				text = row->subject;
+				len = strlen(text);
+				known_width = row->subject_width;
+			}
+			break;
+		}
+		int max = op->max_width;
+		if (max >= 0 && indent > max) {
+			indent = max;
+		}
+		/* Nothing wider than the screen could be seen anyway */
+		int text_max = (max >= 0 && max - indent < width ? max - indent : width);
+		int used = known_width;
+		if (!known_width || known_width > text_max) {
+			len = utf8_truncate(text, len, text_max, &used);
+		}
+		used += indent;
+		int pad = op->min_width > used ? op->min_width - used : 0;
+		if (!op->left_align) {
+			x += put_spaces(cells + x, width - x, basis, pad);
+		}
+		x += put_spaces(cells + x, width - x, basis, indent);
+		x += put_text(cells + x, width - x, basis, text, len);
+		if (op->left_align) {
+			x += put_spaces(cells + x, width - x, basis, pad);
+		}
+	}
+	return x;
+}
@@ -14,6 +14,7 @@
 #include "bind.h"
 #include "colors.h"
 #include "config.h"
+#include "email/charset.h"
 #include "handlers.h"
 #include "worker.h"
 #include "imap/worker.h"
@@ -41,6 +42,15 @@ struct message_handler message_handlers[] = {
 	{ WORKER_MAILBOX_UPDATED, handle_worker_mailbox_updated },
 	{ WORKER_MAILBOX_DELETED, handle_worker_mailbox_deleted },
 	{ WORKER_MESSAGE_UPDATED, handle_worker_message_updated },
+	{ WORKER_MESSAGES_EXPUNGED, handle_worker_messages_expunged },
+	{ WORKER_STORE_FLAGS_DONE, handle_worker_store_flags_done },
+	{ WORKER_STORE_FLAGS_ERROR, handle_worker_store_flags_error },
+	{ WORKER_SEARCH_DONE, handle_worker_search_done },
+	{ WORKER_SEARCH_ERROR, handle_worker_search_error },
+	{ WORKER_SORT_DONE, handle_worker_sort_done },
+	{ WORKER_SORT_ERROR, handle_worker_sort_error },
+	{ WORKER_THREAD_DONE, handle_worker_thread_done },
+	{ WORKER_THREAD_ERROR, handle_worker_thread_error },
 };
 
 void handle_worker_message(struct account_state *account, struct worker_message *msg) {
@@ -73,6 +83,9 @@ static void init_state() {
 	bind_add(state->binds, "l", ":next-mailbox<Enter>");
 	bind_add(state->binds, "J", ":next-folder<Enter>");
 	bind_add(state->binds, "K", ":previous-folder<Enter>");
+	bind_add(state->binds, "n", ":next-result<Enter>");
+	bind_add(state->binds, "N", ":previous-result<Enter>");
+	bind_add(state->binds, "T", ":thread<Enter>");
 }
 
 static void cleanup_state() {
@@ -118,6 +131,11 @@ int main(int argc, char **argv) {
 				ac->source);
 		worker_post_action(account->worker.pipe, WORKER_CONFIGURE, NULL,
 				ac->extras);
+		struct fetch_fields *fields = calloc(1, sizeof(struct fetch_fields));
+		fields->headers = config->ui.index->headers;
+		fields->size = config->ui.index->size;
+		worker_post_action(account->worker.pipe, WORKER_SET_FETCH_FIELDS, NULL,
+				fields);
 		// TODO: Detect appropriate worker based on source
 		pthread_create(&account->worker.thread, NULL, imap_worker,
 				account->worker.pipe);
@@ -128,10 +146,15 @@ int main(int argc, char **argv) {
 	rerender();
 
 	while (1) {
+		/*
+		 * Take everything the workers have for us, within reason, so a burst
+		 * of updates is drawn in one frame instead of one per tick.
+		 */
 		struct worker_message *msg;
 		for (size_t i = 0; i < state->accounts->length; ++i) {
 			struct account_state *account = state->accounts->items[i];
-			if (worker_get_message(account->worker.pipe, &msg)) {
+			for (int n = 0; n < 1024
+					&& worker_get_message(account->worker.pipe, &msg); ++n) {
 				handle_worker_message(account, msg);
 				worker_message_free(msg);
 			}
@@ -141,11 +164,14 @@ int main(int argc, char **argv) {
 			break;
 		}
 
-		struct timespec spec = { 0, .5e+8 };
+		/* Tick once a frame, so the frame rate limit is what we wait on */
+		int fps = config->ui.max_fps > 0 ? config->ui.max_fps : 200;
+		struct timespec spec = { 0, 999999999L / fps };
 		nanosleep(&spec, NULL);
 	}
 
 	teardown_ui();
 	cleanup_state();
+	charset_pool_free();
 	return 0;
 }
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <malloc.h>
 #include <string.h>
 #include <termbox.h>
@@ -5,9 +7,12 @@
 
 #include "colors.h"
 #include "config.h"
+#include "email/columns.h"
+#include "index_format.h"
 #include "state.h"
 #include "ui.h"
 #include "util/list.h"
+#include "util/uidset.h"
 #include "worker.h"
 
 static void clear_remaining(struct tb_cell *cell, int x, int y, int width, int height) {
@@ -23,47 +28,41 @@ void render_account_bar(int x, int y, int width, int folder_width) {
 	struct tb_cell cell;
 
 	/* Render folder list header */
-	get_color("borders", &cell);
+	get_color(COLOR_BORDERS, &cell);
 	const char *aerc = "aerc"; // 4 chars
 	int sides = (folder_width - 4) / 2;
 	for (int _x = 0; _x < sides; ++_x) {
-		tb_printf(x++, y, &cell, " ");
+		tb_puts(x++, y, 1, &cell, " ");
 	}
-	tb_printf(x, y, &cell, aerc); x += 4;
+	tb_puts(x, y, 4, &cell, aerc); x += 4;
 	for (int _x = 0; _x < sides - 1; ++_x) {
-		tb_printf(x++, y, &cell, " ");
+		tb_puts(x++, y, 1, &cell, " ");
 	}
-	tb_printf(x, y, &cell, " "); x += 1;
+	tb_puts(x, y, 1, &cell, " "); x += 1;
 
 	/* Render account tabs */
 	for (size_t i = 0; i < state->accounts->length; ++i) {
 		struct account_state *account = state->accounts->items[i];
 		if (i == state->selected_account) {
-			get_color("account-selected", &cell);
+			get_color(COLOR_ACCOUNT_SELECTED, &cell);
 		} else {
-			get_color("account-unselected", &cell);
+			get_color(COLOR_ACCOUNT_UNSELECTED, &cell);
 			if (account->status.status == ACCOUNT_ERROR) {
-				get_color("account-error", &cell);
+				get_color(COLOR_ACCOUNT_ERROR, &cell);
 			}
 		}
 		x += tb_printf(x, 0, &cell, " %s ", account->name);
 	}
-	get_color("borders", &cell);
+	get_color(COLOR_BORDERS, &cell);
 	clear_remaining(&cell, x, y, width, 1);
 }
 
-static int compare_mailboxes(const void *_a, const void *_b) {
-	const struct aerc_mailbox *a = *(void **)_a;
-	const struct aerc_mailbox *b = *(void **)_b;
-	return strcmp(a->name, b->name);
-}
-
 void render_folder_list(int x, int y, int width, int height) {
 	struct account_state *account =
 		state->accounts->items[state->selected_account];
 
 	struct tb_cell cell;
-	get_color("borders", &cell);
+	get_color(COLOR_BORDERS, &cell);
 	int _x = x, _y = y;
 	_x += width - 1;
 	for (; _y < height; ++_y) {
@@ -73,63 +72,86 @@ void render_folder_list(int x, int y, int width, int height) {
 
 	_x = x, _y = y;
 	if (account->mailboxes) {
-		list_qsort(account->mailboxes, compare_mailboxes);
-		for (size_t i = 0; y < height && i < account->mailboxes->length; ++i, ++y) {
-			struct aerc_mailbox *mailbox = account->mailboxes->items[i];
-			if (strcmp(mailbox->name, account->selected) == 0) {
-				get_color("folder-selected", &cell);
+		/*
+		 * Only the folders that fit are drawn, scrolled so that the selected
+		 * one is among them.
+		 */
+		size_t count;
+		const size_t *rows = get_folder_rows(account, &count);
+		size_t visible = height > y ? height - y : 0;
+		size_t offset = account->ui.folder_offset;
+		int selected = get_aerc_mailbox_index(account, account->selected);
+		long row = selected == -1 ? -1 : get_folder_row(account, selected);
+		if (row >= 0 && (size_t)row < offset) {
+			offset = row;
+		} else if (row >= 0 && visible && (size_t)row >= offset + visible) {
+			offset = row - visible + 1;
+		}
+		if (offset + visible > count) {
+			offset = count > visible ? count - visible : 0;
+		}
+		account->ui.folder_offset = offset;
+		for (size_t r = offset; y < height && r < count; ++r, ++y) {
+			struct aerc_mailbox *mailbox = account->mailboxes->items[rows[r]];
+			if ((int)rows[r] == selected) {
+				get_color(COLOR_FOLDER_SELECTED, &cell);
 			} else {
-				get_color("folder-unselected", &cell);
-			}
-			char c = '\0';
-			// TODO: utf-8 strlen
-			// TODO: decode mailbox names according to spec
-			if ((int)strlen(mailbox->name) > width - 1) {
-				mailbox->name[width - 1] = '\0';
+				get_color(COLOR_FOLDER_UNSELECTED, &cell);
 			}
-			int l = tb_printf(x, y, &cell, "%s", mailbox->name);
-			if (c != '\0') {
-				mailbox->name[width - 1] = c;
+			/* Children are indented under their parent */
+			int l = mailbox->depth * 2 < width - 1 ? mailbox->depth * 2 : width - 1;
+			cell.ch = ' ';
+			for (int i = 0; i < l; ++i) {
+				tb_put_cell(x + i, y, &cell);
 			}
+			int avail = width - 1 - l;
+			tb_puts(x + l, y, avail, &cell, mailbox->leaf);
+			l += mailbox->leaf_width < avail ? mailbox->leaf_width : avail;
 			cell.ch = ' ';
 			while (l < width - 1) {
 				tb_put_cell(x + l, y, &cell);
 				l++;
 			}
-			bool hasChildren = get_mailbox_flag(mailbox, "\\HasChildren");
-			if (hasChildren) {
+			if (mailbox->has_children && !mailbox->expanded) {
 				cell.ch = '.';
 				tb_put_cell(x + width - 2, y, &cell);
 				tb_put_cell(x + width - 3, y, &cell);
 			}
 		}
-		x = _x; ++y;
+		x = _x;
 	} else {
 		add_loading(x, y);
 		x = _x;
 	}
-	get_color("folder-unselected", &cell);
+	get_color(COLOR_FOLDER_UNSELECTED, &cell);
 	clear_remaining(&cell, x, y, width - 1, height);
 }
 
 static void render_command(int x, int y, int width) {
 	struct tb_cell cell;
-	get_color("ex-line", &cell);
+	get_color(COLOR_EX_LINE, &cell);
 	cell.ch = ' ';
 	for (int _x = 0; _x < width; ++_x) {
 		tb_put_cell(x + _x, y, &cell);
 	}
-	tb_printf(x, y, &cell, ":%s", state->command.text);
+	int l = tb_puts(x, y, width, &cell, ":");
+	tb_puts(x + l, y, width - l, &cell, state->command.text);
 }
 
-static void render_partial_input(int x, int y, int width, const char* input) {
+static void render_partial_input(int x, int y, int width, list_t *keys) {
 	struct tb_cell cell;
-	get_color("ex-line", &cell);
+	get_color(COLOR_EX_LINE, &cell);
 	cell.ch = ' ';
 	for (int _x = 0; _x < width; ++_x) {
 		tb_put_cell(x + _x, y, &cell);
 	}
-	tb_printf(x, y, &cell, "> %s", input);
+	int l = tb_puts(x, y, width, &cell, "> ");
+	for (size_t i = 0; i < keys->length; ++i) {
+		if (i != 0) {
+			l += tb_puts(x + l, y, width - l, &cell, " ");
+		}
+		l += tb_puts(x + l, y, width - l, &cell, keys->items[i]);
+	}
 }
 
 void render_status(int x, int y, int width) {
@@ -138,75 +160,131 @@ void render_status(int x, int y, int width) {
 		return;
 	}
 
-	char *input = bind_input_buffer(state->binds);
-	if (strlen(input) > 0) {
-		render_partial_input(x, y, width, input);
-		free(input);
+	if (state->binds->keys->length > 0) {
+		render_partial_input(x, y, width, state->binds->keys);
 		return;
 	}
-	free(input);
 
 	struct account_state *account =
 		state->accounts->items[state->selected_account];
-	if (!account->status.text) return;
-
 	struct tb_cell cell;
-	get_color("status-line", &cell);
+	if (!account->status.text) {
+		/* Nothing to say, but whatever was here before has to go */
+		get_color(COLOR_STATUS_LINE, &cell);
+		clear_remaining(&cell, x, y, width, 1);
+		return;
+	}
+
+	get_color(COLOR_STATUS_LINE, &cell);
 	cell.ch = ' ';
 	if (account->status.status == ACCOUNT_ERROR) {
-		get_color("status-line-error", &cell);
+		get_color(COLOR_STATUS_LINE_ERROR, &cell);
 	}
 	for (int _x = 0; _x < width; ++_x) {
 		tb_put_cell(x + _x, y, &cell);
 	}
 	if (account->status.status == ACCOUNT_OKAY) {
-		tb_printf(x, y, &cell, "%s -- %s",
-				account->selected,
-				account->status.text);
+		struct aerc_mailbox *mbox = get_aerc_mailbox(account, account->selected);
+		const char *name = mbox ? mbox->display_name : account->selected;
+		int l = tb_puts(x, y, width, &cell, name ? name : "");
+		l += tb_puts(x + l, y, width - l, &cell, " -- ");
+		tb_puts(x + l, y, width - l, &cell, account->status.text);
 	} else {
-		tb_printf(x, y, &cell, "%s", account->status.text);
+		tb_puts(x, y, width, &cell, account->status.text);
 	}
 }
 
-void render_item(int x, int y, int width, int height,
-		struct aerc_message *message, bool selected) {
+bool render_item(int x, int y, int width, int height,
+		struct aerc_mailbox *mailbox, struct aerc_message *message,
+		size_t number, bool selected, int depth) {
+	/*
+	 * Everything shown here comes from the mailbox's columns. The message
+	 * itself only tells us whether it still needs to be fetched.
+	 */
+	static struct tb_cell *cells = NULL;
+	static int cells_capacity = 0;
 	struct tb_cell cell;
-	get_color("message-list-unselected", &cell);
-	if (!message || !message->fetched) {
+	get_color(COLOR_MESSAGE_LIST_UNSELECTED, &cell);
+	struct message_columns *columns = mailbox->columns;
+	size_t row = message && message->fetched && columns ?
+		message_columns_row(columns, message->uid) : COLUMNS_NONE;
+	if (row == COLUMNS_NONE) {
 		add_loading(x, y);
-		if (message) {
-			message->should_fetch = true;
+		return true;
+	}
+	bool seen = columns->flags[row] & FLAG_SEEN;
+	if (selected) {
+		get_color(COLOR_MESSAGE_LIST_SELECTED, &cell);
+		if (!seen) {
+			get_color(COLOR_MESSAGE_LIST_SELECTED_UNREAD, &cell);
 		}
 	} else {
-		bool seen = get_message_flag(message, "\\Seen");
-		if (selected) {
-			get_color("message-list-selected", &cell);
-			if (!seen) {
-				get_color("message-list-selected-unread", &cell);
-			}
-		} else {
-			get_color("message-list-unselected", &cell);
-			if (!seen) {
-				get_color("message-list-unselcted-unread", &cell);
-			}
+		get_color(COLOR_MESSAGE_LIST_UNSELECTED, &cell);
+		if (!seen) {
+			get_color(COLOR_MESSAGE_LIST_UNSELECTED_UNREAD, &cell);
 		}
-		char date[64];
-		strftime(date, sizeof(date), config->ui.timestamp_format,
-				message->internal_date);
-		const char *subject = get_message_header(message, "Subject");
-		int l = tb_printf(x, y, &cell, "%s %s", date, subject);
-		if (selected) {
-			get_color("message-list-selected", &cell);
-		} else {
-			get_color("message-list-unselected", &cell);
-		}
-		clear_remaining(&cell, x + l, y, width - l, 1);
 	}
+	if (width <= 0) {
+		return false;
+	}
+	/* The row is built in a buffer that lives as long as we do */
+	if (width > cells_capacity) {
+		cells = realloc(cells, sizeof(struct tb_cell) * width);
+		cells_capacity = width;
+	}
+	struct index_row index_row = {
+		.number = number,
+		.date = columns->dates[row],
+		.date_text = columns->date_texts[row],
+		.date_text_size = COLUMNS_DATE_MAX,
+		.size = columns->sizes[row],
+		.flags = columns->flags[row],
+		.subject = message_columns_subject(columns, row),
+		.from = message_columns_from(columns, row),
+		.subject_width = columns->subject_widths[row],
+		.depth = depth,
+	};
+	int l = render_index_format(config->ui.index, &index_row,
+			&cell, cells, width);
+	if (selected) {
+		get_color(COLOR_MESSAGE_LIST_SELECTED, &cell);
+	} else {
+		get_color(COLOR_MESSAGE_LIST_UNSELECTED, &cell);
+	}
+	cell.ch = ' ';
+	for (int i = l; i < width; ++i) {
+		cells[i] = cell;
+	}
+	tb_blit(x, y, width, 1, cells);
+	return false;
+}
+
+static void add_missing(uidset_t **missing, long n) {
+	/* Picked up by fetch_necessary once the frame is drawn */
+	if (!*missing) {
+		*missing = create_uidset();
+	}
+	uidset_add(*missing, n);
+}
+
+static uint64_t date_stamp(void) {
+	/*
+	 * Formatted dates are cached until the format changes, or the day does,
+	 * since formats can show how long ago something was.
+	 */
+	uint64_t stamp = 14695981039346656037ULL;
+	for (const char *c = config->ui.timestamp_format; *c; ++c) {
+		stamp = (stamp ^ (unsigned char)*c) * 1099511628211ULL;
+	}
+	struct tm local;
+	time_t now = time(NULL);
+	localtime_r(&now, &local);
+	return stamp ^ ((uint64_t)local.tm_year << 9 | local.tm_yday);
 }
 
 void render_items(int x, int y, int width, int height) {
 	struct tb_cell cell;
-	get_color("message-list-unselected", &cell);
+	get_color(COLOR_MESSAGE_LIST_UNSELECTED, &cell);
 	clear_remaining(&cell, x, y, width, height);
 
 	struct account_state *account =
@@ -217,12 +295,97 @@ void render_items(int x, int y, int width, int height) {
 		add_loading(x + width / 2, y);
 		return;
 	}
+	if (mailbox->columns) {
+		message_columns_date_stamp(mailbox->columns, date_stamp());
+	}
+
+	if (account->ui.sort) {
+		/*
+		 * Rows follow the server-provided sort order. Messages we haven't
+		 * loaded yet are rendered as loading indicators.
+		 */
+		for (size_t row = account->ui.list_offset;
+				row < account->ui.row_count && y <= height; ++row) {
+			long uid = account->ui.rows[row];
+			struct aerc_message *message =
+				get_aerc_message_by_uid(mailbox, uid);
+			if (render_item(x, y++, width, height, mailbox, message,
+					row + 1, row == account->ui.selected_message,
+					account->ui.depths ? account->ui.depths[row] : 0)) {
+				add_missing(&account->ui.missing_uids, uid);
+			}
+		}
+		return;
+	}
 
-	int selected = mailbox->messages->length - account->ui.selected_message - 1;
-	for (int i = mailbox->messages->length - account->ui.list_offset - 1;
+	int selected = mailbox->messages->count - account->ui.selected_message - 1;
+	for (int i = mailbox->messages->count - account->ui.list_offset - 1;
 			i >= 0 && y <= height;
 			--i, ++y) {
-		struct aerc_message *message = mailbox->messages->items[i];
-		render_item(x, y, width, height, message, selected == i);
+		struct aerc_message *message = seqmap_get(mailbox->messages, i + 1);
+		if (render_item(x, y, width, height, mailbox, message,
+				mailbox->messages->count - i, selected == i, 0)) {
+			add_missing(&account->ui.missing, i + 1);
+		}
+	}
+}
+
+void render_rows(int x, int y, int width, int height, const uidset_t *rows) {
+	/*
+	 * Redraws just the given rows of the message list, counted from the top
+	 * of the list, where they're on screen.
+	 */
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	struct aerc_mailbox *mailbox = get_aerc_mailbox(account, account->selected);
+	if (!mailbox || !mailbox->messages) {
+		return;
+	}
+	if (mailbox->columns) {
+		message_columns_date_stamp(mailbox->columns, date_stamp());
+	}
+	struct tb_cell cell;
+	size_t offset = account->ui.list_offset;
+	for (size_t i = 0; i < rows->length; ++i) {
+		for (long row = rows->ranges[i].min;
+				row <= rows->ranges[i].max; ++row) {
+			if ((size_t)row < offset) {
+				continue;
+			}
+			int _y = y + (row - offset);
+			if (_y > height) {
+				return;
+			}
+			struct aerc_message *message;
+			size_t seq = 0; // Unsorted rows only
+			int depth = 0;
+			if (account->ui.sort) {
+				if ((size_t)row >= account->ui.row_count) {
+					continue;
+				}
+				message = get_aerc_message_by_uid(mailbox,
+						account->ui.rows[row]);
+				depth = account->ui.depths ? account->ui.depths[row] : 0;
+			} else {
+				if ((size_t)row >= mailbox->messages->count) {
+					continue;
+				}
+				seq = mailbox->messages->count - row;
+				message = seqmap_get(mailbox->messages, seq);
+			}
+			/* Rows still loading don't cover what was there before */
+			remove_loading(x, _y, width, 1);
+			get_color(COLOR_MESSAGE_LIST_UNSELECTED, &cell);
+			clear_remaining(&cell, x, _y, width, 1);
+			if (render_item(x, _y, width, height, mailbox, message, row + 1,
+					(size_t)row == account->ui.selected_message, depth)) {
+				if (account->ui.sort) {
+					add_missing(&account->ui.missing_uids,
+							account->ui.rows[row]);
+				} else {
+					add_missing(&account->ui.missing, seq);
+				}
+			}
+		}
 	}
 }
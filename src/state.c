@@ -5,12 +5,15 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include "email/columns.h"
 #include "email/headers.h"
 #include "config.h"
 #include "state.h"
 #include "ui.h"
 #include "util/stringop.h"
 #include "util/list.h"
+#include "util/utf7.h"
+#include "util/wcwidth.h"
 #include "worker.h"
 
 void set_status(struct account_state *account, enum account_status state,
@@ -22,57 +25,287 @@ void set_status(struct account_state *account, enum account_status state,
 	account->status.text = strdup(text);
 	account->status.status = state;
 	clock_gettime(CLOCK_MONOTONIC, &account->status.since);
-	rerender(); // TODO: just rerender the status bar
+	/* The account bar shows accounts in error */
+	damage(DAMAGE_STATUS | DAMAGE_ACCOUNT_BAR);
 }
 
-static int get_mbox_compare(const void *_mbox, const void *_name) {
-	const struct aerc_mailbox *mbox = _mbox;
-	const char *name = _name;
-	return strcmp(mbox->name, name);
+static int compare_names(const char *a, const char *b, char delimiter) {
+	/*
+	 * Like strcmp, except the delimiter sorts before anything else, so that
+	 * every folder is followed directly by its children: "A", "A/b", "A b".
+	 */
+	for (; *a == *b; ++a, ++b) {
+		if (!*a) {
+			return 0;
+		}
+	}
+	int ca = *a == delimiter && *a ? 1 : (unsigned char)*a;
+	int cb = *b == delimiter && *b ? 1 : (unsigned char)*b;
+	return ca - cb;
 }
 
-struct aerc_mailbox *get_aerc_mailbox(struct account_state *account,
-		const char *name) {
+static bool is_descendant(const struct aerc_mailbox *mbox,
+		const struct aerc_mailbox *parent) {
+	size_t len = strlen(parent->name);
+	return parent->delimiter
+		&& strncmp(mbox->name, parent->name, len) == 0
+		&& mbox->name[len] == parent->delimiter;
+}
+
+static size_t find_mailbox(list_t *mailboxes, const char *name, bool *found) {
+	/* Where name is in the list, or where it would go */
+	size_t min = 0, max = mailboxes->length;
+	while (min < max) {
+		size_t mid = min + (max - min) / 2;
+		const struct aerc_mailbox *mbox = mailboxes->items[mid];
+		int cmp = compare_names(mbox->name, name, mbox->delimiter);
+		if (cmp == 0) {
+			*found = true;
+			return mid;
+		}
+		if (cmp < 0) {
+			min = mid + 1;
+		} else {
+			max = mid;
+		}
+	}
+	*found = false;
+	return min;
+}
+
+int get_aerc_mailbox_index(struct account_state *account, const char *name) {
 	if (!account->mailboxes || !name) {
-		return NULL;
+		return -1;
 	}
-	int i = list_seq_find(account->mailboxes, get_mbox_compare, name);
+	bool found;
+	size_t i = find_mailbox(account->mailboxes, name, &found);
+	return found ? (int)i : -1;
+}
+
+struct aerc_mailbox *get_aerc_mailbox(struct account_state *account,
+		const char *name) {
+	int i = get_aerc_mailbox_index(account, name);
 	if (i == -1) {
 		return NULL;
 	}
 	return account->mailboxes->items[i];
 }
 
+static void prepare_mailbox(struct aerc_mailbox *mbox) {
+	/*
+	 * The folder list draws these for every folder on every redraw, so
+	 * they're worked out once. Names that aren't valid modified UTF-7 are
+	 * shown as they are.
+	 */
+	free(mbox->display_name);
+	mbox->display_name = utf7_decode(mbox->name);
+	if (!mbox->display_name) {
+		mbox->display_name = strdup(mbox->name);
+	}
+	mbox->leaf = mbox->display_name;
+	mbox->depth = 0;
+	if (mbox->delimiter) {
+		for (const char *c = mbox->display_name; *c; ++c) {
+			if (*c == mbox->delimiter && c[1]) {
+				mbox->leaf = c + 1;
+				++mbox->depth;
+			}
+		}
+	}
+	mbox->leaf_width = utf8_width(mbox->leaf, strlen(mbox->leaf));
+	mbox->has_children = get_mailbox_flag(mbox, "\\HasChildren");
+}
+
+static int compare_mailboxes(const void *_a, const void *_b) {
+	const struct aerc_mailbox *a = *(void **)_a;
+	const struct aerc_mailbox *b = *(void **)_b;
+	return compare_names(a->name, b->name, a->delimiter);
+}
+
+void invalidate_folder_rows(struct account_state *account) {
+	free(account->ui.folder_rows);
+	account->ui.folder_rows = NULL;
+	account->ui.folder_count = 0;
+}
+
+const size_t *get_folder_rows(struct account_state *account, size_t *count) {
+	if (!account->ui.folder_rows) {
+		list_t *mailboxes = account->mailboxes;
+		size_t length = mailboxes ? mailboxes->length : 0;
+		size_t *rows = malloc(sizeof(size_t) * (length + 1));
+		size_t n = 0;
+		for (size_t i = 0; i < length; ++i) {
+			struct aerc_mailbox *mbox = mailboxes->items[i];
+			rows[n++] = i;
+			if (mbox->expanded) {
+				continue;
+			}
+			/* Children come straight after their parent */
+			while (i + 1 < length
+					&& is_descendant(mailboxes->items[i + 1], mbox)) {
+				++i;
+			}
+		}
+		account->ui.folder_rows = rows;
+		account->ui.folder_count = n;
+	}
+	*count = account->ui.folder_count;
+	return account->ui.folder_rows;
+}
+
+long get_folder_row(struct account_state *account, size_t index) {
+	size_t count;
+	const size_t *rows = get_folder_rows(account, &count);
+	size_t min = 0, max = count;
+	while (min < max) {
+		size_t mid = min + (max - min) / 2;
+		if (rows[mid] == index) {
+			return mid;
+		}
+		if (rows[mid] < index) {
+			min = mid + 1;
+		} else {
+			max = mid;
+		}
+	}
+	return -1;
+}
+
+void set_aerc_mailboxes(struct account_state *account, list_t *mailboxes) {
+	if (account->mailboxes) {
+		for (size_t i = 0; i < account->mailboxes->length; ++i) {
+			free_aerc_mailbox(account->mailboxes->items[i]);
+		}
+		list_free(account->mailboxes);
+	}
+	list_qsort(mailboxes, compare_mailboxes);
+	for (size_t i = 0; i < mailboxes->length; ++i) {
+		prepare_mailbox(mailboxes->items[i]);
+	}
+	account->mailboxes = mailboxes;
+	account->ui.folder_offset = 0;
+	invalidate_folder_rows(account);
+}
+
+void put_aerc_mailbox(struct account_state *account,
+		struct aerc_mailbox *mbox) {
+	if (!account->mailboxes) {
+		account->mailboxes = create_list();
+	}
+	bool found;
+	size_t i = find_mailbox(account->mailboxes, mbox->name, &found);
+	if (!found) {
+		prepare_mailbox(mbox);
+		list_insert(account->mailboxes, i, mbox);
+		invalidate_folder_rows(account);
+		return;
+	}
+	struct aerc_mailbox *old = account->mailboxes->items[i];
+	/* Nothing the folder list shows changes with an update */
+	mbox->display_name = old->display_name;
+	mbox->leaf = old->leaf;
+	mbox->leaf_width = old->leaf_width;
+	mbox->depth = old->depth;
+	mbox->has_children = old->has_children;
+	mbox->expanded = old->expanded;
+	mbox->children_listed = old->children_listed;
+	if (!mbox->delimiter) {
+		mbox->delimiter = old->delimiter;
+	}
+	old->display_name = NULL;
+	account->mailboxes->items[i] = mbox;
+	free_aerc_mailbox(old);
+}
+
+void remove_aerc_mailbox(struct account_state *account, const char *name) {
+	int i = get_aerc_mailbox_index(account, name);
+	if (i == -1) {
+		return;
+	}
+	struct aerc_mailbox *mbox = account->mailboxes->items[i];
+	list_del(account->mailboxes, i);
+	free_aerc_mailbox(mbox);
+	invalidate_folder_rows(account);
+}
+
 void free_aerc_mailbox(struct aerc_mailbox *mbox) {
 	if (!mbox) return;
 	free(mbox->name);
+	free(mbox->display_name);
 	free_flat_list(mbox->flags);
-	// TODO: Free messages
+	if (mbox->messages) {
+		size_t cursor = 0;
+		void *msg;
+		while (seqmap_iter(mbox->messages, &cursor, &msg)) {
+			free_aerc_message(msg);
+		}
+		seqmap_free(mbox->messages);
+	}
+	message_columns_free(mbox->columns);
 	free(mbox);
 }
 
 void free_aerc_message(struct aerc_message *msg) {
 	if (!msg) return;
-	free_flat_list(msg->flags);
-	if (msg->headers) {
-		for (size_t i = 0; i < msg->headers->length; ++i) {
-			struct email_header *header = msg->headers->items[i];
-			free(header->key);
-			free(header->value);
+	free_headers(msg->headers);
+	free(msg);
+}
+
+void reset_message_view(struct account_state *account) {
+	/*
+	 * Called when the selected mailbox changes, since search results and sort
+	 * orders are specific to one mailbox.
+	 */
+	uidset_free(account->ui.search);
+	account->ui.search = NULL;
+	uidset_t *pending[] = {
+		account->ui.missing, account->ui.missing_uids,
+		account->ui.requested_uids,
+	};
+	for (size_t i = 0; i < sizeof(pending) / sizeof(pending[0]); ++i) {
+		if (pending[i]) {
+			pending[i]->length = 0;
 		}
 	}
-	free_flat_list(msg->headers);
-	free(msg);
+	set_sort(account, NULL, NULL);
 }
 
-const char *get_message_header(struct aerc_message *msg, char *key) {
-	for (size_t i = 0; i < msg->headers->length; ++i) {
-		struct email_header *header = msg->headers->items[i];
-		if (strcmp(header->key, key) == 0) {
-			return header->value;
+void set_sort(struct account_state *account, uidset_t *sort, int *depths) {
+	uidset_free(account->ui.sort);
+	free(account->ui.depths);
+	account->ui.sort = sort;
+	account->ui.depths = depths;
+	account->ui.selected_message = account->ui.list_offset = 0;
+	index_sort_rows(account);
+}
+
+void index_sort_rows(struct account_state *account) {
+	uidset_t *sort = account->ui.sort;
+	free(account->ui.rows);
+	account->ui.rows = NULL;
+	account->ui.row_count = 0;
+	if (!sort) {
+		return;
+	}
+	account->ui.rows = malloc(sizeof(long) * (uidset_count(sort) + 1));
+	size_t n = 0;
+	for (size_t i = 0; i < sort->length; ++i) {
+		const struct uid_range *range = &sort->ranges[i];
+		for (long k = 0; k <= range->max - range->min; ++k) {
+			account->ui.rows[n++] = uid_range_at(range, k);
 		}
 	}
-	return NULL;
+	account->ui.row_count = n;
+}
+
+struct aerc_message *get_aerc_message_by_uid(struct aerc_mailbox *mbox,
+		long uid) {
+	if (!mbox || !mbox->messages) return NULL;
+	return seqmap_find(mbox->messages, uid);
+}
+
+const char *get_message_header(struct aerc_message *msg, char *key) {
+	return msg->headers ? get_header(msg->headers, key) : NULL;
 }
 
 bool get_mailbox_flag(struct aerc_mailbox *mbox, char *flag) {
@@ -86,15 +319,55 @@ bool get_mailbox_flag(struct aerc_mailbox *mbox, char *flag) {
 	return false;
 }
 
-bool get_message_flag(struct aerc_message *msg, char *flag) {
-	if (!msg->flags) return false;
-	for (size_t i = 0; i < msg->flags->length; ++i) {
-		const char *_flag = msg->flags->items[i];
-		if (strcmp(flag, _flag) == 0) {
-			return true;
+void update_message_columns(struct aerc_mailbox *mbox,
+		struct aerc_message *msg) {
+	if (!msg->fetched || !msg->uid) {
+		return;
+	}
+	const char *subject = NULL, *from = NULL;
+	int64_t sent_date = 0;
+	if (msg->headers) {
+		subject = header_text(msg->headers, HEADER_SUBJECT);
+		from = header_text(msg->headers, HEADER_FROM);
+		sent_date = parse_header_date(msg->headers->fields[HEADER_DATE]);
+	}
+	if (!mbox->columns) {
+		mbox->columns = create_message_columns();
+	}
+	message_columns_set(mbox->columns, msg->uid, msg->flags,
+			msg->internal_date, sent_date, msg->size, subject, from);
+}
+
+uidset_t *set_message_flags(struct aerc_mailbox *mbox, const uidset_t *uids,
+		flagset_t flags, bool set) {
+	uidset_t *changed = create_uidset();
+	for (size_t i = 0; mbox && i < uids->length; ++i) {
+		for (long uid = uids->ranges[i].min; uid <= uids->ranges[i].max; ++uid) {
+			struct aerc_message *msg = seqmap_find(mbox->messages, uid);
+			if (!msg || !msg->fetched) {
+				continue;
+			}
+			flagset_t updated = set ? msg->flags | flags : msg->flags & ~flags;
+			if (updated != msg->flags) {
+				msg->flags = updated;
+				uidset_add(changed, uid);
+				size_t row = mbox->columns ?
+					message_columns_row(mbox->columns, uid) : COLUMNS_NONE;
+				if (row != COLUMNS_NONE) {
+					mbox->columns->flags[row] = updated;
+				}
+			}
 		}
 	}
-	return false;
+	return changed;
+}
+
+void free_flag_request(struct flag_request *request) {
+	if (!request) return;
+	uidset_free(request->uids);
+	uidset_free(request->changed);
+	uidset_free(request->failed);
+	free(request);
 }
 
 struct account_config *config_for_account(const char *name) {
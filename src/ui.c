@@ -7,6 +7,7 @@
 #include <termbox.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "util/stringop.h"
 #include "util/list.h"
@@ -15,109 +16,214 @@
 #include "colors.h"
 #include "state.h"
 #include "render.h"
+#include "handlers.h"
+#include "log.h"
 #include "util/list.h"
 #include "util/stringop.h"
+#include "util/spinners.h"
+#include "util/uidset.h"
+#include "util/wcwidth.h"
 #include "ui.h"
 
 int frame = 0;
 
-struct loading_indicator {
-	int x, y;
-};
+static spinners_t *loading_indicators = NULL;
+static int drawn_step = -1; // The loading animation frame on screen
 
-list_t *loading_indicators = NULL;
+static struct timespec started;
+static double last_frame = 0;
+static struct frame_stats stats = { 0 };
+
+static double elapsed() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - started.tv_sec)
+		+ (now.tv_nsec - started.tv_nsec) / 1e9;
+}
 
 void init_ui() {
 	tb_init();
 	tb_select_input_mode(TB_INPUT_ESC | TB_INPUT_MOUSE);
+	loading_indicators = create_spinners();
+	clock_gettime(CLOCK_MONOTONIC, &started);
 }
 
 void teardown_ui() {
 	tb_shutdown();
+	spinners_free(loading_indicators);
 }
 
-int tb_printf(int x, int y, struct tb_cell *basis, const char *fmt, ...) {
-	va_list args;
-	va_start(args, fmt);
-	int len = vsnprintf(NULL, 0, fmt, args);
-	va_end(args);
-
-	char *buf = malloc(len + 1);
-	va_start(args, fmt);
-	vsnprintf(buf, len + 1, fmt, args);
-	va_end(args);
-
+int tb_puts(int x, int y, int width, struct tb_cell *basis, const char *text) {
+	/*
+	 * Decodes and draws in one pass. Anything past width on a line is
+	 * skipped, up to the next newline. Wide characters take two cells, the
+	 * second of which termbox skips when it draws the first, and zero-width
+	 * ones are left out, since termbox can't combine them.
+	 */
 	int l = 0;
 	int _x = x, _y = y;
-	char *b = buf;
-	while (*b) {
-		b += tb_utf8_char_to_unicode(&basis->ch, b);
-		++l;
+	bool clipped = false;
+	const char *t = text, *end = text + strlen(text);
+	while (t < end) {
+		size_t n;
+		basis->ch = next_codepoint(t, end - t, &n);
+		t += n;
 		switch (basis->ch) {
 		case '\n':
 			_x = x;
 			_y++;
+			clipped = false;
 			break;
 		case '\r':
 			_x = x;
+			clipped = false;
 			break;
-		default:
+		default:;
+			int w = codepoint_width(basis->ch);
+			if (w == 0 || clipped) {
+				break;
+			}
+			if (width >= 0 && _x - x + w > width) {
+				clipped = true;
+				break;
+			}
 			tb_put_cell(_x, _y, basis);
-			_x++;
+			if (w == 2) {
+				uint32_t ch = basis->ch;
+				basis->ch = ' ';
+				tb_put_cell(_x + 1, _y, basis);
+				basis->ch = ch;
+			}
+			_x += w;
+			l += w;
 			break;
 		}
 	}
-
-	free(buf);
 	return l;
 }
 
-static void need_rerender() {
-	state->rerender = true;
+int tb_printf(int x, int y, struct tb_cell *basis, const char *fmt, ...) {
+	/*
+	 * Almost everything we draw fits on the stack. Longer text is formatted
+	 * into a buffer that's kept for next time, so drawing doesn't allocate
+	 * once it has grown to fit.
+	 */
+	static char *scratch = NULL;
+	static size_t scratch_size = 0;
+	char buf[256];
+	char *text = buf;
+
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	if (len < 0) {
+		return 0;
+	}
+	if ((size_t)len >= sizeof(buf)) {
+		if ((size_t)len >= scratch_size) {
+			scratch_size = len + 1;
+			scratch = realloc(scratch, scratch_size);
+		}
+		va_start(args, fmt);
+		vsnprintf(scratch, len + 1, fmt, args);
+		va_end(args);
+		text = scratch;
+	}
+	return tb_puts(x, y, -1, basis, text);
 }
 
-void rerender() {
-	free_flat_list(loading_indicators);
-	loading_indicators = create_list();
+/* The message list sits to the right of the folders, between the bars */
+static const int folder_width = 20;
 
-	tb_clear();
-	int width = tb_width(), height = tb_height();
-	int folder_width = 20;
+/* What has to be redrawn at the end of this tick */
+static unsigned damaged = 0;
+static uidset_t *damaged_rows = NULL;
 
-	render_account_bar(0, 0, width, folder_width);
-	render_folder_list(0, 1, folder_width, height);
-	render_status(folder_width, height - 1, width - folder_width);
-	render_items(folder_width, 1, width - folder_width, height - 2);
+void damage(unsigned regions) {
+	damaged |= regions;
+}
 
-	if (state->command.text) {
-		tb_set_cursor(folder_width + strlen(state->command.text) + 1, height - 1);
-	} else {
-		tb_set_cursor(TB_HIDE_CURSOR, TB_HIDE_CURSOR);
+void damage_row(size_t row) {
+	if (!damaged_rows) {
+		damaged_rows = create_uidset();
 	}
-	tb_present();
+	uidset_add(damaged_rows, row);
 }
 
-void rerender_item(size_t index) {
+void damage_message(size_t index) {
 	struct account_state *account =
 		state->accounts->items[state->selected_account];
 	struct aerc_mailbox *mailbox = get_aerc_mailbox(account, account->selected);
-	if (index >= mailbox->messages->length) return;
-	int folder_width = 20;
-	int width = tb_width(), height = tb_height();
-	int x = folder_width, y = mailbox->messages->length - account->ui.list_offset - index;
-	struct aerc_message *message = mailbox->messages->items[index];
-	if (!message) return;
-	size_t selected = mailbox->messages->length - account->ui.selected_message - 1;
-	// TODO: Consider scrolling
-	for (size_t i = 0; i < loading_indicators->length; ++i) {
-		struct loading_indicator *indic = loading_indicators->items[i];
-		if (indic->x == x && indic->y == y) {
-			list_del(loading_indicators, i);
-			break;
+	if (!mailbox || !mailbox->messages) return;
+	if (index >= mailbox->messages->count) return;
+	if (account->ui.sort) {
+		/* The row isn't derived from the index, so just redraw the list */
+		damage(DAMAGE_MESSAGES);
+		return;
+	}
+	damage_row(mailbox->messages->count - index - 1);
+}
+
+void rerender() {
+	damage(DAMAGE_ALL);
+}
+
+int message_list_height() {
+	return tb_height() - 2;
+}
+
+static void scroll_list(int x, int y, int w, int h, int dy) {
+	/*
+	 * termbox can't scroll the terminal, but it only sends the cells that
+	 * changed, so we move what's on screen in its back buffer instead of
+	 * drawing it all again.
+	 */
+	struct tb_cell *cells = tb_cell_buffer();
+	int stride = tb_width();
+	if (!cells || w <= 0) {
+		return;
+	}
+	size_t size = sizeof(struct tb_cell) * w;
+	if (dy > 0) {
+		for (int _y = y; _y < y + h - dy; ++_y) {
+			memmove(&cells[_y * stride + x],
+					&cells[(_y + dy) * stride + x], size);
+		}
+	} else {
+		for (int _y = y + h - 1; _y >= y - dy; --_y) {
+			memmove(&cells[_y * stride + x],
+					&cells[(_y + dy) * stride + x], size);
 		}
 	}
-	render_item(x, y, width - folder_width, height - 2, message, selected == index);
-	tb_present();
+	spinners_scroll(loading_indicators, x, y, w, h, dy);
+}
+
+void show_row(size_t row) {
+	struct account_state *account =
+		state->accounts->items[state->selected_account];
+	int height = message_list_height();
+	size_t visible = height > 0 ? (size_t)height : 1;
+	size_t offset = account->ui.list_offset;
+	if (row < offset) {
+		offset = row;
+	} else if (row >= offset + visible) {
+		offset = row - visible + 1;
+	} else {
+		return;
+	}
+	long dy = (long)offset - (long)account->ui.list_offset;
+	account->ui.list_offset = offset;
+	if ((damaged & DAMAGE_MESSAGES) || labs(dy) >= (long)visible) {
+		damage(DAMAGE_MESSAGES);
+		return;
+	}
+	scroll_list(folder_width, 1, tb_width() - folder_width, visible, dy);
+	/* Only the rows that scrolled into view need drawing */
+	size_t first = dy > 0 ? offset + visible - dy : offset;
+	for (size_t r = first; r < first + labs(dy); ++r) {
+		damage_row(r);
+	}
 }
 
 static void render_loading(int x, int y) {
@@ -125,20 +231,113 @@ static void render_loading(int x, int y) {
 	if (config->ui.loading_frames->length == 0) {
 		return;
 	}
-	get_color("loading-indicator", &cell);
+	get_color(COLOR_LOADING_INDICATOR, &cell);
 	int f = frame / 8 % config->ui.loading_frames->length;
 	tb_printf(x, y, &cell, "%s   ",
 			(const char *)config->ui.loading_frames->items[f]);
 }
 
+static void time_region(enum frame_region region, double *since) {
+	double now = elapsed();
+	double spent = now - *since;
+	stats.regions[region] += spent;
+	if (spent > stats.worst_regions[region]) {
+		stats.worst_regions[region] = spent;
+	}
+	*since = now;
+}
+
+static void render_frame() {
+	int width = tb_width(), height = tb_height();
+	double start = elapsed(), since = start;
+
+	if ((damaged & DAMAGE_ALL) == DAMAGE_ALL) {
+		spinners_clear(loading_indicators);
+		tb_clear();
+	}
+	if (damaged & DAMAGE_ACCOUNT_BAR) {
+		remove_loading(0, 0, width, 1);
+		render_account_bar(0, 0, width, folder_width);
+		time_region(FRAME_ACCOUNT_BAR, &since);
+	}
+	if (damaged & DAMAGE_FOLDERS) {
+		remove_loading(0, 1, folder_width, height - 1);
+		render_folder_list(0, 1, folder_width, height);
+		time_region(FRAME_FOLDERS, &since);
+	}
+	if (damaged & DAMAGE_STATUS) {
+		remove_loading(folder_width, height - 1, width - folder_width, 1);
+		render_status(folder_width, height - 1, width - folder_width);
+		time_region(FRAME_STATUS, &since);
+	}
+	if (damaged & DAMAGE_MESSAGES) {
+		remove_loading(folder_width, 1, width - folder_width, height - 2);
+		render_items(folder_width, 1, width - folder_width, height - 2);
+		time_region(FRAME_MESSAGES, &since);
+	} else if (damaged_rows && damaged_rows->length) {
+		render_rows(folder_width, 1, width - folder_width, height - 2,
+				damaged_rows);
+		time_region(FRAME_MESSAGES, &since);
+	}
+	/* Indicators drawn this frame are already up to date */
+	if (frame / 8 != drawn_step) {
+		drawn_step = frame / 8;
+		size_t cursor = 0;
+		int x, y;
+		while (spinners_iter(loading_indicators, &cursor, &x, &y)) {
+			render_loading(x, y);
+		}
+	}
+
+	if (state->command.text) {
+		tb_set_cursor(folder_width + strlen(state->command.text) + 1, height - 1);
+	} else {
+		tb_set_cursor(TB_HIDE_CURSOR, TB_HIDE_CURSOR);
+	}
+	tb_present();
+	time_region(FRAME_PRESENT, &since);
+
+	/* Drawing the list is what tells us which messages are still missing */
+	bool drew_messages = (damaged & DAMAGE_MESSAGES)
+		|| (damaged_rows && damaged_rows->length);
+	damaged = 0;
+	if (damaged_rows) {
+		damaged_rows->length = 0;
+	}
+	if (drew_messages) {
+		struct account_state *account =
+			state->accounts->items[state->selected_account];
+		struct aerc_mailbox *mailbox =
+			get_aerc_mailbox(account, account->selected);
+		if (mailbox) {
+			fetch_necessary(account, mailbox);
+		}
+	}
+
+	double spent = since - start;
+	++stats.frames;
+	stats.total += spent;
+	if (spent > stats.worst) {
+		stats.worst = spent;
+	}
+	if (config->ui.max_fps > 0 && spent > 1.0 / config->ui.max_fps) {
+		worker_log(L_DEBUG, "Slow frame: %.1f ms", spent * 1000);
+	}
+}
+
+const struct frame_stats *get_frame_stats() {
+	return &stats;
+}
+
 void add_loading(int x, int y) {
-	struct loading_indicator *indic = calloc(1, sizeof(struct loading_indicator));
-	indic->x = x;
-	indic->y = y;
-	list_add(loading_indicators, indic);
+	spinners_add(loading_indicators, x, y);
 	render_loading(x, y);
 }
 
+void remove_loading(int x, int y, int w, int h) {
+	spinners_remove(loading_indicators, x, y, w, h);
+}
+
 static void command_input(uint16_t ch) {
 	size_t size = tb_utf8_char_length(ch);
 	size_t len = strlen(state->command.text);
@@ -149,13 +348,13 @@ static void command_input(uint16_t ch) {
 	}
 	memcpy(state->command.text + len, &ch, size);
 	state->command.text[len + size] = '\0';
-	need_rerender();
+	damage(DAMAGE_STATUS);
 }
 
 static void abort_command() {
 	free(state->command.text);
 	state->command.text = NULL;
-	need_rerender();
+	damage(DAMAGE_STATUS);
 }
 
 static void command_backspace() {
@@ -164,7 +363,7 @@ static void command_backspace() {
 		return;
 	}
 	state->command.text[len - 1] = '\0';
-	need_rerender();
+	damage(DAMAGE_STATUS);
 }
 
 static void command_delete_word() {
@@ -177,7 +376,7 @@ static void command_delete_word() {
 	while (cmd != state->command.text && !isspace(*cmd)) --cmd;
 	if (cmd != state->command.text) ++cmd;
 	*cmd = '\0';
-	need_rerender();
+	damage(DAMAGE_STATUS);
 }
 
 
@@ -210,9 +409,14 @@ static struct tb_event *parse_input_command(const char *input, size_t *consumed)
 
 static void process_event(struct tb_event* event, aqueue_t *event_queue) {
 	switch (event->type) {
-	case TB_EVENT_RESIZE:
-		need_rerender();
+	case TB_EVENT_RESIZE: {
+		struct account_state *account =
+			state->accounts->items[state->selected_account];
+		damage(DAMAGE_ALL);
+		/* Keep the selection on screen if we got shorter */
+		show_row(account->ui.selected_message);
 		break;
+	}
 	case TB_EVENT_KEY:
 		if (state->command.text) {
 			switch (event->key) {
@@ -264,21 +468,17 @@ static void process_event(struct tb_event* event, aqueue_t *event_queue) {
 					}
 				}
 			}
-			need_rerender();
+			damage(DAMAGE_STATUS);
 		}
 		break;
 	}
 }
 
 bool ui_tick() {
-	if (loading_indicators->length > 1) {
-		frame++;
-		for (size_t i = 0; i < loading_indicators->length; ++i) {
-			struct loading_indicator *indic = loading_indicators->items[i];
-			render_loading(indic->x, indic->y);
-		}
-		tb_present();
-	}
+	/* Loading indicators move on every 50ms, however often we tick */
+	double now = elapsed();
+	frame = (int)(now * 20);
+	bool animate = loading_indicators->count > 0 && frame / 8 != drawn_step;
 
 	aqueue_t *events = aqueue_new();
 
@@ -307,9 +507,20 @@ bool ui_tick() {
 	}
 	aqueue_free(events);
 
-	if (state->rerender) {
-		state->rerender = false;
-		rerender();
+	/*
+	 * Whatever was damaged since the last frame is drawn at once, and no more
+	 * often than ui.max-fps allows. Anything damaged in between waits for the
+	 * next frame.
+	 */
+	bool dirty = damaged || (damaged_rows && damaged_rows->length) || animate;
+	if (dirty) {
+		int fps = config->ui.max_fps;
+		if (fps <= 0 || last_frame == 0 || now - last_frame >= 1.0 / fps) {
+			last_frame = now;
+			render_frame();
+		} else {
+			++stats.deferred;
+		}
 	}
 
 	return !state->exit;
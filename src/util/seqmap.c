@@ -0,0 +1,278 @@
+/*
+ * util/seqmap.c - maps IMAP sequence numbers to UIDs and messages
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/seqmap.h"
+
+#define EMPTY SIZE_MAX
+
+/*
+ * Fenwick tree
+ */
+
+static void tree_add(seqmap_t *map, size_t slot, long delta) {
+	for (size_t i = slot + 1; i <= map->capacity; i += i & -i) {
+		map->tree[i] += delta;
+	}
+}
+
+static size_t tree_prefix(const seqmap_t *map, size_t slot) {
+	/* Number of live slots in [0, slot] */
+	size_t sum = 0;
+	for (size_t i = slot + 1; i > 0; i -= i & -i) {
+		sum += map->tree[i];
+	}
+	return sum;
+}
+
+static size_t tree_find(const seqmap_t *map, size_t seq) {
+	/*
+	 * Returns the slot of the seq-th live message by walking down the tree,
+	 * or EMPTY if there are fewer than seq.
+	 */
+	if (seq == 0 || seq > map->count) {
+		return EMPTY;
+	}
+	size_t pos = 0, step = 1;
+	while (step * 2 <= map->capacity) {
+		step *= 2;
+	}
+	for (; step; step /= 2) {
+		if (pos + step <= map->capacity && map->tree[pos + step] < seq) {
+			pos += step;
+			seq -= map->tree[pos];
+		}
+	}
+	return pos; // pos is the 1-based index of the slot before ours
+}
+
+static void tree_build(seqmap_t *map) {
+	memset(map->tree, 0, sizeof(size_t) * (map->capacity + 1));
+	for (size_t i = 1; i <= map->capacity; ++i) {
+		if (i <= map->length && map->alive[i - 1]) {
+			map->tree[i] += 1;
+		}
+		size_t j = i + (i & -i);
+		if (j <= map->capacity) {
+			map->tree[j] += map->tree[i];
+		}
+	}
+}
+
+/*
+ * UID hash table
+ */
+
+static size_t hash_uid(long uid) {
+	uint64_t key = (uint64_t)uid;
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return (size_t)key;
+}
+
+static size_t hash_find(const seqmap_t *map, long uid) {
+	size_t mask = map->bucket_count - 1;
+	for (size_t i = hash_uid(uid) & mask; map->buckets[i] != EMPTY;
+			i = (i + 1) & mask) {
+		if (map->uids[map->buckets[i]] == uid) {
+			return i;
+		}
+	}
+	return EMPTY;
+}
+
+static void hash_insert(seqmap_t *map, size_t slot) {
+	size_t mask = map->bucket_count - 1;
+	size_t i = hash_uid(map->uids[slot]) & mask;
+	while (map->buckets[i] != EMPTY) {
+		i = (i + 1) & mask;
+	}
+	map->buckets[i] = slot;
+	map->hashed++;
+}
+
+static void hash_delete(seqmap_t *map, size_t i) {
+	/*
+	 * Linear probing deletion without tombstones: shift later entries of the
+	 * same probe sequence back into the hole.
+	 */
+	size_t mask = map->bucket_count - 1;
+	size_t j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		if (map->buckets[j] == EMPTY) {
+			break;
+		}
+		size_t home = hash_uid(map->uids[map->buckets[j]]) & mask;
+		if ((j > i && (home <= i || home > j))
+				|| (j < i && (home <= i && home > j))) {
+			map->buckets[i] = map->buckets[j];
+			i = j;
+		}
+	}
+	map->buckets[i] = EMPTY;
+	map->hashed--;
+}
+
+static void hash_build(seqmap_t *map, size_t bucket_count) {
+	free(map->buckets);
+	map->bucket_count = bucket_count;
+	map->buckets = malloc(sizeof(size_t) * bucket_count);
+	for (size_t i = 0; i < bucket_count; ++i) {
+		map->buckets[i] = EMPTY;
+	}
+	map->hashed = 0;
+	for (size_t i = 0; i < map->length; ++i) {
+		if (map->alive[i] && map->uids[i]) {
+			hash_insert(map, i);
+		}
+	}
+}
+
+/*
+ * Slots
+ */
+
+static void resize(seqmap_t *map, size_t capacity) {
+	map->capacity = capacity;
+	map->items = realloc(map->items, sizeof(void *) * capacity);
+	map->uids = realloc(map->uids, sizeof(long) * capacity);
+	map->alive = realloc(map->alive, sizeof(bool) * capacity);
+	map->tree = realloc(map->tree, sizeof(size_t) * (capacity + 1));
+	tree_build(map);
+}
+
+static void compact(seqmap_t *map) {
+	size_t n = 0;
+	for (size_t i = 0; i < map->length; ++i) {
+		if (map->alive[i]) {
+			map->items[n] = map->items[i];
+			map->uids[n] = map->uids[i];
+			map->alive[n] = true;
+			++n;
+		}
+	}
+	map->length = n;
+	tree_build(map);
+	hash_build(map, map->bucket_count);
+}
+
+static size_t slot_of(const seqmap_t *map, size_t seq) {
+	return tree_find(map, seq);
+}
+
+seqmap_t *create_seqmap(void) {
+	seqmap_t *map = calloc(1, sizeof(seqmap_t));
+	resize(map, 64);
+	hash_build(map, 64);
+	return map;
+}
+
+void seqmap_free(seqmap_t *map) {
+	if (!map) return;
+	free(map->items);
+	free(map->uids);
+	free(map->alive);
+	free(map->tree);
+	free(map->buckets);
+	free(map);
+}
+
+void seqmap_append(seqmap_t *map, void *item) {
+	if (map->length == map->capacity) {
+		if (map->length - map->count >= map->count) {
+			compact(map);
+		} else {
+			resize(map, map->capacity * 2);
+		}
+	}
+	size_t slot = map->length++;
+	map->items[slot] = item;
+	map->uids[slot] = 0;
+	map->alive[slot] = true;
+	map->count++;
+	tree_add(map, slot, 1);
+}
+
+void *seqmap_get(const seqmap_t *map, size_t seq) {
+	size_t slot = slot_of(map, seq);
+	return slot == EMPTY ? NULL : map->items[slot];
+}
+
+void seqmap_set(seqmap_t *map, size_t seq, void *item) {
+	size_t slot = slot_of(map, seq);
+	if (slot != EMPTY) {
+		map->items[slot] = item;
+	}
+}
+
+long seqmap_uid(const seqmap_t *map, size_t seq) {
+	size_t slot = slot_of(map, seq);
+	return slot == EMPTY ? 0 : map->uids[slot];
+}
+
+void seqmap_set_uid(seqmap_t *map, size_t seq, long uid) {
+	size_t slot = slot_of(map, seq);
+	if (slot == EMPTY || map->uids[slot] == uid) {
+		return;
+	}
+	if (map->uids[slot]) {
+		hash_delete(map, hash_find(map, map->uids[slot]));
+	}
+	size_t existing = uid ? hash_find(map, uid) : EMPTY;
+	if (existing != EMPTY) {
+		/* Another slot claims this UID; the server knows better */
+		map->uids[map->buckets[existing]] = 0;
+		hash_delete(map, existing);
+	}
+	map->uids[slot] = 0;
+	if (uid && (map->hashed + 1) * 2 > map->bucket_count) {
+		/* Before setting the UID, or the rebuild would hash this slot too */
+		hash_build(map, map->bucket_count * 2);
+	}
+	map->uids[slot] = uid;
+	if (uid) {
+		hash_insert(map, slot);
+	}
+}
+
+void *seqmap_find(const seqmap_t *map, long uid) {
+	size_t i = hash_find(map, uid);
+	return i == EMPTY ? NULL : map->items[map->buckets[i]];
+}
+
+size_t seqmap_seq(const seqmap_t *map, long uid) {
+	size_t i = hash_find(map, uid);
+	return i == EMPTY ? 0 : tree_prefix(map, map->buckets[i]);
+}
+
+void *seqmap_remove(seqmap_t *map, size_t seq) {
+	size_t slot = slot_of(map, seq);
+	if (slot == EMPTY) {
+		return NULL;
+	}
+	void *item = map->items[slot];
+	if (map->uids[slot]) {
+		hash_delete(map, hash_find(map, map->uids[slot]));
+	}
+	map->alive[slot] = false;
+	map->count--;
+	tree_add(map, slot, -1);
+	return item;
+}
+
+bool seqmap_iter(const seqmap_t *map, size_t *cursor, void **item) {
+	while (*cursor < map->length && !map->alive[*cursor]) {
+		++*cursor;
+	}
+	if (*cursor >= map->length) {
+		return false;
+	}
+	*item = map->items[(*cursor)++];
+	return true;
+}
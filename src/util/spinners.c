@@ -0,0 +1,168 @@
+/*
+ * util/spinners.c - tracks where loading indicators are on screen
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/spinners.h"
+
+spinners_t *create_spinners(void) {
+	return calloc(1, sizeof(spinners_t));
+}
+
+void spinners_free(spinners_t *spinners) {
+	if (!spinners) return;
+	free(spinners->active);
+	free(spinners->columns);
+	free(spinners);
+}
+
+static void grow(spinners_t *spinners, size_t rows) {
+	size_t capacity = spinners->rows ? spinners->rows : 64;
+	while (capacity <= rows) {
+		capacity *= 2;
+	}
+	size_t words = (spinners->rows + 63) / 64, new_words = (capacity + 63) / 64;
+	spinners->active = realloc(spinners->active, sizeof(uint64_t) * new_words);
+	memset(spinners->active + words, 0,
+			sizeof(uint64_t) * (new_words - words));
+	spinners->columns = realloc(spinners->columns,
+			sizeof(*spinners->columns) * capacity);
+	memset(spinners->columns + spinners->rows, 0xFF,
+			sizeof(*spinners->columns) * (capacity - spinners->rows));
+	spinners->rows = capacity;
+}
+
+static bool row_active(const spinners_t *spinners, size_t y) {
+	return y < spinners->rows && spinners->active[y / 64] & (1ULL << y % 64);
+}
+
+bool spinners_add(spinners_t *spinners, int x, int y) {
+	if (x < 0 || y < 0 || x > INT16_MAX) {
+		return false;
+	}
+	if ((size_t)y >= spinners->rows) {
+		grow(spinners, y);
+	}
+	int16_t *columns = spinners->columns[y];
+	int16_t *free_slot = NULL;
+	for (int i = 0; i < SPINNERS_PER_ROW; ++i) {
+		if (columns[i] == x) {
+			return true;
+		}
+		if (columns[i] < 0 && !free_slot) {
+			free_slot = &columns[i];
+		}
+	}
+	if (!free_slot) {
+		return false;
+	}
+	*free_slot = x;
+	spinners->active[y / 64] |= 1ULL << y % 64;
+	++spinners->count;
+	return true;
+}
+
+static void remove_row(spinners_t *spinners, size_t y, int x, int w) {
+	int16_t *columns = spinners->columns[y];
+	bool any = false;
+	for (int i = 0; i < SPINNERS_PER_ROW; ++i) {
+		if (columns[i] >= x && columns[i] < x + w) {
+			columns[i] = -1;
+			--spinners->count;
+		}
+		any = any || columns[i] >= 0;
+	}
+	if (!any) {
+		spinners->active[y / 64] &= ~(1ULL << y % 64);
+	}
+}
+
+void spinners_remove(spinners_t *spinners, int x, int y, int w, int h) {
+	if (!spinners->count) {
+		return;
+	}
+	for (int _y = y < 0 ? 0 : y; _y < y + h; ++_y) {
+		if ((size_t)_y >= spinners->rows) {
+			break;
+		}
+		if (row_active(spinners, _y)) {
+			remove_row(spinners, _y, x, w);
+		}
+	}
+}
+
+void spinners_clear(spinners_t *spinners) {
+	int x, y;
+	size_t cursor = 0;
+	while (spinners->count && spinners_iter(spinners, &cursor, &x, &y)) {
+		remove_row(spinners, y, 0, INT16_MAX + 1);
+	}
+}
+
+static void move(spinners_t *spinners, int y, int x, int w,
+		int top, int bottom, int dy) {
+	for (int i = 0; i < SPINNERS_PER_ROW; ++i) {
+		/* Adding can grow the registry, so don't hold on to the row */
+		int column = spinners->columns[y][i];
+		if (column < x || column >= x + w) {
+			continue;
+		}
+		remove_row(spinners, y, column, 1);
+		if (y - dy >= top && y - dy < bottom) {
+			spinners_add(spinners, column, y - dy);
+		}
+	}
+}
+
+void spinners_scroll(spinners_t *spinners, int x, int y, int w, int h, int dy) {
+	/* Walk away from where they're going, so none is moved twice */
+	int top = y < 0 ? 0 : y;
+	int bottom = (size_t)(y + h) > spinners->rows ? (int)spinners->rows : y + h;
+	if (dy > 0) {
+		for (int _y = top; _y < bottom; ++_y) {
+			if (row_active(spinners, _y)) {
+				move(spinners, _y, x, w, top, y + h, dy);
+			}
+		}
+	} else if (dy < 0) {
+		for (int _y = bottom - 1; _y >= top; --_y) {
+			if (row_active(spinners, _y)) {
+				move(spinners, _y, x, w, top, y + h, dy);
+			}
+		}
+	}
+}
+
+bool spinners_iter(const spinners_t *spinners, size_t *cursor, int *x, int *y) {
+	/* The cursor is the row times SPINNERS_PER_ROW plus the slot */
+	size_t row = *cursor / SPINNERS_PER_ROW;
+	size_t slot = *cursor % SPINNERS_PER_ROW;
+	while (row < spinners->rows) {
+		uint64_t word = spinners->active[row / 64] >> row % 64;
+		if (!word) {
+			row = (row / 64 + 1) * 64;
+			slot = 0;
+			continue;
+		}
+		if (!(word & 1)) {
+			row += __builtin_ctzll(word);
+			slot = 0;
+			continue;
+		}
+		for (; slot < SPINNERS_PER_ROW; ++slot) {
+			if (spinners->columns[row][slot] >= 0) {
+				*x = spinners->columns[row][slot];
+				*y = row;
+				*cursor = row * SPINNERS_PER_ROW + slot + 1;
+				return true;
+			}
+		}
+		++row;
+		slot = 0;
+	}
+	*cursor = row * SPINNERS_PER_ROW;
+	return false;
+}
@@ -0,0 +1,206 @@
+/*
+ * util/uidset.c - implements run-length encoded sets of UIDs
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/uidset.h"
+
+uidset_t *create_uidset(void) {
+	uidset_t *set = malloc(sizeof(uidset_t));
+	set->capacity = 8;
+	set->length = 0;
+	set->ranges = malloc(sizeof(struct uid_range) * set->capacity);
+	return set;
+}
+
+void uidset_free(uidset_t *set) {
+	if (set == NULL) {
+		return;
+	}
+	free(set->ranges);
+	free(set);
+}
+
+static void uidset_resize(uidset_t *set) {
+	if (set->length == set->capacity) {
+		set->capacity *= 2;
+		set->ranges = realloc(set->ranges,
+				sizeof(struct uid_range) * set->capacity);
+	}
+}
+
+static size_t uidset_lower_bound(const uidset_t *set, long uid) {
+	/*
+	 * Returns the index of the first range whose max is >= uid, or
+	 * set->length if there is none.
+	 */
+	size_t lo = 0, hi = set->length;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (set->ranges[mid].max < uid) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+void uidset_add_range(uidset_t *set, long min, long max) {
+	if (min > max) {
+		long _ = min; min = max; max = _;
+	}
+	/*
+	 * Find the first range that could touch the new one (ranges that end
+	 * exactly one before it are merged too), then swallow every range that
+	 * overlaps or is adjacent to it.
+	 */
+	size_t i = uidset_lower_bound(set, min - 1);
+	size_t j = i;
+	while (j < set->length && set->ranges[j].min <= max + 1) {
+		if (set->ranges[j].min < min) min = set->ranges[j].min;
+		if (set->ranges[j].max > max) max = set->ranges[j].max;
+		++j;
+	}
+	if (i == j) {
+		uidset_resize(set);
+		memmove(&set->ranges[i + 1], &set->ranges[i],
+				sizeof(struct uid_range) * (set->length - i));
+		set->length++;
+	} else if (j - i > 1) {
+		memmove(&set->ranges[i + 1], &set->ranges[j],
+				sizeof(struct uid_range) * (set->length - j));
+		set->length -= j - i - 1;
+	}
+	set->ranges[i].min = min;
+	set->ranges[i].max = max;
+	set->ranges[i].descending = false;
+}
+
+void uidset_add(uidset_t *set, long uid) {
+	if (set->length != 0 && set->ranges[set->length - 1].max + 1 == uid) {
+		/* Fast path for adding in ascending order */
+		set->ranges[set->length - 1].max = uid;
+		return;
+	}
+	uidset_add_range(set, uid, uid);
+}
+
+void uidset_append(uidset_t *set, long uid) {
+	if (set->length != 0) {
+		/* A single UID can go on to become a run in either direction */
+		struct uid_range *last = &set->ranges[set->length - 1];
+		bool single = last->min == last->max;
+		if (!last->descending && last->max + 1 == uid) {
+			last->max = uid;
+			return;
+		}
+		if ((last->descending || single) && last->min - 1 == uid) {
+			last->min = uid;
+			last->descending = true;
+			return;
+		}
+	}
+	uidset_resize(set);
+	set->ranges[set->length].min = uid;
+	set->ranges[set->length].max = uid;
+	set->ranges[set->length].descending = false;
+	set->length++;
+}
+
+bool uidset_contains(const uidset_t *set, long uid) {
+	if (!set) return false;
+	size_t i = uidset_lower_bound(set, uid);
+	return i < set->length && set->ranges[i].min <= uid;
+}
+
+long uidset_count(const uidset_t *set) {
+	long count = 0;
+	for (size_t i = 0; i < set->length; ++i) {
+		count += set->ranges[i].max - set->ranges[i].min + 1;
+	}
+	return count;
+}
+
+long uidset_get(const uidset_t *set, long n) {
+	for (size_t i = 0; i < set->length && n >= 0; ++i) {
+		long len = set->ranges[i].max - set->ranges[i].min + 1;
+		if (n < len) {
+			return uid_range_at(&set->ranges[i], n);
+		}
+		n -= len;
+	}
+	return -1;
+}
+
+bool uidset_parse(uidset_t *set, const char *str, bool ordered) {
+	/*
+	 * IMAP sequence-sets are comma separated numbers or ranges of numbers,
+	 * like 1:5,7,9:12. Ranges may be given in either order (12:9 == 9:12).
+	 */
+	while (*str) {
+		char *end;
+		long min = strtol(str, &end, 10);
+		if (end == str || min < 0) {
+			return false;
+		}
+		long max = min;
+		str = end;
+		if (*str == ':') {
+			++str;
+			max = strtol(str, &end, 10);
+			if (end == str || max < 0) {
+				return false;
+			}
+			str = end;
+		}
+		if (ordered) {
+			long step = min <= max ? 1 : -1;
+			for (long uid = min; ; uid += step) {
+				uidset_append(set, uid);
+				if (uid == max) break;
+			}
+		} else {
+			uidset_add_range(set, min, max);
+		}
+		if (*str == ',') {
+			++str;
+		} else if (*str) {
+			return false;
+		}
+	}
+	return true;
+}
+
+char *uidset_serialize(const uidset_t *set) {
+	/*
+	 * Measure, allocate, print.
+	 */
+	size_t size = 1;
+	for (size_t i = 0; i < set->length; ++i) {
+		const struct uid_range *r = &set->ranges[i];
+		if (r->min == r->max) {
+			size += snprintf(NULL, 0, "%ld,", r->min);
+		} else {
+			size += snprintf(NULL, 0, "%ld:%ld,", r->min, r->max);
+		}
+	}
+	char *result = malloc(size);
+	char *_ = result;
+	*_ = '\0';
+	for (size_t i = 0; i < set->length; ++i) {
+		const struct uid_range *r = &set->ranges[i];
+		if (r->min == r->max) {
+			_ += sprintf(_, "%ld,", r->min);
+		} else {
+			_ += sprintf(_, "%ld:%ld,", r->min, r->max);
+		}
+	}
+	if (_ != result) {
+		*(_ - 1) = '\0';
+	}
+	return result;
+}
@@ -0,0 +1,175 @@
+/*
+ * util/utf7.c - modified UTF-7, as used for IMAP mailbox names
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/utf7.h"
+
+static const char alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+,";
+
+static int base64_value(char c) {
+	if (c >= 'A' && c <= 'Z') return c - 'A';
+	if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if (c >= '0' && c <= '9') return c - '0' + 52;
+	if (c == '+') return 62;
+	if (c == ',') return 63;
+	return -1;
+}
+
+static bool is_direct(unsigned char c) {
+	return c >= 0x20 && c <= 0x7E;
+}
+
+static size_t put_utf8(char *out, uint32_t cp) {
+	if (cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	} else if (cp < 0x800) {
+		out[0] = 0xC0 | cp >> 6;
+		out[1] = 0x80 | (cp & 0x3F);
+		return 2;
+	} else if (cp < 0x10000) {
+		out[0] = 0xE0 | cp >> 12;
+		out[1] = 0x80 | (cp >> 6 & 0x3F);
+		out[2] = 0x80 | (cp & 0x3F);
+		return 3;
+	}
+	out[0] = 0xF0 | cp >> 18;
+	out[1] = 0x80 | (cp >> 12 & 0x3F);
+	out[2] = 0x80 | (cp >> 6 & 0x3F);
+	out[3] = 0x80 | (cp & 0x3F);
+	return 4;
+}
+
+static uint32_t next_utf8(const char **text) {
+	const unsigned char *p = (const unsigned char *)*text;
+	int len = p[0] >= 0xF0 && p[0] <= 0xF4 ? 4
+		: p[0] >= 0xE0 ? 3 : p[0] >= 0xC2 && p[0] < 0xE0 ? 2 : 0;
+	uint32_t cp = len == 4 ? p[0] & 0x07 : len == 3 ? p[0] & 0x0F : p[0] & 0x1F;
+	for (int i = 1; i < len; ++i) {
+		if ((p[i] & 0xC0) != 0x80) {
+			len = 0;
+			break;
+		}
+		cp = cp << 6 | (p[i] & 0x3F);
+	}
+	/* Overlong forms, surrogates and anything past U+10FFFF */
+	if (len == 0 || (len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000)
+			|| (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+		*text += 1;
+		return 0xFFFD;
+	}
+	*text += len;
+	return cp;
+}
+
+char *utf7_decode(const char *name) {
+	/* Eight base64 characters make at most nine bytes of UTF-8 */
+	char *out = malloc(strlen(name) * 2 + 1), *o = out;
+	const char *p = name;
+	while (*p) {
+		char c = *p++;
+		if (!is_direct(c)) {
+			goto invalid;
+		}
+		if (c != '&') {
+			*o++ = c;
+			continue;
+		}
+		if (*p == '-') {
+			*o++ = '&';
+			++p;
+			continue;
+		}
+		uint32_t bits = 0, high = 0;
+		int nbits = 0;
+		for (; *p && *p != '-'; ++p) {
+			int value = base64_value(*p);
+			if (value == -1) {
+				goto invalid;
+			}
+			bits = bits << 6 | value;
+			nbits += 6;
+			if (nbits < 16) {
+				continue;
+			}
+			nbits -= 16;
+			uint32_t unit = bits >> nbits & 0xFFFF;
+			bits &= (1 << nbits) - 1;
+			if (high) {
+				if (unit < 0xDC00 || unit > 0xDFFF) {
+					goto invalid;
+				}
+				o += put_utf8(o, 0x10000 + ((high - 0xD800) << 10)
+						+ (unit - 0xDC00));
+				high = 0;
+			} else if (unit >= 0xD800 && unit <= 0xDBFF) {
+				high = unit;
+			} else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+				goto invalid;
+			} else {
+				o += put_utf8(o, unit);
+			}
+		}
+		/* Whatever bits are left over must be padding, and zero */
+		if (*p != '-' || high || nbits >= 6 || bits) {
+			goto invalid;
+		}
+		++p;
+	}
+	*o = '\0';
+	return out;
+invalid:
+	free(out);
+	return NULL;
+}
+
+char *utf7_encode(const char *text) {
+	/*
+	 * The worst case is a lone invalid byte, which becomes U+FFFD in a run
+	 * of its own: five bytes, "&,,0-".
+	 */
+	char *out = malloc(strlen(text) * 5 + 1), *o = out;
+	const char *p = text;
+	while (*p) {
+		if (is_direct(*p)) {
+			*o++ = *p;
+			if (*p++ == '&') {
+				*o++ = '-';
+			}
+			continue;
+		}
+		*o++ = '&';
+		uint32_t bits = 0;
+		int nbits = 0;
+		while (*p && !is_direct(*p)) {
+			uint32_t cp = next_utf8(&p);
+			uint32_t units[2] = { cp, 0 };
+			int count = 1;
+			if (cp >= 0x10000) {
+				units[0] = 0xD800 + ((cp - 0x10000) >> 10);
+				units[1] = 0xDC00 + ((cp - 0x10000) & 0x3FF);
+				count = 2;
+			}
+			for (int i = 0; i < count; ++i) {
+				bits = bits << 16 | units[i];
+				nbits += 16;
+				while (nbits >= 6) {
+					nbits -= 6;
+					*o++ = alphabet[bits >> nbits & 0x3F];
+				}
+				bits &= (1 << nbits) - 1;
+			}
+		}
+		if (nbits) {
+			*o++ = alphabet[bits << (6 - nbits) & 0x3F];
+		}
+		*o++ = '-';
+	}
+	*o = '\0';
+	return out;
+}
@@ -0,0 +1,292 @@
+/*
+ * util/wcwidth.c - terminal column widths of Unicode text
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/wcwidth.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+/* SSE2 is part of x86-64, so there's nothing to detect */
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ * Ranges of code points from U+0300 up, sorted, each packed into a word as
+ * first << 11 | (last - first). From Unicode 14.0: zero_width is categories
+ * Mn, Me and Cf (except the soft hyphen) and the Hangul medial vowels and
+ * final consonants; double_width is East Asian Width W and F, and all of
+ * planes 2 and 3. Ranges are joined across unassigned code points.
+ */
+static const uint32_t zero_width[] = {
+	0x00300 << 11 | 111, 0x00483 << 11 | 6, 0x00591 << 11 | 44,
+	0x005BF << 11 | 0, 0x005C1 << 11 | 1, 0x005C4 << 11 | 1, 0x005C7 << 11 | 0,
+	0x00600 << 11 | 5, 0x00610 << 11 | 10, 0x0061C << 11 | 0,
+	0x0064B << 11 | 20, 0x00670 << 11 | 0, 0x006D6 << 11 | 7,
+	0x006DF << 11 | 5, 0x006E7 << 11 | 1, 0x006EA << 11 | 3, 0x0070F << 11 | 0,
+	0x00711 << 11 | 0, 0x00730 << 11 | 26, 0x007A6 << 11 | 10,
+	0x007EB << 11 | 8, 0x007FD << 11 | 0, 0x00816 << 11 | 3, 0x0081B << 11 | 8,
+	0x00825 << 11 | 2, 0x00829 << 11 | 4, 0x00859 << 11 | 2,
+	0x00890 << 11 | 15, 0x008CA << 11 | 56, 0x0093A << 11 | 0,
+	0x0093C << 11 | 0, 0x00941 << 11 | 7, 0x0094D << 11 | 0, 0x00951 << 11 | 6,
+	0x00962 << 11 | 1, 0x00981 << 11 | 0, 0x009BC << 11 | 0, 0x009C1 << 11 | 3,
+	0x009CD << 11 | 0, 0x009E2 << 11 | 1, 0x009FE << 11 | 4, 0x00A3C << 11 | 0,
+	0x00A41 << 11 | 16, 0x00A70 << 11 | 1, 0x00A75 << 11 | 0,
+	0x00A81 << 11 | 1, 0x00ABC << 11 | 0, 0x00AC1 << 11 | 7, 0x00ACD << 11 | 0,
+	0x00AE2 << 11 | 1, 0x00AFA << 11 | 7, 0x00B3C << 11 | 0, 0x00B3F << 11 | 0,
+	0x00B41 << 11 | 3, 0x00B4D << 11 | 9, 0x00B62 << 11 | 1, 0x00B82 << 11 | 0,
+	0x00BC0 << 11 | 0, 0x00BCD << 11 | 0, 0x00C00 << 11 | 0, 0x00C04 << 11 | 0,
+	0x00C3C << 11 | 0, 0x00C3E << 11 | 2, 0x00C46 << 11 | 16,
+	0x00C62 << 11 | 1, 0x00C81 << 11 | 0, 0x00CBC << 11 | 0, 0x00CBF << 11 | 0,
+	0x00CC6 << 11 | 0, 0x00CCC << 11 | 1, 0x00CE2 << 11 | 1, 0x00D00 << 11 | 1,
+	0x00D3B << 11 | 1, 0x00D41 << 11 | 3, 0x00D4D << 11 | 0, 0x00D62 << 11 | 1,
+	0x00D81 << 11 | 0, 0x00DCA << 11 | 0, 0x00DD2 << 11 | 4, 0x00E31 << 11 | 0,
+	0x00E34 << 11 | 6, 0x00E47 << 11 | 7, 0x00EB1 << 11 | 0, 0x00EB4 << 11 | 8,
+	0x00EC8 << 11 | 5, 0x00F18 << 11 | 1, 0x00F35 << 11 | 0, 0x00F37 << 11 | 0,
+	0x00F39 << 11 | 0, 0x00F71 << 11 | 13, 0x00F80 << 11 | 4,
+	0x00F86 << 11 | 1, 0x00F8D << 11 | 47, 0x00FC6 << 11 | 0,
+	0x0102D << 11 | 3, 0x01032 << 11 | 5, 0x01039 << 11 | 1, 0x0103D << 11 | 1,
+	0x01058 << 11 | 1, 0x0105E << 11 | 2, 0x01071 << 11 | 3, 0x01082 << 11 | 0,
+	0x01085 << 11 | 1, 0x0108D << 11 | 0, 0x0109D << 11 | 0,
+	0x01160 << 11 | 159, 0x0135D << 11 | 2, 0x01712 << 11 | 2,
+	0x01732 << 11 | 1, 0x01752 << 11 | 1, 0x01772 << 11 | 1, 0x017B4 << 11 | 1,
+	0x017B7 << 11 | 6, 0x017C6 << 11 | 0, 0x017C9 << 11 | 10,
+	0x017DD << 11 | 0, 0x0180B << 11 | 4, 0x01885 << 11 | 1, 0x018A9 << 11 | 0,
+	0x01920 << 11 | 2, 0x01927 << 11 | 1, 0x01932 << 11 | 0, 0x01939 << 11 | 2,
+	0x01A17 << 11 | 1, 0x01A1B << 11 | 0, 0x01A56 << 11 | 0, 0x01A58 << 11 | 8,
+	0x01A62 << 11 | 0, 0x01A65 << 11 | 7, 0x01A73 << 11 | 12,
+	0x01AB0 << 11 | 83, 0x01B34 << 11 | 0, 0x01B36 << 11 | 4,
+	0x01B3C << 11 | 0, 0x01B42 << 11 | 0, 0x01B6B << 11 | 8, 0x01B80 << 11 | 1,
+	0x01BA2 << 11 | 3, 0x01BA8 << 11 | 1, 0x01BAB << 11 | 2, 0x01BE6 << 11 | 0,
+	0x01BE8 << 11 | 1, 0x01BED << 11 | 0, 0x01BEF << 11 | 2, 0x01C2C << 11 | 7,
+	0x01C36 << 11 | 1, 0x01CD0 << 11 | 2, 0x01CD4 << 11 | 12,
+	0x01CE2 << 11 | 6, 0x01CED << 11 | 0, 0x01CF4 << 11 | 0, 0x01CF8 << 11 | 1,
+	0x01DC0 << 11 | 63, 0x0200B << 11 | 4, 0x0202A << 11 | 4,
+	0x02060 << 11 | 15, 0x020D0 << 11 | 32, 0x02CEF << 11 | 2,
+	0x02D7F << 11 | 0, 0x02DE0 << 11 | 31, 0x0302A << 11 | 3,
+	0x03099 << 11 | 1, 0x0A66F << 11 | 3, 0x0A674 << 11 | 9, 0x0A69E << 11 | 1,
+	0x0A6F0 << 11 | 1, 0x0A802 << 11 | 0, 0x0A806 << 11 | 0, 0x0A80B << 11 | 0,
+	0x0A825 << 11 | 1, 0x0A82C << 11 | 0, 0x0A8C4 << 11 | 1,
+	0x0A8E0 << 11 | 17, 0x0A8FF << 11 | 0, 0x0A926 << 11 | 7,
+	0x0A947 << 11 | 10, 0x0A980 << 11 | 2, 0x0A9B3 << 11 | 0,
+	0x0A9B6 << 11 | 3, 0x0A9BC << 11 | 1, 0x0A9E5 << 11 | 0, 0x0AA29 << 11 | 5,
+	0x0AA31 << 11 | 1, 0x0AA35 << 11 | 1, 0x0AA43 << 11 | 0, 0x0AA4C << 11 | 0,
+	0x0AA7C << 11 | 0, 0x0AAB0 << 11 | 0, 0x0AAB2 << 11 | 2, 0x0AAB7 << 11 | 1,
+	0x0AABE << 11 | 1, 0x0AAC1 << 11 | 0, 0x0AAEC << 11 | 1, 0x0AAF6 << 11 | 0,
+	0x0ABE5 << 11 | 0, 0x0ABE8 << 11 | 0, 0x0ABED << 11 | 0, 0x0FB1E << 11 | 0,
+	0x0FE00 << 11 | 15, 0x0FE20 << 11 | 15, 0x0FEFF << 11 | 0,
+	0x0FFF9 << 11 | 2, 0x101FD << 11 | 0, 0x102E0 << 11 | 0, 0x10376 << 11 | 4,
+	0x10A01 << 11 | 14, 0x10A38 << 11 | 7, 0x10AE5 << 11 | 1,
+	0x10D24 << 11 | 3, 0x10EAB << 11 | 1, 0x10F46 << 11 | 10,
+	0x10F82 << 11 | 3, 0x11001 << 11 | 0, 0x11038 << 11 | 14,
+	0x11070 << 11 | 0, 0x11073 << 11 | 1, 0x1107F << 11 | 2, 0x110B3 << 11 | 3,
+	0x110B9 << 11 | 1, 0x110BD << 11 | 0, 0x110C2 << 11 | 11,
+	0x11100 << 11 | 2, 0x11127 << 11 | 4, 0x1112D << 11 | 7, 0x11173 << 11 | 0,
+	0x11180 << 11 | 1, 0x111B6 << 11 | 8, 0x111C9 << 11 | 3, 0x111CF << 11 | 0,
+	0x1122F << 11 | 2, 0x11234 << 11 | 0, 0x11236 << 11 | 1, 0x1123E << 11 | 0,
+	0x112DF << 11 | 0, 0x112E3 << 11 | 7, 0x11300 << 11 | 1, 0x1133B << 11 | 1,
+	0x11340 << 11 | 0, 0x11366 << 11 | 14, 0x11438 << 11 | 7,
+	0x11442 << 11 | 2, 0x11446 << 11 | 0, 0x1145E << 11 | 0, 0x114B3 << 11 | 5,
+	0x114BA << 11 | 0, 0x114BF << 11 | 1, 0x114C2 << 11 | 1, 0x115B2 << 11 | 3,
+	0x115BC << 11 | 1, 0x115BF << 11 | 1, 0x115DC << 11 | 1, 0x11633 << 11 | 7,
+	0x1163D << 11 | 0, 0x1163F << 11 | 1, 0x116AB << 11 | 0, 0x116AD << 11 | 0,
+	0x116B0 << 11 | 5, 0x116B7 << 11 | 0, 0x1171D << 11 | 2, 0x11722 << 11 | 3,
+	0x11727 << 11 | 4, 0x1182F << 11 | 8, 0x11839 << 11 | 1, 0x1193B << 11 | 1,
+	0x1193E << 11 | 0, 0x11943 << 11 | 0, 0x119D4 << 11 | 7, 0x119E0 << 11 | 0,
+	0x11A01 << 11 | 9, 0x11A33 << 11 | 5, 0x11A3B << 11 | 3, 0x11A47 << 11 | 0,
+	0x11A51 << 11 | 5, 0x11A59 << 11 | 2, 0x11A8A << 11 | 12,
+	0x11A98 << 11 | 1, 0x11C30 << 11 | 13, 0x11C3F << 11 | 0,
+	0x11C92 << 11 | 21, 0x11CAA << 11 | 6, 0x11CB2 << 11 | 1,
+	0x11CB5 << 11 | 1, 0x11D31 << 11 | 20, 0x11D47 << 11 | 0,
+	0x11D90 << 11 | 1, 0x11D95 << 11 | 0, 0x11D97 << 11 | 0, 0x11EF3 << 11 | 1,
+	0x13430 << 11 | 8, 0x16AF0 << 11 | 4, 0x16B30 << 11 | 6, 0x16F4F << 11 | 0,
+	0x16F8F << 11 | 3, 0x16FE4 << 11 | 0, 0x1BC9D << 11 | 1,
+	0x1BCA0 << 11 | 2047, 0x1C4A0 << 11 | 2047, 0x1CCA0 << 11 | 678,
+	0x1D167 << 11 | 2, 0x1D173 << 11 | 15, 0x1D185 << 11 | 6,
+	0x1D1AA << 11 | 3, 0x1D242 << 11 | 2, 0x1DA00 << 11 | 54,
+	0x1DA3B << 11 | 49, 0x1DA75 << 11 | 0, 0x1DA84 << 11 | 0,
+	0x1DA9B << 11 | 20, 0x1E000 << 11 | 42, 0x1E130 << 11 | 6,
+	0x1E2AE << 11 | 0, 0x1E2EC << 11 | 3, 0x1E8D0 << 11 | 6, 0x1E944 << 11 | 6,
+	0xE0001 << 11 | 494,
+};
+
+static const uint32_t double_width[] = {
+	0x01100 << 11 | 95, 0x0231A << 11 | 1, 0x02329 << 11 | 1,
+	0x023E9 << 11 | 3, 0x023F0 << 11 | 0, 0x023F3 << 11 | 0, 0x025FD << 11 | 1,
+	0x02614 << 11 | 1, 0x02648 << 11 | 11, 0x0267F << 11 | 0,
+	0x02693 << 11 | 0, 0x026A1 << 11 | 0, 0x026AA << 11 | 1, 0x026BD << 11 | 1,
+	0x026C4 << 11 | 1, 0x026CE << 11 | 0, 0x026D4 << 11 | 0, 0x026EA << 11 | 0,
+	0x026F2 << 11 | 1, 0x026F5 << 11 | 0, 0x026FA << 11 | 0, 0x026FD << 11 | 0,
+	0x02705 << 11 | 0, 0x0270A << 11 | 1, 0x02728 << 11 | 0, 0x0274C << 11 | 0,
+	0x0274E << 11 | 0, 0x02753 << 11 | 2, 0x02757 << 11 | 0, 0x02795 << 11 | 2,
+	0x027B0 << 11 | 0, 0x027BF << 11 | 0, 0x02B1B << 11 | 1, 0x02B50 << 11 | 0,
+	0x02B55 << 11 | 0, 0x02E80 << 11 | 425, 0x0302E << 11 | 16,
+	0x03041 << 11 | 85, 0x0309B << 11 | 428, 0x03250 << 11 | 2047,
+	0x03A50 << 11 | 2047, 0x04250 << 11 | 2047, 0x04A50 << 11 | 879,
+	0x04E00 << 11 | 2047, 0x05600 << 11 | 2047, 0x05E00 << 11 | 2047,
+	0x06600 << 11 | 2047, 0x06E00 << 11 | 2047, 0x07600 << 11 | 2047,
+	0x07E00 << 11 | 2047, 0x08600 << 11 | 2047, 0x08E00 << 11 | 2047,
+	0x09600 << 11 | 2047, 0x09E00 << 11 | 1734, 0x0A960 << 11 | 28,
+	0x0AC00 << 11 | 2047, 0x0B400 << 11 | 2047, 0x0BC00 << 11 | 2047,
+	0x0C400 << 11 | 2047, 0x0CC00 << 11 | 2047, 0x0D400 << 11 | 931,
+	0x0F900 << 11 | 473, 0x0FE10 << 11 | 9, 0x0FE30 << 11 | 59,
+	0x0FF01 << 11 | 95, 0x0FFE0 << 11 | 6, 0x16FE0 << 11 | 3,
+	0x16FF0 << 11 | 2047, 0x177F0 << 11 | 2047, 0x17FF0 << 11 | 2047,
+	0x187F0 << 11 | 2047, 0x18FF0 << 11 | 2047, 0x197F0 << 11 | 2047,
+	0x19FF0 << 11 | 2047, 0x1A7F0 << 11 | 2047, 0x1AFF0 << 11 | 779,
+	0x1F004 << 11 | 0, 0x1F0CF << 11 | 0, 0x1F18E << 11 | 0, 0x1F191 << 11 | 9,
+	0x1F200 << 11 | 288, 0x1F32D << 11 | 8, 0x1F337 << 11 | 69,
+	0x1F37E << 11 | 21, 0x1F3A0 << 11 | 42, 0x1F3CF << 11 | 4,
+	0x1F3E0 << 11 | 16, 0x1F3F4 << 11 | 0, 0x1F3F8 << 11 | 70,
+	0x1F440 << 11 | 0, 0x1F442 << 11 | 186, 0x1F4FF << 11 | 62,
+	0x1F54B << 11 | 3, 0x1F550 << 11 | 23, 0x1F57A << 11 | 0,
+	0x1F595 << 11 | 1, 0x1F5A4 << 11 | 0, 0x1F5FB << 11 | 84,
+	0x1F680 << 11 | 69, 0x1F6CC << 11 | 0, 0x1F6D0 << 11 | 2,
+	0x1F6D5 << 11 | 10, 0x1F6EB << 11 | 1, 0x1F6F4 << 11 | 8,
+	0x1F7E0 << 11 | 16, 0x1F90C << 11 | 46, 0x1F93C << 11 | 9,
+	0x1F947 << 11 | 184, 0x1FA70 << 11 | 134, 0x20000 << 11 | 2047,
+	0x20800 << 11 | 2047, 0x21000 << 11 | 2047, 0x21800 << 11 | 2047,
+	0x22000 << 11 | 2047, 0x22800 << 11 | 2047, 0x23000 << 11 | 2047,
+	0x23800 << 11 | 2047, 0x24000 << 11 | 2047, 0x24800 << 11 | 2047,
+	0x25000 << 11 | 2047, 0x25800 << 11 | 2047, 0x26000 << 11 | 2047,
+	0x26800 << 11 | 2047, 0x27000 << 11 | 2047, 0x27800 << 11 | 2047,
+	0x28000 << 11 | 2047, 0x28800 << 11 | 2047, 0x29000 << 11 | 2047,
+	0x29800 << 11 | 2047, 0x2A000 << 11 | 2047, 0x2A800 << 11 | 2047,
+	0x2B000 << 11 | 2047, 0x2B800 << 11 | 2047, 0x2C000 << 11 | 2047,
+	0x2C800 << 11 | 2047, 0x2D000 << 11 | 2047, 0x2D800 << 11 | 2047,
+	0x2E000 << 11 | 2047, 0x2E800 << 11 | 2047, 0x2F000 << 11 | 2047,
+	0x2F800 << 11 | 2047, 0x30000 << 11 | 2047, 0x30800 << 11 | 2047,
+	0x31000 << 11 | 2047, 0x31800 << 11 | 2047, 0x32000 << 11 | 2047,
+	0x32800 << 11 | 2047, 0x33000 << 11 | 2047, 0x33800 << 11 | 2047,
+	0x34000 << 11 | 2047, 0x34800 << 11 | 2047, 0x35000 << 11 | 2047,
+	0x35800 << 11 | 2047, 0x36000 << 11 | 2047, 0x36800 << 11 | 2047,
+	0x37000 << 11 | 2047, 0x37800 << 11 | 2047, 0x38000 << 11 | 2047,
+	0x38800 << 11 | 2047, 0x39000 << 11 | 2047, 0x39800 << 11 | 2047,
+	0x3A000 << 11 | 2047, 0x3A800 << 11 | 2047, 0x3B000 << 11 | 2047,
+	0x3B800 << 11 | 2047, 0x3C000 << 11 | 2047, 0x3C800 << 11 | 2047,
+	0x3D000 << 11 | 2047, 0x3D800 << 11 | 2047, 0x3E000 << 11 | 2047,
+	0x3E800 << 11 | 2047, 0x3F000 << 11 | 2047, 0x3F800 << 11 | 2045,
+};
+
+static bool in_table(const uint32_t *table, size_t length, uint32_t ch) {
+	/* Finds the last range that starts at or before ch */
+	size_t lo = 0, hi = length;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (table[mid] >> 11 <= ch) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo && ch - (table[lo - 1] >> 11) <= (table[lo - 1] & 0x7FF);
+}
+
+int codepoint_width(uint32_t ch) {
+	if (ch < 0x300) {
+		/* Latin, which is narrow apart from the controls */
+		return ch < 0x20 || (ch >= 0x7F && ch < 0xA0) ? 0 : 1;
+	}
+	if (in_table(zero_width, sizeof(zero_width) / sizeof(zero_width[0]), ch)) {
+		return 0;
+	}
+	if (in_table(double_width,
+				sizeof(double_width) / sizeof(double_width[0]), ch)) {
+		return 2;
+	}
+	return 1;
+}
+
+static size_t ascii_run(const char *text, size_t len) {
+	/* How many bytes of printable ASCII text starts with */
+	size_t i = 0;
+#ifdef HAVE_SSE2
+	const __m128i low = _mm_set1_epi8(0x1F), high = _mm_set1_epi8(0x7F);
+	while (len - i >= 16) {
+		/* Bytes from 0x80 up are negative, so fail the first compare */
+		__m128i block = _mm_loadu_si128((const __m128i *)(text + i));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+				_mm_cmpgt_epi8(block, low), _mm_cmplt_epi8(block, high)));
+		if (mask != 0xFFFF) {
+			return i + __builtin_ctz(~mask);
+		}
+		i += 16;
+	}
+#endif
+	while (i < len && text[i] >= 0x20 && text[i] < 0x7F) {
+		++i;
+	}
+	return i;
+}
+
+uint32_t next_codepoint(const char *text, size_t len, size_t *n) {
+	const unsigned char *p = (const unsigned char *)text;
+	size_t expected = p[0] >= 0xF0 && p[0] <= 0xF4 ? 4
+		: p[0] >= 0xE0 ? 3 : p[0] >= 0xC2 && p[0] < 0xE0 ? 2 : 1;
+	uint32_t ch = expected == 4 ? p[0] & 0x07
+		: expected == 3 ? p[0] & 0x0F : expected == 2 ? p[0] & 0x1F : p[0];
+	if (expected > len) {
+		expected = 1;
+	}
+	for (size_t i = 1; i < expected; ++i) {
+		if ((p[i] & 0xC0) != 0x80) {
+			expected = 1;
+			break;
+		}
+		ch = ch << 6 | (p[i] & 0x3F);
+	}
+	*n = 1;
+	if (expected == 1) {
+		/* Stray bytes are shown as U+FFFD */
+		return p[0] < 0x80 ? p[0] : 0xFFFD;
+	}
+	*n = expected;
+	return ch;
+}
+
+int utf8_width(const char *text, size_t len) {
+	int width = 0;
+	size_t i = 0;
+	while (i < len) {
+		size_t run = ascii_run(text + i, len - i);
+		width += run;
+		i += run;
+		if (i < len) {
+			size_t n;
+			width += codepoint_width(next_codepoint(text + i, len - i, &n));
+			i += n;
+		}
+	}
+	return width;
+}
+
+size_t utf8_truncate(const char *text, size_t len, int max, int *width) {
+	int used = 0;
+	size_t i = 0;
+	if (max < 0) {
+		max = 0;
+	}
+	while (i < len) {
+		size_t run = ascii_run(text + i, len - i);
+		if (run) {
+			size_t fits = run < (size_t)(max - used) ? run : (size_t)(max - used);
+			used += fits;
+			i += fits;
+			if (fits < run) {
+				break;
+			}
+			continue;
+		}
+		size_t n;
+		int w = codepoint_width(next_codepoint(text + i, len - i, &n));
+		if (used + w > max) {
+			break;
+		}
+		used += w;
+		i += n;
+	}
+	*width = used;
+	return i;
+}
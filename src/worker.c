@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "email/flags.h"
 #include "util/aqueue.h"
 #include "worker.h"
 
@@ -18,9 +19,11 @@ struct worker_pipe *worker_pipe_new() {
 	if (!pipe) return NULL;
 	pipe->messages = aqueue_new();
 	pipe->actions = aqueue_new();
+	pipe->flags = create_flag_table();
 	if (!pipe->messages || !pipe->actions) {
 		aqueue_free(pipe->messages);
 		aqueue_free(pipe->actions);
+		flag_table_free(pipe->flags);
 		free(pipe);
 		return NULL;
 	}
@@ -30,6 +33,7 @@ struct worker_pipe *worker_pipe_new() {
 void worker_pipe_free(struct worker_pipe *pipe) {
 	aqueue_free(pipe->messages);
 	aqueue_free(pipe->actions);
+	flag_table_free(pipe->flags);
 	free(pipe);
 }
 
@@ -0,0 +1,36 @@
+#include <stdlib.h>
+#include "tests.h"
+#include "colors.h"
+
+static void test_set_color(void **state) {
+	colors_init();
+	struct tb_cell cell;
+	/* Like the config, defaults are background:foreground */
+	get_color(COLOR_ACCOUNT_ERROR, &cell);
+	assert_int_equal(TB_BLACK, cell.fg);
+	assert_int_equal(TB_RED, cell.bg);
+
+	assert_true(set_color("folder-selected", "blue:*yellow"));
+	get_color(COLOR_FOLDER_SELECTED, &cell);
+	assert_int_equal(TB_YELLOW | TB_BOLD, cell.fg);
+	assert_int_equal(TB_BLUE, cell.bg);
+
+	assert_true(set_color("status-line", "green"));
+	get_color(COLOR_STATUS_LINE, &cell);
+	assert_int_equal(TB_GREEN, cell.fg);
+	assert_int_equal(TB_DEFAULT, cell.bg);
+
+	/* The old misspelling still works */
+	assert_true(set_color("message-list-unselcted-unread", "cyan"));
+	get_color(COLOR_MESSAGE_LIST_UNSELECTED_UNREAD, &cell);
+	assert_int_equal(TB_CYAN, cell.fg);
+
+	assert_false(set_color("no-such-color", "red"));
+}
+
+int run_tests_colors() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_set_color),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "email/columns.h"
+#include "util/uidset.h"
+
+static void assert_order(uidset_t *uids, const long *expected, size_t length) {
+	assert_non_null(uids);
+	assert_int_equal(length, uidset_count(uids));
+	for (size_t i = 0; i < length; ++i) {
+		assert_int_equal(expected[i], uidset_get(uids, i));
+	}
+	uidset_free(uids);
+}
+
+static void test_columns_set(void **state) {
+	struct message_columns *columns = create_message_columns();
+	size_t row = message_columns_set(columns, 10, FLAG_SEEN, 1000, 0, 2048,
+			"Hello", "Bob <bob@example.org>");
+	assert_int_equal(row, message_columns_row(columns, 10));
+	assert_int_equal(2048, columns->sizes[row]);
+	assert_int_equal(COLUMNS_NONE, message_columns_row(columns, 11));
+	assert_string_equal("Hello", message_columns_subject(columns, row));
+	assert_string_equal("Bob <bob@example.org>",
+			message_columns_from(columns, row));
+
+	/* Updates keep the row */
+	assert_int_equal(row, message_columns_set(columns, 10, 0, 1000, 0, 0,
+				"Hello again", NULL));
+	assert_int_equal(1, columns->count);
+	assert_int_equal(0, columns->flags[row]);
+	assert_string_equal("Hello again", message_columns_subject(columns, row));
+	assert_string_equal("", message_columns_from(columns, row));
+
+	/* Cached dates last until the stamp changes or the row does */
+	message_columns_date_stamp(columns, 1);
+	strcpy(columns->date_texts[row], "Tuesday");
+	message_columns_date_stamp(columns, 1);
+	assert_string_equal("Tuesday", columns->date_texts[row]);
+	message_columns_date_stamp(columns, 2);
+	assert_string_equal("", columns->date_texts[row]);
+	strcpy(columns->date_texts[row], "Tuesday");
+	message_columns_set(columns, 10, 0, 2000, 0, 0, "Hello", NULL);
+	assert_string_equal("", columns->date_texts[row]);
+	message_columns_free(columns);
+}
+
+static void test_columns_remove(void **state) {
+	struct message_columns *columns = create_message_columns();
+	char subject[32];
+	for (long uid = 1; uid <= 1000; ++uid) {
+		snprintf(subject, sizeof(subject), "Message %ld", uid);
+		message_columns_set(columns, uid, 0, uid, 0, 0, subject, "");
+	}
+	for (long uid = 1; uid <= 1000; uid += 2) {
+		message_columns_remove(columns, uid);
+	}
+	assert_int_equal(500, columns->count);
+	/* Enough new rows to force a compaction */
+	for (long uid = 1001; uid <= 2000; ++uid) {
+		snprintf(subject, sizeof(subject), "Message %ld", uid);
+		message_columns_set(columns, uid, 0, uid, 0, 0, subject, "");
+	}
+	assert_int_equal(1500, columns->count);
+	for (long uid = 1; uid <= 2000; ++uid) {
+		size_t row = message_columns_row(columns, uid);
+		if (uid <= 1000 && uid % 2) {
+			assert_int_equal(COLUMNS_NONE, row);
+			continue;
+		}
+		snprintf(subject, sizeof(subject), "Message %ld", uid);
+		assert_string_equal(subject, message_columns_subject(columns, row));
+		assert_int_equal(uid, columns->dates[row]);
+	}
+	message_columns_free(columns);
+}
+
+static void test_columns_sort(void **state) {
+	struct message_columns *columns = create_message_columns();
+	message_columns_set(columns, 1, 0, 300, 50, 0,
+			"Re: banana", "Carol <c@x>");
+	message_columns_set(columns, 2, 0, 100, 0, 0, "apple", "alice <a@x>");
+	message_columns_set(columns, 3, 0, 200, 400, 0,
+			"Cherry", "\"Zed\" <b@x>");
+	message_columns_set(columns, 4, 0, 200, 0, 0, "Fwd: Apple", "Dave <d@x>");
+
+	/* ARRIVAL is the internal date, DATE the Date: header if there is one */
+	const long by_arrival[] = { 2, 3, 4, 1 };
+	assert_order(message_columns_sort(columns, "ARRIVAL"), by_arrival, 4);
+	const long by_date[] = { 1, 2, 4, 3 };
+	assert_order(message_columns_sort(columns, "DATE"), by_date, 4);
+	const long by_reverse_date[] = { 3, 4, 2, 1 };
+	assert_order(message_columns_sort(columns, "REVERSE DATE"),
+			by_reverse_date, 4);
+	const long by_subject[] = { 2, 4, 1, 3 };
+	assert_order(message_columns_sort(columns, "subject"), by_subject, 4);
+	const long by_from[] = { 2, 3, 1, 4 };
+	assert_order(message_columns_sort(columns, "FROM"), by_from, 4);
+	const long by_subject_arrival[] = { 4, 2, 1, 3 };
+	assert_order(message_columns_sort(columns, "SUBJECT REVERSE ARRIVAL"),
+			by_subject_arrival, 4);
+
+	assert_null(message_columns_sort(columns, "SIZE"));
+	assert_null(message_columns_sort(columns, "REVERSE"));
+	message_columns_free(columns);
+}
+
+int run_tests_columns() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_columns_set),
+		cmocka_unit_test(test_columns_remove),
+		cmocka_unit_test(test_columns_sort),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "email/flags.h"
+
+static void test_flag_intern(void **state) {
+	struct flag_table *table = create_flag_table();
+	assert_int_equal(FLAG_SEEN, flag_intern(table, "\\Seen"));
+	assert_int_equal(FLAG_DELETED, flag_lookup(table, "\\deleted"));
+	assert_int_equal(0, flag_lookup(table, "$Junk"));
+	flagset_t junk = flag_intern(table, "$Junk");
+	assert_int_equal((flagset_t)1 << 6, junk);
+	assert_int_equal(junk, flag_intern(table, "$JUNK"));
+	assert_string_equal("$Junk", flag_name(table, junk));
+	assert_null(flag_name(table, (flagset_t)1 << 7));
+	flag_table_free(table);
+}
+
+static void test_flag_table_full(void **state) {
+	struct flag_table *table = create_flag_table();
+	char name[16];
+	for (int i = 6; i < FLAG_MAX; ++i) {
+		snprintf(name, sizeof(name), "$Label%d", i);
+		assert_int_equal((flagset_t)1 << i, flag_intern(table, name));
+	}
+	assert_int_equal(0, flag_intern(table, "$OneTooMany"));
+	assert_int_equal((flagset_t)1 << 63, flag_lookup(table, "$Label63"));
+	flag_table_free(table);
+}
+
+static void test_flagset_serialize(void **state) {
+	struct flag_table *table = create_flag_table();
+	flagset_t junk = flag_intern(table, "$Junk");
+	char *str = flagset_serialize(table, FLAG_SEEN | FLAG_FLAGGED | junk);
+	assert_string_equal("\\Seen \\Flagged $Junk", str);
+	free(str);
+	str = flagset_serialize(table, 0);
+	assert_string_equal("", str);
+	free(str);
+	flag_table_free(table);
+}
+
+int run_tests_flags() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_flag_intern),
+		cmocka_unit_test(test_flag_table_full),
+		cmocka_unit_test(test_flagset_serialize),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
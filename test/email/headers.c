@@ -8,16 +8,16 @@ static void test_parse_headers_simple(void **state) {
 	const char *headers = "Subject: hello world\r\n"
 		"Date: test\r\n"
 		"From: Foo Bar <fbar@example.org>";
-	list_t *output = create_list();
+	struct email_headers *output = create_email_headers();
 	parse_headers(headers, output);
-	assert_int_equal(3, output->length);
+	assert_int_equal(3, output->headers->length);
 	struct email_header expected[] = {
 		{ "Subject", "hello world" },
 		{ "Date", "test" },
 		{ "From", "Foo Bar <fbar@example.org>" }
 	};
 	for (int i = 0; i < 3; ++i) {
-		struct email_header *test = output->items[i];
+		struct email_header *test = output->headers->items[i];
 		assert_string_equal(test->key, expected[i].key);
 		assert_string_equal(test->value, expected[i].value);
 	}
@@ -29,26 +29,93 @@ static void test_parse_headers_continued(void **state) {
 		" extended\r\n"
 		"Date: test\r\n"
 		"From: Foo Bar <fbar@example.org>";
-	list_t *output = create_list();
+	struct email_headers *output = create_email_headers();
 	parse_headers(headers, output);
-	assert_int_equal(3, output->length);
+	assert_int_equal(3, output->headers->length);
 	struct email_header expected[] = {
 		{ "Subject", "hello world extended" },
 		{ "Date", "test" },
 		{ "From", "Foo Bar <fbar@example.org>" }
 	};
 	for (int i = 0; i < 3; ++i) {
-		struct email_header *test = output->items[i];
+		struct email_header *test = output->headers->items[i];
 		assert_string_equal(test->key, expected[i].key);
 		assert_string_equal(test->value, expected[i].value);
 	}
 	free_headers(output);
 }
 
+static void test_parse_headers_fields(void **state) {
+	const char *headers = "subject: first\r\n"
+		"X-Mailer: test\r\n"
+		"Message-Id: <a@example.org>\r\n"
+		"x-mailer: again\r\n"
+		"Subject: second";
+	struct email_headers *output = create_email_headers();
+	parse_headers(headers, output);
+	assert_string_equal("first", output->fields[HEADER_SUBJECT]);
+	assert_string_equal("<a@example.org>", output->fields[HEADER_MESSAGE_ID]);
+	assert_null(output->fields[HEADER_FROM]);
+	assert_string_equal("test", get_header(output, "X-MAILER"));
+	assert_null(get_header(output, "X-Spam"));
+
+	/* Keys are shared between headers and messages */
+	struct email_header *first = output->headers->items[1];
+	struct email_header *second = output->headers->items[3];
+	assert_ptr_equal(first->key, second->key);
+	assert_ptr_equal(first->key, intern_header_key("X-Mailer"));
+
+	struct email_headers *copy = copy_headers(output);
+	free_headers(output);
+	assert_string_equal("first", copy->fields[HEADER_SUBJECT]);
+	assert_string_equal("again", ((struct email_header *)copy->headers->items[3])->value);
+	free_headers(copy);
+}
+
+static void test_parse_headers_unfolding(void **state) {
+	const char *headers = "\r\n"
+		"References: <a@example.org>\n"
+		"\t<b@example.org>  \r\n"
+		"   <c@example.org>\r\n"
+		"Subject:   spaced  out  \n"
+		"Broken line\r\n"
+		" continued\r\n"
+		"To:\r\n"
+		"\r\n"
+		"Body: not a header\r\n";
+	struct email_headers *output = create_email_headers();
+	parse_headers(headers, output);
+	assert_int_equal(3, output->headers->length);
+	assert_string_equal("<a@example.org> <b@example.org> <c@example.org>",
+			output->fields[HEADER_REFERENCES]);
+	assert_string_equal("spaced  out", output->fields[HEADER_SUBJECT]);
+	assert_string_equal("", output->fields[HEADER_TO]);
+	assert_null(get_header(output, "Body"));
+	free_headers(output);
+}
+
+static void test_parse_header_date(void **state) {
+	assert_int_equal(1057049557,
+			parse_header_date("Tue, 1 Jul 2003 10:52:37 +0200"));
+	assert_int_equal(880127706,
+			parse_header_date("Fri, 21 Nov 1997 09:55:06 -0600"));
+	/* Obsolete forms: comments, zone names, no seconds, two digit years */
+	assert_int_equal(951800400,
+			parse_header_date("Tue, 29 Feb 2000 00:00 (noon-ish) EST"));
+	assert_int_equal(-27723480,
+			parse_header_date("Thu, 13 Feb 69 23:32 -0330 (Newfoundland)"));
+	assert_int_equal(0, parse_header_date("yesterday"));
+	assert_int_equal(0, parse_header_date("1 Smarch 2003 10:00 +0000"));
+	assert_int_equal(0, parse_header_date(NULL));
+}
+
 int run_tests_headers() {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(test_parse_headers_simple),
 		cmocka_unit_test(test_parse_headers_continued),
+		cmocka_unit_test(test_parse_headers_fields),
+		cmocka_unit_test(test_parse_headers_unfolding),
+		cmocka_unit_test(test_parse_header_date),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
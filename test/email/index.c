@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tests.h"
+#include "email/index.h"
+#include "util/uidset.h"
+
+static void test_index_query(void **state) {
+	struct email_index *index = email_index_open(NULL);
+	email_index_add(index, "INBOX", 4, "Lunch on Friday? Bob <bob@example.org>");
+	email_index_add(index, "INBOX", 7, "Re: Invoice 1234 alice@example.org");
+	email_index_add(index, "INBOX", 9, "Invoices for FRIDAY bob@example.org");
+	email_index_add(index, "Archive", 2, "friday invoice");
+	assert_true(email_index_contains(index, "INBOX", 7));
+	assert_false(email_index_contains(index, "INBOX", 2));
+
+	uidset_t *uids = email_index_query(index, "INBOX", "friday bob");
+	char *str = uidset_serialize(uids);
+	assert_string_equal("4,9", str);
+	free(str);
+	uidset_free(uids);
+
+	uids = email_index_query(index, "INBOX", "invoice*");
+	str = uidset_serialize(uids);
+	assert_string_equal("7,9", str);
+	free(str);
+	uidset_free(uids);
+
+	uids = email_index_query(index, "INBOX", "invoice alice");
+	str = uidset_serialize(uids);
+	assert_string_equal("7", str);
+	free(str);
+	uidset_free(uids);
+
+	/* Single characters aren't indexed, so they don't narrow the search */
+	uids = email_index_query(index, "INBOX", "friday bob b");
+	str = uidset_serialize(uids);
+	assert_string_equal("4,9", str);
+	free(str);
+	uidset_free(uids);
+
+	uids = email_index_query(index, "Sent", "friday");
+	assert_int_equal(0, uidset_count(uids));
+	uidset_free(uids);
+	email_index_close(index);
+}
+
+static void test_index_persistence(void **state) {
+	char path[] = "/tmp/aerc-index-test-XXXXXX";
+	int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	close(fd);
+	remove(path);
+	char journal[sizeof(path) + 8];
+	strcpy(journal, path);
+	strcat(journal, ".journal");
+
+	struct email_index *index = email_index_open(path);
+	email_index_add(index, "INBOX", 1, "hello world");
+	assert_true(email_index_save(index));
+	email_index_add(index, "INBOX", 2, "hello again");
+	email_index_close(index);
+
+	index = email_index_open(path);
+	uidset_t *uids = email_index_query(index, "INBOX", "hello");
+	char *str = uidset_serialize(uids);
+	assert_string_equal("1:2", str);
+	free(str);
+	uidset_free(uids);
+	email_index_close(index);
+	remove(path);
+	remove(journal);
+}
+
+static void test_index_remove(void **state) {
+	char path[] = "/tmp/aerc-index-test-XXXXXX";
+	int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	close(fd);
+	remove(path);
+	char journal[sizeof(path) + 8];
+	strcpy(journal, path);
+	strcat(journal, ".journal");
+
+	struct email_index *index = email_index_open(path);
+	email_index_set_uidvalidity(index, "INBOX", 100);
+	email_index_add(index, "INBOX", 1, "hello world");
+	email_index_add(index, "INBOX", 2, "hello again");
+	email_index_add(index, "INBOX", 3, "hello there");
+	email_index_add(index, "Sent", 1, "hello back");
+
+	/* Expunged messages drop out of results */
+	email_index_remove(index, "INBOX", 2);
+	assert_false(email_index_contains(index, "INBOX", 2));
+	uidset_t *uids = email_index_query(index, "INBOX", "hello");
+	char *str = uidset_serialize(uids);
+	assert_string_equal("1,3", str);
+	free(str);
+	uidset_free(uids);
+
+	/* And stay out across the journal and a snapshot */
+	email_index_close(index);
+	index = email_index_open(path);
+	uids = email_index_query(index, "INBOX", "hello");
+	str = uidset_serialize(uids);
+	assert_string_equal("1,3", str);
+	free(str);
+	uidset_free(uids);
+	assert_true(email_index_save(index));
+	email_index_add(index, "INBOX", 4, "hello again");
+	uids = email_index_query(index, "INBOX", "again");
+	str = uidset_serialize(uids);
+	assert_string_equal("4", str);
+	free(str);
+	uidset_free(uids);
+
+	/* A new UIDVALIDITY forgets the mailbox, and only that one */
+	email_index_set_uidvalidity(index, "INBOX", 100);
+	assert_true(email_index_contains(index, "INBOX", 1));
+	email_index_set_uidvalidity(index, "INBOX", 200);
+	email_index_close(index);
+	index = email_index_open(path);
+	assert_false(email_index_contains(index, "INBOX", 1));
+	assert_false(email_index_contains(index, "INBOX", 4));
+	assert_true(email_index_contains(index, "Sent", 1));
+	email_index_add(index, "INBOX", 1, "a different message");
+	uids = email_index_query(index, "INBOX", "hello");
+	assert_int_equal(0, uidset_count(uids));
+	uidset_free(uids);
+	email_index_close(index);
+	remove(path);
+	remove(journal);
+}
+
+int run_tests_index() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_index_query),
+		cmocka_unit_test(test_index_persistence),
+		cmocka_unit_test(test_index_remove),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "email/rfc2047.h"
+
+static void assert_decoded(const char *expected, const char *text) {
+	char *decoded = rfc2047_decode(text);
+	assert_non_null(decoded);
+	assert_string_equal(expected, decoded);
+	free(decoded);
+}
+
+static void test_decode_words(void **state) {
+	assert_decoded("Caf\xC3\xA9 tonight?", "=?UTF-8?B?Q2Fmw6k=?= tonight?");
+	assert_decoded("Caf\xC3\xA9 tonight?", "=?utf-8?q?Caf=C3=A9_tonight=3F?=");
+	/* Missing padding */
+	assert_decoded("Caf\xC3\xA9", "=?UTF-8?B?Q2Fmw6k?=");
+	/* RFC 2231 language suffix */
+	assert_decoded("Hi", "=?US-ASCII*EN?Q?Hi?=");
+	assert_decoded("Re: Caf\xC3\xA9 <a@example.org>",
+			"Re: =?UTF-8?Q?Caf=C3=A9?= <a@example.org>");
+}
+
+static void test_decode_adjacent(void **state) {
+	/* Whitespace between encoded words goes away, but not around them */
+	assert_decoded("ab c", "=?UTF-8?Q?a?=\t=?UTF-8?Q?b?= c");
+	/* A character split across two words */
+	assert_decoded("\xE2\x82\xAC", "=?UTF-8?B?4oI=?= =?UTF-8?B?rA==?=");
+}
+
+static void test_decode_charsets(void **state) {
+	assert_decoded("Caf\xC3\xA9", "=?ISO-8859-1?Q?Caf=E9?=");
+	assert_decoded("\xC3\xA9 \xE2\x82\xAC", "=?ISO-8859-1?Q?=E9_?= =?ISO-8859-15?Q?=A4?=");
+	/* Unknown charsets are passed through */
+	assert_decoded("abc", "=?X-UNKNOWN?Q?abc?=");
+	/* Control characters don't survive */
+	assert_decoded("a b", "=?UTF-8?Q?a=0Ab?=");
+}
+
+static void test_decode_nothing(void **state) {
+	assert_null(rfc2047_decode("Plain subject"));
+	assert_null(rfc2047_decode("=?UTF-8?X?abc?="));
+	assert_null(rfc2047_decode("=?UTF-8?B?not base64!?="));
+	assert_null(rfc2047_decode("=?UTF-8?Q?unterminated"));
+	assert_null(rfc2047_decode(NULL));
+	assert_decoded("=?broken ok", "=?broken =?UTF-8?Q?ok?=");
+}
+
+int run_tests_rfc2047() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_decode_words),
+		cmocka_unit_test(test_decode_adjacent),
+		cmocka_unit_test(test_decode_charsets),
+		cmocka_unit_test(test_decode_nothing),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
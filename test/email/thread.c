@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "email/thread.h"
+#include "util/uidset.h"
+
+static void assert_threads(struct thread_index *index,
+		const long *uids, const int *depths, size_t length) {
+	struct thread_list *threads = thread_index_flatten(index);
+	assert_int_equal(length, threads->length);
+	for (size_t i = 0; i < length; ++i) {
+		assert_int_equal(uids[i], uidset_get(threads->uids, i));
+		assert_int_equal(depths[i], threads->depths[i]);
+	}
+	thread_list_free(threads);
+}
+
+static void test_thread_replies(void **state) {
+	struct thread_index *index = create_thread_index();
+	thread_index_add(index, 1, "<a@x>", NULL, NULL);
+	thread_index_add(index, 2, "<b@x>", "<a@x>", "<a@x>");
+	thread_index_add(index, 3, "<c@x>", NULL, NULL);
+	thread_index_add(index, 4, "<d@x>", "<a@x> <b@x>", NULL);
+	thread_index_add(index, 5, "<e@x>", NULL, "<a@x>");
+	/* Already added, ignored */
+	thread_index_add(index, 5, "<e@x>", NULL, "<c@x>");
+	long uids[] = { 3, 1, 2, 4, 5 };
+	int depths[] = { 0, 0, 1, 2, 1 };
+	assert_threads(index, uids, depths, 5);
+	thread_index_free(index);
+}
+
+static void test_thread_out_of_order(void **state) {
+	/*
+	 * Replies arriving before their parents are grouped under a placeholder
+	 * and moved under the parent once it shows up.
+	 */
+	struct thread_index *index = create_thread_index();
+	thread_index_add(index, 3, "<c@x>", "<a@x> <b@x>", NULL);
+	thread_index_add(index, 4, "<d@x>", "<a@x>", NULL);
+	long uids1[] = { 3, 4 };
+	int depths1[] = { 0, 0 };
+	assert_threads(index, uids1, depths1, 2);
+
+	thread_index_add(index, 1, "<a@x>", NULL, NULL);
+	long uids2[] = { 1, 3, 4 };
+	int depths2[] = { 0, 1, 1 };
+	assert_threads(index, uids2, depths2, 3);
+
+	thread_index_add(index, 2, "<b@x>", "<a@x>", NULL);
+	long uids3[] = { 1, 2, 3, 4 };
+	int depths3[] = { 0, 1, 2, 1 };
+	assert_threads(index, uids3, depths3, 4);
+	thread_index_free(index);
+}
+
+static void test_thread_loops(void **state) {
+	struct thread_index *index = create_thread_index();
+	thread_index_add(index, 1, "<a@x>", "<b@x>", NULL);
+	thread_index_add(index, 2, "<b@x>", "<a@x>", NULL);
+	thread_index_add(index, 3, "<a@x>", NULL, NULL); // Duplicate ID
+	struct thread_list *threads = thread_index_flatten(index);
+	assert_int_equal(3, threads->length);
+	thread_list_free(threads);
+	thread_index_free(index);
+}
+
+static void test_thread_deep(void **state) {
+	/* One long chain of replies, with a gap and a sibling thread */
+	enum { DEPTH = 20000 };
+	struct thread_index *index = create_thread_index();
+	thread_index_add(index, DEPTH + 1, "<top@x>", NULL, NULL);
+	char id[32], parent[32];
+	for (long uid = 1; uid <= DEPTH; ++uid) {
+		snprintf(id, sizeof(id), "<%ld@x>", uid);
+		snprintf(parent, sizeof(parent), "<%ld@x>", uid == 5 ? 3 : uid - 1);
+		thread_index_add(index, uid, uid == 4 ? "<4@y>" : id,
+				NULL, uid == 1 ? NULL : parent);
+	}
+	struct thread_list *threads = thread_index_flatten(index);
+	assert_int_equal(DEPTH + 1, threads->length);
+	assert_int_equal(1, uidset_get(threads->uids, 0));
+	assert_int_equal(0, threads->depths[0]);
+	/* Nothing replied to 4, so 5 carries on under 3 */
+	assert_int_equal(4, uidset_get(threads->uids, 3));
+	assert_int_equal(3, threads->depths[3]);
+	assert_int_equal(5, uidset_get(threads->uids, 4));
+	assert_int_equal(3, threads->depths[4]);
+	assert_int_equal(DEPTH, uidset_get(threads->uids, DEPTH - 1));
+	assert_int_equal(DEPTH - 2, threads->depths[DEPTH - 1]);
+	assert_int_equal(DEPTH + 1, uidset_get(threads->uids, DEPTH));
+	assert_int_equal(0, threads->depths[DEPTH]);
+	thread_list_free(threads);
+	thread_index_free(index);
+}
+
+int run_tests_thread() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_thread_replies),
+		cmocka_unit_test(test_thread_out_of_order),
+		cmocka_unit_test(test_thread_loops),
+		cmocka_unit_test(test_thread_deep),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "email/transfer.h"
+#include "util/base64.h"
+
+static char *wrap_lines(const char *text, size_t len, size_t width,
+		const char *line_break, size_t *wrapped_len) {
+	size_t break_len = strlen(line_break);
+	char *wrapped = malloc(len + (len / width + 1) * break_len);
+	size_t o = 0;
+	for (size_t i = 0; i < len; i += width) {
+		size_t n = len - i < width ? len - i : width;
+		memcpy(wrapped + o, text + i, n);
+		o += n;
+		memcpy(wrapped + o, line_break, break_len);
+		o += break_len;
+	}
+	*wrapped_len = o;
+	return wrapped;
+}
+
+static size_t decode_base64_chunked(enum transfer_impl impl,
+		const char *in, size_t len, size_t chunk, unsigned char *out) {
+	struct base64_decoder dec;
+	base64_decoder_init(&dec);
+	dec.impl = impl;
+	size_t o = 0;
+	for (size_t i = 0; i < len; i += chunk) {
+		size_t n = len - i < chunk ? len - i : chunk;
+		unsigned char *buf = malloc(BASE64_DECODED_MAX(n));
+		size_t written = base64_decode(&dec, in + i, n, buf);
+		memcpy(out + o, buf, written);
+		free(buf);
+		o += written;
+	}
+	return o + base64_decode_finish(&dec, out + o);
+}
+
+static void test_base64_round_trip(void **state) {
+	unsigned char data[5000];
+	srand(1);
+	for (size_t i = 0; i < sizeof(data); ++i) {
+		data[i] = rand();
+	}
+	const size_t chunks[] = { 1, 3, 7, 64, 1000, 100000 };
+	/* 76 is what mailers use; the others land lines all over the blocks */
+	const struct { size_t width; const char *line_break; } lines[] = {
+		{ 76, "\r\n" }, { 76, "\n" }, { 64, "\r\n" }, { 60, "\r\n" },
+		{ 72, "\n" }, { 77, "\r\n" }, { 4, "\r\n" }, { 100000, "" },
+	};
+	for (size_t trim = 0; trim < 3; ++trim) {
+		int encoded_len;
+		char *encoded = base64(data, sizeof(data) - trim, &encoded_len);
+		for (size_t l = 0; l < sizeof(lines) / sizeof(lines[0]); ++l) {
+			size_t wrapped_len;
+			char *wrapped = wrap_lines(encoded, encoded_len, lines[l].width,
+					lines[l].line_break, &wrapped_len);
+			for (int impl = TRANSFER_SCALAR;
+					impl <= (int)transfer_impl_best(); ++impl) {
+				for (size_t c = 0;
+						c < sizeof(chunks) / sizeof(chunks[0]); ++c) {
+					unsigned char out[sizeof(data)];
+					size_t len = decode_base64_chunked(impl,
+							wrapped, wrapped_len, chunks[c], out);
+					assert_int_equal(sizeof(data) - trim, len);
+					assert_memory_equal(data, out, len);
+				}
+			}
+			free(wrapped);
+		}
+		free(encoded);
+	}
+}
+
+static void test_base64_every_byte(void **state) {
+	/* Every byte value, at every offset of a vector block */
+	char text[97];
+	for (size_t i = 0; i < 96; ++i) {
+		text[i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+			[(i * 7) % 64];
+	}
+	text[96] = '\0';
+	for (int c = 0; c < 256; ++c) {
+		for (size_t pos = 0; pos < 48; ++pos) {
+			char copy[97];
+			memcpy(copy, text, sizeof(copy));
+			copy[pos] = (char)c;
+			unsigned char expected[BASE64_DECODED_MAX(96)];
+			size_t expected_len = decode_base64_chunked(
+					TRANSFER_SCALAR, copy, 96, 96, expected);
+			unsigned char out[BASE64_DECODED_MAX(96)];
+			size_t len = decode_base64_chunked(
+					transfer_impl_best(), copy, 96, 96, out);
+			assert_int_equal(expected_len, len);
+			assert_memory_equal(expected, out, len);
+		}
+	}
+}
+
+static void test_base64_padding(void **state) {
+	unsigned char out[16];
+	assert_int_equal(5, decode_base64_chunked(
+				transfer_impl_best(), "aGVsbG8=", 8, 8, out));
+	assert_memory_equal("hello", out, 5);
+	assert_int_equal(5, decode_base64_chunked(
+				transfer_impl_best(), "aGVsbG8", 7, 7, out));
+	assert_memory_equal("hello", out, 5);
+	assert_int_equal(4, decode_base64_chunked(
+				transfer_impl_best(), "aGV\r\nsbA==", 10, 2, out));
+	assert_memory_equal("hell", out, 4);
+}
+
+static void test_qp_decode(void **state) {
+	const char *text = "Caf=C3=A9 =\r\nsoft=\nbreak =ZZ =3d=3D\r\nlong "
+		"line of plain text to fill a vector block or two=2E trailing=";
+	const char *expected = "Caf\xC3\xA9 softbreak =ZZ ==\r\nlong "
+		"line of plain text to fill a vector block or two. trailing=";
+	size_t len = strlen(text);
+	for (int impl = TRANSFER_SCALAR;
+			impl <= (int)transfer_impl_best(); ++impl) {
+		for (size_t chunk = 1; chunk <= len; ++chunk) {
+			struct qp_decoder dec;
+			qp_decoder_init(&dec);
+			dec.impl = impl;
+			char out[256];
+			size_t o = 0;
+			for (size_t i = 0; i < len; i += chunk) {
+				size_t n = len - i < chunk ? len - i : chunk;
+				o += qp_decode(&dec, text + i, n, out + o);
+			}
+			o += qp_decode_finish(&dec, out + o);
+			out[o] = '\0';
+			assert_string_equal(expected, out);
+		}
+	}
+}
+
+int run_tests_transfer() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_base64_round_trip),
+		cmocka_unit_test(test_base64_every_byte),
+		cmocka_unit_test(test_base64_padding),
+		cmocka_unit_test(test_qp_decode),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,97 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "internal/imap.h"
+#include "imap/imap.h"
+#include "util/seqmap.h"
+
+extern void imap_init(struct imap_connection *imap);
+
+static size_t expunged[8];
+static long expunged_uids[8];
+static size_t expunged_count;
+
+static void message_expunged(struct imap_connection *imap, size_t seq,
+		long uid) {
+	expunged_uids[expunged_count] = uid;
+	expunged[expunged_count++] = seq;
+}
+
+static struct imap_connection *make_connection(void) {
+	struct imap_connection *imap = calloc(1, sizeof(struct imap_connection));
+	imap_init(imap);
+	imap->events.message_expunged = message_expunged;
+	imap->selected = strdup("INBOX");
+	struct mailbox *mbox = get_or_make_mailbox(imap, "INBOX");
+	for (long i = 1; i <= 10; ++i) {
+		struct mailbox_message *msg = calloc(1, sizeof(struct mailbox_message));
+		msg->uid = i * 100;
+		seqmap_append(mbox->messages, msg);
+		seqmap_set_uid(mbox->messages, i, msg->uid);
+	}
+	mbox->exists = 10;
+	expunged_count = 0;
+	return imap;
+}
+
+static void free_connection(struct imap_connection *imap) {
+	mailbox_free(get_mailbox(imap, "INBOX"));
+	list_free(imap->mailboxes);
+	free(imap->selected);
+	imap_close(imap);
+}
+
+static void test_handle_expunge(void **state) {
+	int _;
+	struct imap_connection *imap = make_connection();
+	struct mailbox *mbox = get_mailbox(imap, "INBOX");
+
+	const char *lines[] = { "* 3 EXPUNGE\r\n", "* 3 EXPUNGE\r\n" };
+	for (size_t i = 0; i < 2; ++i) {
+		imap_arg_t *arg = calloc(1, sizeof(imap_arg_t));
+		imap_parse_args(lines[i], arg, &_);
+		expect_string(__wrap_hashtable_get, key, "EXPUNGE");
+		will_return(__wrap_hashtable_get, handle_imap_expunge);
+		handle_line(imap, arg);
+		imap_arg_free(arg);
+	}
+
+	assert_int_equal(8, mbox->exists);
+	assert_int_equal(8, mbox->messages->count);
+	assert_int_equal(2, expunged_count);
+	assert_int_equal(3, expunged[0]);
+	assert_int_equal(3, expunged[1]);
+	assert_int_equal(300, expunged_uids[0]);
+	assert_int_equal(400, expunged_uids[1]);
+	assert_int_equal(500, seqmap_uid(mbox->messages, 3));
+	assert_int_equal(3, seqmap_seq(mbox->messages, 500));
+	assert_null(seqmap_find(mbox->messages, 300));
+	free_connection(imap);
+}
+
+static void test_handle_vanished(void **state) {
+	int _;
+	struct imap_connection *imap = make_connection();
+	struct mailbox *mbox = get_mailbox(imap, "INBOX");
+
+	imap_arg_t *arg = calloc(1, sizeof(imap_arg_t));
+	imap_parse_args("* VANISHED (EARLIER) 200,700:900,1234\r\n", arg, &_);
+	handle_imap_vanished(imap, arg->str, arg->next->str, arg->next->next);
+	imap_arg_free(arg);
+
+	assert_int_equal(6, mbox->messages->count);
+	assert_int_equal(4, expunged_count);
+	assert_int_equal(1000, seqmap_uid(mbox->messages, 6));
+	assert_int_equal(3, seqmap_seq(mbox->messages, 400));
+	free_connection(imap);
+}
+
+int run_tests_expunge() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_handle_expunge),
+		cmocka_unit_test(test_handle_vanished),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
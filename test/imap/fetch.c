@@ -0,0 +1,62 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "internal/imap.h"
+#include "imap/imap.h"
+#include "util/seqmap.h"
+
+extern void imap_init(struct imap_connection *imap);
+
+static struct mailbox_message *updated;
+
+static void message_updated(struct imap_connection *imap,
+		struct mailbox_message *msg) {
+	updated = msg;
+}
+
+static void test_handle_fetch(void **state) {
+	int _;
+	struct imap_connection *imap = calloc(1, sizeof(struct imap_connection));
+	imap_init(imap);
+	imap->flags = create_flag_table();
+	imap->events.message_updated = message_updated;
+	imap->selected = strdup("INBOX");
+	struct mailbox *mbox = get_or_make_mailbox(imap, "INBOX");
+	for (long i = 1; i <= 2; ++i) {
+		seqmap_append(mbox->messages,
+				calloc(1, sizeof(struct mailbox_message)));
+	}
+
+	/* Every item we know, and one we don't, after the last handler */
+	imap_arg_t *arg = calloc(1, sizeof(imap_arg_t));
+	imap_parse_args("* 2 FETCH (UID 100 RFC822.SIZE 2048 FLAGS (\\Seen) "
+			"X-GM-MSGID 42)\r\n", arg, &_);
+	expect_string(__wrap_hashtable_get, key, "FETCH");
+	will_return(__wrap_hashtable_get, handle_imap_fetch);
+	updated = NULL;
+	handle_line(imap, arg);
+	imap_arg_free(arg);
+
+	struct mailbox_message *msg = seqmap_get(mbox->messages, 2);
+	assert_ptr_equal(msg, updated);
+	assert_int_equal(100, msg->uid);
+	assert_int_equal(2048, msg->size);
+	assert_int_equal(FLAG_SEEN, msg->flags);
+	assert_true(msg->populated);
+	assert_ptr_equal(msg, seqmap_find(mbox->messages, 100));
+
+	flag_table_free(imap->flags);
+	mailbox_free(mbox);
+	list_free(imap->mailboxes);
+	free(imap->selected);
+	imap_close(imap);
+}
+
+int run_tests_fetch() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_handle_fetch),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
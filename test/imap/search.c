@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "internal/imap.h"
+#include "imap/imap.h"
+#include "email/thread.h"
+#include "util/uidset.h"
+
+extern void imap_init(struct imap_connection *imap);
+
+static uidset_t *result = NULL;
+
+static void search_callback(struct imap_connection *imap, void *data,
+		enum imap_status status, uidset_t *uids) {
+	assert_int_equal(STATUS_OK, status);
+	result = uids;
+}
+
+static void test_handle_esearch(void **state) {
+	int _;
+	struct imap_connection *imap = calloc(1, sizeof(struct imap_connection));
+	imap_init(imap);
+	imap->next_tag = 5;
+	imap->cap = calloc(1, sizeof(struct imap_capabilities));
+	imap->cap->esearch = true;
+
+	imap_search(imap, search_callback, NULL, "UNSEEN");
+
+	imap_arg_t *arg = calloc(1, sizeof(imap_arg_t));
+	imap_parse_args("* ESEARCH (TAG \"a0005\") UID ALL 4:18,21\r\n", arg, &_);
+	handle_imap_esearch(imap, arg->str, arg->next->str, arg->next->next);
+	imap_arg_free(arg);
+
+	arg = calloc(1, sizeof(imap_arg_t));
+	imap_parse_args("a0005 OK done\r\n", arg, &_);
+	expect_string(__wrap_hashtable_get, key, "OK");
+	will_return(__wrap_hashtable_get, handle_imap_status);
+	handle_line(imap, arg);
+	imap_arg_free(arg);
+
+	assert_non_null(result);
+	assert_int_equal(16, uidset_count(result));
+	assert_true(uidset_contains(result, 21));
+	assert_false(uidset_contains(result, 20));
+	uidset_free(result);
+	free(imap->cap);
+	imap_close(imap);
+}
+
+static struct thread_list *threads = NULL;
+
+static void thread_callback(struct imap_connection *imap, void *data,
+		enum imap_status status, struct thread_list *_threads) {
+	assert_int_equal(STATUS_OK, status);
+	threads = _threads;
+}
+
+static void test_handle_thread(void **state) {
+	int _;
+	struct imap_connection *imap = calloc(1, sizeof(struct imap_connection));
+	imap_init(imap);
+	imap->next_tag = 7;
+	imap->cap = calloc(1, sizeof(struct imap_capabilities));
+	imap->cap->thread_references = true;
+
+	imap_thread(imap, thread_callback, NULL, "ALL");
+
+	imap_arg_t *arg = calloc(1, sizeof(imap_arg_t));
+	imap_parse_args("* THREAD (2)(3 6 (4 23)(44 7 96))\r\n", arg, &_);
+	handle_imap_thread(imap, arg->str, arg->next->str, arg->next->next);
+	imap_arg_free(arg);
+
+	arg = calloc(1, sizeof(imap_arg_t));
+	imap_parse_args("a0007 OK done\r\n", arg, &_);
+	expect_string(__wrap_hashtable_get, key, "OK");
+	will_return(__wrap_hashtable_get, handle_imap_status);
+	handle_line(imap, arg);
+	imap_arg_free(arg);
+
+	assert_non_null(threads);
+	long uids[] = { 3, 6, 4, 23, 44, 7, 96, 2 };
+	int depths[] = { 0, 1, 2, 3, 2, 3, 4, 0 };
+	assert_int_equal(8, threads->length);
+	for (size_t i = 0; i < threads->length; ++i) {
+		assert_int_equal(uids[i], uidset_get(threads->uids, i));
+		assert_int_equal(depths[i], threads->depths[i]);
+	}
+	thread_list_free(threads);
+	free(imap->cap);
+	imap_close(imap);
+}
+
+int run_tests_search() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_handle_esearch),
+		cmocka_unit_test(test_handle_thread),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,123 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "internal/imap.h"
+#include "imap/imap.h"
+#include "util/seqmap.h"
+#include "util/uidset.h"
+
+extern void imap_init(struct imap_connection *imap);
+
+static enum imap_status result;
+
+static void store_callback(struct imap_connection *imap, void *data,
+		enum imap_status status, const char *args) {
+	result = status;
+}
+
+static bool has_flag(struct mailbox_message *msg, flagset_t flag) {
+	return msg->flags & flag;
+}
+
+static struct imap_connection *make_connection(long messages) {
+	struct imap_connection *imap = calloc(1, sizeof(struct imap_connection));
+	imap_init(imap);
+	imap->flags = create_flag_table();
+	imap->selected = strdup("INBOX");
+	struct mailbox *mbox = get_or_make_mailbox(imap, "INBOX");
+	for (long i = 1; i <= messages; ++i) {
+		struct mailbox_message *msg = calloc(1, sizeof(struct mailbox_message));
+		msg->uid = i;
+		msg->populated = true;
+		seqmap_append(mbox->messages, msg);
+		seqmap_set_uid(mbox->messages, i, i);
+	}
+	imap->next_tag = 1;
+	return imap;
+}
+
+static void free_connection(struct imap_connection *imap) {
+	flag_table_free(imap->flags);
+	mailbox_free(get_mailbox(imap, "INBOX"));
+	list_free(imap->mailboxes);
+	free(imap->selected);
+	imap_close(imap);
+}
+
+static void reply(struct imap_connection *imap, const char *line,
+		const char *status) {
+	int _;
+	imap_arg_t *arg = calloc(1, sizeof(imap_arg_t));
+	imap_parse_args(line, arg, &_);
+	expect_string(__wrap_hashtable_get, key, status);
+	will_return(__wrap_hashtable_get, handle_imap_status);
+	handle_line(imap, arg);
+	imap_arg_free(arg);
+}
+
+static void test_store_rollback(void **state) {
+	struct imap_connection *imap = make_connection(5);
+	struct mailbox *mbox = get_mailbox(imap, "INBOX");
+	((struct mailbox_message *)seqmap_find(mbox->messages, 2))->flags = FLAG_SEEN;
+
+	uidset_t *uids = create_uidset();
+	uidset_add_range(uids, 1, 3);
+	result = STATUS_OK;
+	imap_store(imap, store_callback, NULL, uids, true, FLAG_SEEN, NULL);
+
+	/* Applied before the server answers */
+	assert_true(has_flag(seqmap_find(mbox->messages, 1), FLAG_SEEN));
+	assert_true(has_flag(seqmap_find(mbox->messages, 3), FLAG_SEEN));
+	assert_false(has_flag(seqmap_find(mbox->messages, 4), FLAG_SEEN));
+
+	reply(imap, "a0001 NO Read only mailbox\r\n", "NO");
+
+	/* Put back, except for the message that already had it */
+	assert_int_equal(STATUS_NO, result);
+	assert_false(has_flag(seqmap_find(mbox->messages, 1), FLAG_SEEN));
+	assert_true(has_flag(seqmap_find(mbox->messages, 2), FLAG_SEEN));
+	assert_false(has_flag(seqmap_find(mbox->messages, 3), FLAG_SEEN));
+
+	uidset_free(uids);
+	free_connection(imap);
+}
+
+static void test_store_partial_failure(void **state) {
+	/*
+	 * Every other message makes one range each, which takes two commands.
+	 * Only the one the server refuses is put back and reported.
+	 */
+	struct imap_connection *imap = make_connection(1002);
+	struct mailbox *mbox = get_mailbox(imap, "INBOX");
+	uidset_t *uids = create_uidset();
+	for (long uid = 1; uid <= 1001; uid += 2) {
+		uidset_add(uids, uid);
+	}
+	uidset_t *failed = create_uidset();
+	result = STATUS_OK;
+	imap_store(imap, store_callback, NULL, uids, true, FLAG_FLAGGED, failed);
+
+	reply(imap, "a0002 NO Over quota\r\n", "NO");
+	reply(imap, "a0001 OK Done\r\n", "OK");
+	assert_int_equal(STATUS_NO, result);
+	char *str = uidset_serialize(failed);
+	assert_string_equal("1001", str);
+	free(str);
+	assert_true(has_flag(seqmap_find(mbox->messages, 1), FLAG_FLAGGED));
+	assert_true(has_flag(seqmap_find(mbox->messages, 999), FLAG_FLAGGED));
+	assert_false(has_flag(seqmap_find(mbox->messages, 1001), FLAG_FLAGGED));
+
+	uidset_free(failed);
+	uidset_free(uids);
+	free_connection(imap);
+}
+
+int run_tests_store() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_store_rollback),
+		cmocka_unit_test(test_store_partial_failure),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
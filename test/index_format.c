@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tests.h"
+#include "config.h"
+#include "email/headers.h"
+#include "index_format.h"
+
+static char *render(const struct index_format *format,
+		const struct index_row *row, int width) {
+	struct tb_cell basis = { .fg = 1, .bg = 2 };
+	struct tb_cell *cells = calloc(width, sizeof(struct tb_cell));
+	int len = render_index_format(format, row, &basis, cells, width);
+	char *text = malloc(len * 4 + 1);
+	size_t o = 0;
+	for (int i = 0; i < len; ++i) {
+		assert_int_equal(1, cells[i].fg);
+		o += tb_utf8_unicode_to_char(text + o, cells[i].ch);
+	}
+	text[o] = '\0';
+	free(cells);
+	return text;
+}
+
+static void test_compile(void **state) {
+	struct index_format *format = compile_index_format("%4C %Z %D %-17.17n %s");
+	assert_int_equal(9, format->length);
+	assert_int_equal(INDEX_NUMBER, format->ops[0].field);
+	assert_int_equal(4, format->ops[0].min_width);
+	assert_false(format->ops[0].left_align);
+	assert_int_equal(INDEX_LITERAL, format->ops[1].field);
+	assert_int_equal(INDEX_NAME, format->ops[6].field);
+	assert_int_equal(17, format->ops[6].min_width);
+	assert_int_equal(17, format->ops[6].max_width);
+	assert_true(format->ops[6].left_align);
+	assert_int_equal(1 << HEADER_FROM | 1 << HEADER_SUBJECT, format->headers);
+	assert_false(format->size);
+	free_index_format(format);
+
+	/* Literal runs are merged, unknown conversions kept as written */
+	format = compile_index_format("[%%%q] %s %");
+	assert_int_equal(3, format->length);
+	assert_int_equal(INDEX_LITERAL, format->ops[0].field);
+	assert_int_equal(6, format->ops[0].literal_length);
+	assert_memory_equal("[%%q] ", format->literals, 6);
+	assert_string_equal(" %", format->literals + format->ops[2].literal);
+	assert_int_equal(1 << HEADER_SUBJECT, format->headers);
+	free_index_format(format);
+}
+
+static void test_render(void **state) {
+	struct aerc_config test_config = { 0 };
+	test_config.ui.timestamp_format = "%Y-%m-%d";
+	struct aerc_config *old_config = config;
+	config = &test_config;
+	setenv("TZ", "UTC", 1);
+	tzset();
+
+	struct index_row row = {
+		.number = 42,
+		.date = 1500000000,
+		.flags = FLAG_FLAGGED,
+		.subject = "Caf\xC3\xA9 tonight?",
+		.from = "\"Jane Doe\" <jane@example.org>",
+	};
+	struct index_format *format = compile_index_format("%4C %Z %D %-6.6n|%s");
+	char *text = render(format, &row, 80);
+	assert_string_equal("  42 N!  2017-07-14 Jane D|Caf\xC3\xA9 tonight?", text);
+	free(text);
+
+	/* Cut off at the edge */
+	text = render(format, &row, 12);
+	assert_string_equal("  42 N!  201", text);
+	free(text);
+
+	/* Addresses stand in for missing names, and replies are indented */
+	row.from = "<jane@example.org>";
+	row.depth = 2;
+	row.flags = FLAG_SEEN | FLAG_ANSWERED;
+	free_index_format(format);
+	format = compile_index_format("%Z|%-20n|%.6s");
+	text = render(format, &row, 80);
+	assert_string_equal("  r|jane@example.org    |    Ca", text);
+	free(text);
+	free_index_format(format);
+
+	/* Dates are formatted once into the row's cache */
+	char cache[32] = "";
+	row.date_text = cache;
+	row.date_text_size = sizeof(cache);
+	format = compile_index_format("%D");
+	text = render(format, &row, 80);
+	assert_string_equal("2017-07-14", text);
+	assert_string_equal("2017-07-14", cache);
+	free(text);
+	test_config.ui.timestamp_format = "%Y";
+	text = render(format, &row, 80);
+	assert_string_equal("2017-07-14", text);
+	free(text);
+	cache[0] = '\0';
+	text = render(format, &row, 80);
+	assert_string_equal("2017", text);
+	free(text);
+	free_index_format(format);
+
+	/* Wide characters take two cells, the second blank */
+	row.depth = 0;
+	row.subject = "\xE4\xB8\xAD\xE6\x96\x87 mail";
+	format = compile_index_format("%-6.5s|");
+	text = render(format, &row, 80);
+	assert_string_equal("\xE4\xB8\xAD \xE6\x96\x87   |", text);
+	free(text);
+	free_index_format(format);
+
+	/* Stray Latin-1 bytes are drawn as one U+FFFD each, as measured */
+	row.subject = "caf\xE9 au lait";
+	format = compile_index_format("%-14.14s|");
+	text = render(format, &row, 80);
+	assert_string_equal("caf\xEF\xBF\xBD au lait  |", text);
+	free(text);
+	free_index_format(format);
+
+	format = compile_index_format("%5c");
+	assert_true(format->size);
+	assert_int_equal(0, format->headers);
+	const uint32_t sizes[] = { 999, 2560, 524288, 3 * 1024 * 1024 };
+	const char *expected[] = { "  999", " 2.5K", " 512K", " 3.0M" };
+	for (size_t i = 0; i < 4; ++i) {
+		row.size = sizes[i];
+		text = render(format, &row, 80);
+		assert_string_equal(expected[i], text);
+		free(text);
+	}
+	free_index_format(format);
+
+	config = old_config;
+}
+
+int run_tests_index_format() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_compile),
+		cmocka_unit_test(test_render),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -17,6 +17,24 @@ int main(int argc, char **argv) {
 	ret += run_tests_imap();
 	ret += run_tests_headers();
 	ret += run_tests_bind();
+	ret += run_tests_search();
+	ret += run_tests_uidset();
+	ret += run_tests_index();
+	ret += run_tests_thread();
+	ret += run_tests_seqmap();
+	ret += run_tests_expunge();
+	ret += run_tests_store();
+	ret += run_tests_fetch();
+	ret += run_tests_flags();
+	ret += run_tests_columns();
+	ret += run_tests_rfc2047();
+	ret += run_tests_transfer();
+	ret += run_tests_index_format();
+	ret += run_tests_colors();
+	ret += run_tests_spinners();
+	ret += run_tests_state();
+	ret += run_tests_utf7();
+	ret += run_tests_wcwidth();
 
 	return ret;
 }
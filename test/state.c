@@ -0,0 +1,121 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "state.h"
+#include "util/stringop.h"
+
+static struct aerc_mailbox *mailbox(const char *name, bool children) {
+	struct aerc_mailbox *mbox = calloc(1, sizeof(struct aerc_mailbox));
+	mbox->name = strdup(name);
+	mbox->flags = create_list();
+	if (children) {
+		list_add(mbox->flags, strdup("\\HasChildren"));
+	}
+	return mbox;
+}
+
+static void assert_order(struct account_state *account, const char **names,
+		size_t count) {
+	assert_int_equal(count, account->mailboxes->length);
+	for (size_t i = 0; i < count; ++i) {
+		struct aerc_mailbox *mbox = account->mailboxes->items[i];
+		assert_string_equal(names[i], mbox->name);
+	}
+}
+
+static void test_mailboxes_sorted(void **state) {
+	struct account_state account = { 0 };
+	list_t *listed = create_list();
+	list_add(listed, mailbox("Sent", false));
+	list_add(listed, mailbox("Archive", true));
+	list_add(listed, mailbox("INBOX", false));
+	set_aerc_mailboxes(&account, listed);
+	const char *listed_names[] = { "Archive", "INBOX", "Sent" };
+	assert_order(&account, listed_names, 3);
+
+	struct aerc_mailbox *archive = get_aerc_mailbox(&account, "Archive");
+	assert_non_null(archive);
+	assert_true(archive->has_children);
+	assert_string_equal("Archive", archive->leaf);
+	assert_int_equal(2, get_aerc_mailbox_index(&account, "Sent"));
+	assert_null(get_aerc_mailbox(&account, "Drafts"));
+
+	/* New folders go in their place, updated ones replace the old */
+	put_aerc_mailbox(&account, mailbox("Drafts", false));
+	put_aerc_mailbox(&account, mailbox("Zebra", false));
+	struct aerc_mailbox *inbox = mailbox("INBOX", false);
+	inbox->exists = 42;
+	put_aerc_mailbox(&account, inbox);
+	const char *put_names[] = { "Archive", "Drafts", "INBOX", "Sent", "Zebra" };
+	assert_order(&account, put_names, 5);
+	assert_ptr_equal(inbox, get_aerc_mailbox(&account, "INBOX"));
+	assert_string_equal("INBOX", inbox->leaf);
+
+	/* Names are decoded for display, and measured once */
+	put_aerc_mailbox(&account, mailbox("Entw&APw-rfe", false));
+	struct aerc_mailbox *drafts = get_aerc_mailbox(&account, "Entw&APw-rfe");
+	assert_string_equal("Entw\xC3\xBC" "rfe", drafts->leaf);
+	assert_int_equal(8, drafts->leaf_width);
+	remove_aerc_mailbox(&account, "Entw&APw-rfe");
+
+	remove_aerc_mailbox(&account, "Drafts");
+	remove_aerc_mailbox(&account, "Nowhere");
+	const char *removed_names[] = { "Archive", "INBOX", "Sent", "Zebra" };
+	assert_order(&account, removed_names, 4);
+
+	for (size_t i = 0; i < account.mailboxes->length; ++i) {
+		free_aerc_mailbox(account.mailboxes->items[i]);
+	}
+	list_free(account.mailboxes);
+}
+
+static void test_folder_tree(void **state) {
+	struct account_state account = { 0 };
+	list_t *listed = create_list();
+	const char *names[] = { "A b", "A/b", "A", "A/b/c", "B" };
+	for (size_t i = 0; i < 5; ++i) {
+		struct aerc_mailbox *mbox = mailbox(names[i],
+				!strcmp(names[i], "A") || !strcmp(names[i], "A/b"));
+		mbox->delimiter = '/';
+		list_add(listed, mbox);
+	}
+	set_aerc_mailboxes(&account, listed);
+	/* Children follow their parent, ahead of its siblings */
+	const char *sorted[] = { "A", "A/b", "A/b/c", "A b", "B" };
+	assert_order(&account, sorted, 5);
+	struct aerc_mailbox *c = get_aerc_mailbox(&account, "A/b/c");
+	assert_string_equal("c", c->leaf);
+	assert_int_equal(2, c->depth);
+	assert_string_equal("A/b/c", c->display_name);
+
+	/* Collapsed folders hide their descendants */
+	size_t count;
+	const size_t *rows = get_folder_rows(&account, &count);
+	assert_int_equal(3, count);
+	assert_int_equal(0, rows[0]);
+	assert_int_equal(3, rows[1]);
+	assert_int_equal(-1, get_folder_row(&account, 1));
+	assert_int_equal(2, get_folder_row(&account, 4));
+
+	get_aerc_mailbox(&account, "A")->expanded = true;
+	invalidate_folder_rows(&account);
+	rows = get_folder_rows(&account, &count);
+	assert_int_equal(4, count);
+	assert_int_equal(1, rows[1]);
+	assert_int_equal(-1, get_folder_row(&account, 2));
+
+	invalidate_folder_rows(&account);
+	for (size_t i = 0; i < account.mailboxes->length; ++i) {
+		free_aerc_mailbox(account.mailboxes->items[i]);
+	}
+	list_free(account.mailboxes);
+}
+
+int run_tests_state() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_mailboxes_sorted),
+		cmocka_unit_test(test_folder_tree),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "util/seqmap.h"
+
+static void *item(long n) {
+	return (void *)(intptr_t)n;
+}
+
+static void test_seqmap_lookup(void **state) {
+	seqmap_t *map = create_seqmap();
+	for (long i = 1; i <= 1000; ++i) {
+		seqmap_append(map, item(i));
+		seqmap_set_uid(map, i, i * 10);
+	}
+	assert_int_equal(1000, map->count);
+	assert_int_equal(1000, map->hashed);
+	assert_ptr_equal(item(500), seqmap_get(map, 500));
+	assert_int_equal(5000, seqmap_uid(map, 500));
+	assert_ptr_equal(item(500), seqmap_find(map, 5000));
+	assert_int_equal(500, seqmap_seq(map, 5000));
+	assert_null(seqmap_find(map, 5001));
+	assert_int_equal(0, seqmap_seq(map, 5001));
+	assert_null(seqmap_get(map, 1001));
+	seqmap_free(map);
+}
+
+static void test_seqmap_remove(void **state) {
+	seqmap_t *map = create_seqmap();
+	for (long i = 1; i <= 100; ++i) {
+		seqmap_append(map, item(i));
+		seqmap_set_uid(map, i, i);
+	}
+	/* Expunging 3 moves everything after it up one */
+	assert_ptr_equal(item(3), seqmap_remove(map, 3));
+	assert_int_equal(99, map->count);
+	assert_ptr_equal(item(4), seqmap_get(map, 3));
+	assert_int_equal(3, seqmap_seq(map, 4));
+	assert_null(seqmap_find(map, 3));
+	/* Remove most of them to force compaction, keeping every tenth */
+	for (long seq = map->count; seq > 0; --seq) {
+		if (seqmap_uid(map, seq) % 10 != 0) {
+			seqmap_remove(map, seq);
+		}
+	}
+	assert_int_equal(10, map->count);
+	for (long i = 0; i < 100; ++i) {
+		seqmap_append(map, item(1000 + i));
+	}
+	assert_int_equal(110, map->count);
+	assert_int_equal(7, seqmap_seq(map, 70));
+	assert_ptr_equal(item(100), seqmap_get(map, 10));
+	assert_ptr_equal(item(1000), seqmap_get(map, 11));
+
+	size_t cursor = 0, n = 0;
+	void *it;
+	while (seqmap_iter(map, &cursor, &it)) {
+		++n;
+		if (n == 1) assert_ptr_equal(item(10), it);
+	}
+	assert_int_equal(110, n);
+	seqmap_free(map);
+}
+
+static void test_seqmap_set_uid_late(void **state) {
+	/* UIDs are learned whenever messages happen to be fetched */
+	seqmap_t *map = create_seqmap();
+	for (long i = 1; i <= 10; ++i) {
+		seqmap_append(map, item(i));
+	}
+	seqmap_set_uid(map, 7, 70);
+	seqmap_set_uid(map, 2, 20);
+	seqmap_remove(map, 1);
+	assert_int_equal(1, seqmap_seq(map, 20));
+	assert_int_equal(6, seqmap_seq(map, 70));
+	assert_int_equal(0, seqmap_uid(map, 2));
+	seqmap_free(map);
+}
+
+int run_tests_seqmap() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_seqmap_lookup),
+		cmocka_unit_test(test_seqmap_remove),
+		cmocka_unit_test(test_seqmap_set_uid_late),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
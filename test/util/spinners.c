@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include "tests.h"
+#include "util/spinners.h"
+
+static int collect(const spinners_t *spinners, int *xs, int *ys) {
+	size_t cursor = 0;
+	int n = 0;
+	while (spinners_iter(spinners, &cursor, &xs[n], &ys[n])) {
+		++n;
+	}
+	return n;
+}
+
+static void test_spinners_add_remove(void **state) {
+	spinners_t *spinners = create_spinners();
+	assert_true(spinners_add(spinners, 0, 1));
+	assert_true(spinners_add(spinners, 20, 1));
+	assert_true(spinners_add(spinners, 20, 1));
+	assert_false(spinners_add(spinners, 40, 1));
+	assert_true(spinners_add(spinners, 20, 200));
+	assert_int_equal(3, spinners->count);
+
+	int xs[8], ys[8];
+	assert_int_equal(3, collect(spinners, xs, ys));
+	assert_int_equal(0, xs[0]);
+	assert_int_equal(1, ys[0]);
+	assert_int_equal(20, xs[1]);
+	assert_int_equal(1, ys[1]);
+	assert_int_equal(20, xs[2]);
+	assert_int_equal(200, ys[2]);
+
+	/* Only the message list side of row 1 */
+	spinners_remove(spinners, 20, 1, 60, 1);
+	assert_int_equal(2, collect(spinners, xs, ys));
+	assert_int_equal(0, xs[0]);
+	assert_int_equal(200, ys[1]);
+
+	spinners_clear(spinners);
+	assert_int_equal(0, spinners->count);
+	assert_int_equal(0, collect(spinners, xs, ys));
+	spinners_free(spinners);
+}
+
+static void test_spinners_scroll(void **state) {
+	spinners_t *spinners = create_spinners();
+	for (int y = 1; y <= 5; ++y) {
+		spinners_add(spinners, 20, y);
+	}
+	spinners_add(spinners, 0, 3);
+
+	int xs[8], ys[8];
+	spinners_scroll(spinners, 20, 1, 60, 5, 2);
+	assert_int_equal(4, collect(spinners, xs, ys));
+	assert_int_equal(20, xs[0]);
+	assert_int_equal(1, ys[0]);
+	assert_int_equal(20, xs[1]);
+	assert_int_equal(2, ys[1]);
+	/* The one outside the rectangle is left alone */
+	assert_int_equal(3, ys[2]);
+	assert_int_equal(3, ys[3]);
+	assert_int_equal(20, xs[2] + xs[3]);
+
+	spinners_scroll(spinners, 20, 1, 60, 5, -3);
+	assert_int_equal(3, collect(spinners, xs, ys));
+	assert_int_equal(0, xs[0]);
+	assert_int_equal(3, ys[0]);
+	assert_int_equal(4, ys[1]);
+	assert_int_equal(5, ys[2]);
+	spinners_free(spinners);
+}
+
+int run_tests_spinners() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_spinners_add_remove),
+		cmocka_unit_test(test_spinners_scroll),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
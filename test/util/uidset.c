@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "util/uidset.h"
+
+static void test_uidset_add_merges(void **state) {
+	uidset_t *set = create_uidset();
+	uidset_add(set, 5);
+	uidset_add(set, 1);
+	uidset_add(set, 3);
+	uidset_add(set, 2);
+	uidset_add(set, 4);
+	uidset_add(set, 10);
+	assert_int_equal(2, set->length);
+	assert_int_equal(6, uidset_count(set));
+	char *str = uidset_serialize(set);
+	assert_string_equal("1:5,10", str);
+	free(str);
+	assert_true(uidset_contains(set, 3));
+	assert_false(uidset_contains(set, 6));
+	uidset_free(set);
+}
+
+static void test_uidset_add_range_overlapping(void **state) {
+	uidset_t *set = create_uidset();
+	uidset_add_range(set, 1, 3);
+	uidset_add_range(set, 7, 9);
+	uidset_add_range(set, 12, 15);
+	uidset_add_range(set, 2, 13);
+	assert_int_equal(1, set->length);
+	assert_int_equal(1, set->ranges[0].min);
+	assert_int_equal(15, set->ranges[0].max);
+	uidset_free(set);
+}
+
+static void test_uidset_parse(void **state) {
+	uidset_t *set = create_uidset();
+	assert_true(uidset_parse(set, "9:12,1:5,7", false));
+	char *str = uidset_serialize(set);
+	assert_string_equal("1:5,7,9:12", str);
+	free(str);
+	assert_false(uidset_parse(set, "1:x", false));
+	uidset_free(set);
+}
+
+static void test_uidset_parse_ordered(void **state) {
+	uidset_t *set = create_uidset();
+	assert_true(uidset_parse(set, "8,3:1,4:6", true));
+	assert_int_equal(8, uidset_get(set, 0));
+	assert_int_equal(3, uidset_get(set, 1));
+	assert_int_equal(1, uidset_get(set, 3));
+	assert_int_equal(6, uidset_get(set, 6));
+	assert_int_equal(-1, uidset_get(set, 7));
+	/* 3:1 is one descending run */
+	assert_int_equal(3, set->length);
+	uidset_free(set);
+}
+
+static void test_uidset_append_descending(void **state) {
+	/* A REVERSE sort of a mailbox with no gaps is a single run */
+	uidset_t *set = create_uidset();
+	for (long uid = 1000; uid > 0; --uid) {
+		uidset_append(set, uid);
+	}
+	assert_int_equal(1, set->length);
+	assert_int_equal(1000, uidset_count(set));
+	assert_int_equal(1000, uidset_get(set, 0));
+	assert_int_equal(1, uidset_get(set, 999));
+	/* Runs don't change direction */
+	uidset_append(set, 2);
+	uidset_append(set, 3);
+	uidset_append(set, 10);
+	uidset_append(set, 9);
+	assert_int_equal(3, set->length);
+	assert_int_equal(2, uidset_get(set, 1000));
+	assert_int_equal(3, uidset_get(set, 1001));
+	assert_int_equal(9, uidset_get(set, 1003));
+	char *str = uidset_serialize(set);
+	assert_string_equal("1:1000,2:3,9:10", str);
+	free(str);
+	uidset_free(set);
+}
+
+int run_tests_uidset() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_uidset_add_merges),
+		cmocka_unit_test(test_uidset_add_range_overlapping),
+		cmocka_unit_test(test_uidset_parse),
+		cmocka_unit_test(test_uidset_parse_ordered),
+		cmocka_unit_test(test_uidset_append_descending),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
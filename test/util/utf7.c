@@ -0,0 +1,54 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "util/utf7.h"
+
+static void assert_decodes(const char *expected, const char *name) {
+	char *decoded = utf7_decode(name);
+	assert_non_null(decoded);
+	assert_string_equal(expected, decoded);
+	free(decoded);
+}
+
+static void assert_encodes(const char *expected, const char *text) {
+	char *encoded = utf7_encode(text);
+	assert_string_equal(expected, encoded);
+	free(encoded);
+}
+
+static void test_utf7_decode(void **state) {
+	assert_decodes("INBOX", "INBOX");
+	assert_decodes("Tom & Jerry", "Tom &- Jerry");
+	assert_decodes("Entw\xC3\xBC" "rfe", "Entw&APw-rfe");
+	/* From RFC 3501 */
+	assert_decodes("~peter/mail/\xE5\x8F\xB0\xE5\x8C\x97/\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E",
+			"~peter/mail/&U,BTFw-/&ZeVnLIqe-");
+	/* Outside the BMP, as a surrogate pair */
+	assert_decodes("\xF0\x9F\x93\xA7", "&2D3c5w-");
+
+	assert_null(utf7_decode("Entw&APw"));
+	assert_null(utf7_decode("&AP!-"));
+	assert_null(utf7_decode("&2D0-"));
+	assert_null(utf7_decode("&APx-"));
+	assert_null(utf7_decode("Entw\xC3\xBC" "rfe"));
+}
+
+static void test_utf7_encode(void **state) {
+	assert_encodes("INBOX", "INBOX");
+	assert_encodes("Tom &- Jerry", "Tom & Jerry");
+	assert_encodes("Entw&APw-rfe", "Entw\xC3\xBC" "rfe");
+	assert_encodes("~peter/mail/&U,BTFw-/&ZeVnLIqe-",
+			"~peter/mail/\xE5\x8F\xB0\xE5\x8C\x97/\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E");
+	assert_encodes("&2D3c5w-", "\xF0\x9F\x93\xA7");
+	assert_encodes("a&,,0-b", "a\xFF" "b");
+	assert_encodes("&,,0-", "\x80");
+	assert_encodes("&,,0-a&,,0-", "\x80" "a\x80");
+}
+
+int run_tests_utf7() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_utf7_decode),
+		cmocka_unit_test(test_utf7_encode),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "util/wcwidth.h"
+
+static void test_codepoint_width(void **state) {
+	assert_int_equal(1, codepoint_width('a'));
+	assert_int_equal(0, codepoint_width('\t'));
+	assert_int_equal(1, codepoint_width(0xE9)); // é
+	assert_int_equal(0, codepoint_width(0x301)); // Combining acute accent
+	assert_int_equal(0, codepoint_width(0x200B)); // Zero width space
+	assert_int_equal(2, codepoint_width(0x4E2D)); // 中
+	assert_int_equal(2, codepoint_width(0xFF21)); // Fullwidth A
+	assert_int_equal(2, codepoint_width(0x1F4E7)); // 📧
+	assert_int_equal(2, codepoint_width(0x2A6D6)); // Plane 2
+	assert_int_equal(1, codepoint_width(0x10FFFD));
+}
+
+static void test_next_codepoint(void **state) {
+	size_t n;
+	assert_int_equal('a', next_codepoint("a", 1, &n));
+	assert_int_equal(1, n);
+	assert_int_equal(0x4E2D, next_codepoint("\xE4\xB8\xAD", 3, &n));
+	assert_int_equal(3, n);
+	/* Stray, cut off and badly continued bytes are taken one at a time */
+	assert_int_equal(0xFFFD, next_codepoint("\xE9 au", 4, &n));
+	assert_int_equal(1, n);
+	assert_int_equal(0xFFFD, next_codepoint("\xE4\xB8", 2, &n));
+	assert_int_equal(1, n);
+	assert_int_equal(0xFFFD, next_codepoint("\xC3" "a", 2, &n));
+	assert_int_equal(1, n);
+}
+
+static void test_utf8_width(void **state) {
+	const char *text = "The quick brown fox jumps over the lazy dog";
+	assert_int_equal(strlen(text), utf8_width(text, strlen(text)));
+	text = "Caf\xC3\xA9 cafe\xCC\x81 \xE4\xB8\xAD\xE6\x96\x87 \xF0\x9F\x93\xA7";
+	assert_int_equal(17, utf8_width(text, strlen(text)));
+	/* Stray and cut off bytes are a column each */
+	assert_int_equal(4, utf8_width("a\xFF\xE4\xB8", 4));
+}
+
+static void test_utf8_truncate(void **state) {
+	int width;
+	const char *text = "A long run of ASCII text, longer than a vector";
+	assert_int_equal(20, utf8_truncate(text, strlen(text), 20, &width));
+	assert_int_equal(20, width);
+	assert_int_equal(strlen(text), utf8_truncate(text, strlen(text), 80, &width));
+	assert_int_equal(strlen(text), width);
+
+	/* Wide characters aren't split, and combining marks stay with theirs */
+	text = "\xE4\xB8\xAD\xE6\x96\x87xe\xCC\x81y";
+	assert_int_equal(3, utf8_truncate(text, strlen(text), 3, &width));
+	assert_int_equal(2, width);
+	assert_int_equal(10, utf8_truncate(text, strlen(text), 6, &width));
+	assert_int_equal(6, width);
+	assert_int_equal(0, utf8_truncate(text, strlen(text), 0, &width));
+	assert_int_equal(0, width);
+}
+
+int run_tests_wcwidth() {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_codepoint_width),
+		cmocka_unit_test(test_next_codepoint),
+		cmocka_unit_test(test_utf8_width),
+		cmocka_unit_test(test_utf8_truncate),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -29,6 +29,11 @@ int __wrap_ab_recv(absocket_t *socket, void *buffer, size_t len) {
 	return mock_type(int);
 }
 
+ssize_t __wrap_ab_send(absocket_t *socket, void *buffer, size_t len) {
+	// no-op
+	return len;
+}
+
 void __wrap_absocket_free(void *socket) {
 	// no-op
 }